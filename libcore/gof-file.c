@@ -63,6 +63,22 @@ static guint    signals[LAST_SIGNAL];
 
 static guint32  effective_user_id;
 
+/* Pixbuf residency: every file holding a pix is linked into a global LRU queue,
+ * most recently drawn first. Once the resident bytes exceed the budget the pix of
+ * files which have not been drawn within the grace period (i.e. are not visible
+ * in any view) are dropped. gof_file_update_icon () reloads them on next draw.
+ */
+#define GOF_FILE_PIX_DEFAULT_BUDGET (256 * 1024 * 1024)
+#define GOF_FILE_PIX_DEFAULT_GRACE_MS 2000
+
+G_LOCK_DEFINE_STATIC (pix_lru_mutex);
+
+static GQueue   pix_lru = G_QUEUE_INIT;
+static guint64  pix_resident_bytes = 0;
+static guint64  pix_evictions = 0;
+static guint64  pix_budget = GOF_FILE_PIX_DEFAULT_BUDGET;
+static gint64   pix_grace_usec = GOF_FILE_PIX_DEFAULT_GRACE_MS * 1000;
+
 static gpointer _g_object_ref0 (gpointer self) {
     return self ? g_object_ref (self) : NULL;
 }
@@ -395,7 +411,8 @@ gof_file_update_type (GOFFile *file)
     gof_file_update_formated_type (file);
     /* update icon */
     file->icon = g_content_type_get_icon (ftype);
-    if (file->pix_size > 1)
+    /* An evicted pix is reloaded lazily when next drawn */
+    if (file->pix_size > 1 && file->pix != NULL)
         gof_file_update_icon_internal (file, file->pix_size);
 
     gof_file_icon_changed (file);
@@ -693,29 +710,162 @@ gof_file_get_icon_pixbuf (GOFFile *file, gint size, gboolean force_size, GOFFile
     return pix;
 }
 
+/* Must be called with pix_lru_mutex held */
+static void
+gof_file_pix_residency_remove_unlocked (GOFFile *file)
+{
+    if (file->pix_lru_link == NULL)
+        return;
+
+    g_queue_delete_link (&pix_lru, file->pix_lru_link);
+    file->pix_lru_link = NULL;
+    pix_resident_bytes -= file->pix_bytes;
+    file->pix_bytes = 0;
+}
+
+static void
+gof_file_pix_residency_remove (GOFFile *file)
+{
+    G_LOCK (pix_lru_mutex);
+    gof_file_pix_residency_remove_unlocked (file);
+    G_UNLOCK (pix_lru_mutex);
+}
+
+/* Drop the pix of the least recently drawn files until we are back under budget.
+ * Files drawn within the grace period are considered visible and are kept even
+ * if this means exceeding the budget for a while.
+ */
+static void
+gof_file_pix_residency_evict_unlocked (void)
+{
+    gint64 now = g_get_monotonic_time ();
+    GList *link;
+    GOFFile *victim;
+
+    while (pix_resident_bytes > pix_budget && (link = g_queue_peek_tail_link (&pix_lru)) != NULL) {
+        victim = link->data;
+        /* never evict the pix which has just been requested */
+        if (link == pix_lru.head || now - victim->pix_last_used < pix_grace_usec)
+            break;
+
+        gof_file_pix_residency_remove_unlocked (victim);
+        /* Keep pix_size so that thumbnail updates still pick the right size */
+        _g_object_unref0 (victim->pix);
+        pix_evictions++;
+    }
+}
+
+static void
+gof_file_pix_residency_add (GOFFile *file)
+{
+    g_return_if_fail (file->pix != NULL);
+
+    G_LOCK (pix_lru_mutex);
+    gof_file_pix_residency_remove_unlocked (file);
+    file->pix_bytes = gdk_pixbuf_get_byte_length (file->pix);
+    file->pix_last_used = g_get_monotonic_time ();
+    pix_resident_bytes += file->pix_bytes;
+    g_queue_push_head (&pix_lru, file);
+    file->pix_lru_link = g_queue_peek_head_link (&pix_lru);
+    gof_file_pix_residency_evict_unlocked ();
+    G_UNLOCK (pix_lru_mutex);
+}
+
+static void
+gof_file_pix_residency_touch (GOFFile *file)
+{
+    G_LOCK (pix_lru_mutex);
+    if (file->pix_lru_link != NULL) {
+        g_queue_unlink (&pix_lru, file->pix_lru_link);
+        g_queue_push_head_link (&pix_lru, file->pix_lru_link);
+        file->pix_last_used = g_get_monotonic_time ();
+    }
+    G_UNLOCK (pix_lru_mutex);
+}
+
+/**
+ * gof_file_add_pixbuf_bytes:
+ * @n_bytes : the size of data made from the pix of @file, which is dropped together with it.
+ *
+ * Counts @n_bytes against the pixbuf budget for as long as the current pix is kept.
+ **/
+void
+gof_file_add_pixbuf_bytes (GOFFile *file, gsize n_bytes)
+{
+    G_LOCK (pix_lru_mutex);
+    if (file->pix_lru_link != NULL) {
+        file->pix_bytes += n_bytes;
+        pix_resident_bytes += n_bytes;
+        /* the pix is being drawn: move it to the head, which is never evicted */
+        g_queue_unlink (&pix_lru, file->pix_lru_link);
+        g_queue_push_head_link (&pix_lru, file->pix_lru_link);
+        file->pix_last_used = g_get_monotonic_time ();
+        gof_file_pix_residency_evict_unlocked ();
+    }
+    G_UNLOCK (pix_lru_mutex);
+}
+
+/**
+ * gof_file_set_pixbuf_budget:
+ * @max_bytes : the number of bytes of icon pixbufs allowed to stay resident, 0 for unlimited.
+ * @grace_ms  : files drawn less than @grace_ms ago are never evicted.
+ **/
+void
+gof_file_set_pixbuf_budget (guint64 max_bytes, guint grace_ms)
+{
+    G_LOCK (pix_lru_mutex);
+    pix_budget = max_bytes > 0 ? max_bytes : G_MAXUINT64;
+    pix_grace_usec = (gint64) grace_ms * 1000;
+    gof_file_pix_residency_evict_unlocked ();
+    G_UNLOCK (pix_lru_mutex);
+}
+
+/**
+ * gof_file_get_pixbuf_residency:
+ * @n_files     : (out) (allow-none): number of files currently holding a pixbuf.
+ * @n_bytes     : (out) (allow-none): number of bytes held by those pixbufs and what is drawn from them.
+ * @n_evictions : (out) (allow-none): number of pixbufs evicted since startup.
+ **/
+void
+gof_file_get_pixbuf_residency (guint *n_files, guint64 *n_bytes, guint64 *n_evictions)
+{
+    G_LOCK (pix_lru_mutex);
+    if (n_files != NULL)
+        *n_files = g_queue_get_length (&pix_lru);
+    if (n_bytes != NULL)
+        *n_bytes = pix_resident_bytes;
+    if (n_evictions != NULL)
+        *n_evictions = pix_evictions;
+    G_UNLOCK (pix_lru_mutex);
+}
+
 static void
 gof_file_update_icon_internal (GOFFile *file, gint size)
 {
     g_return_if_fail (size >= 1);
     /* destroy pixbuff if already present */
+    gof_file_pix_residency_remove (file);
     _g_object_unref0 (file->pix);
     /* make sure we always got a non null pixbuf of the specified size */
     file->pix = gof_file_get_icon_pixbuf (file, size,
                                           gof_preferences_get_force_icon_size (gof_preferences_get_default ()),
                                           GOF_FILE_ICON_FLAGS_USE_THUMBNAILS);
     file->pix_size = size;
+    gof_file_pix_residency_add (file);
 }
 
 /* This function is used by the icon renderer and fm-list-model.
- * Store the pixbuf and update it only for size change.
+ * Store the pixbuf and update it only for size change or after it was evicted.
  */
 void gof_file_update_icon (GOFFile *file, gint size)
 {
     if (size <= 1)
         return;
 
-    if (!(file->pix == NULL || file->pix_size != size))
+    if (!(file->pix == NULL || file->pix_size != size)) {
+        gof_file_pix_residency_touch (file);
         return;
+    }
 
     gof_file_update_icon_internal (file, size);
 }
@@ -907,7 +1057,9 @@ gof_file_query_thumbnail_update (GOFFile *file)
         g_free (md5_hash);
     }
 
-    gof_file_update_icon_internal (file, file->pix_size);
+    /* An evicted pix is reloaded lazily when next drawn */
+    if (file->pix != NULL)
+        gof_file_update_icon_internal (file, file->pix_size);
 }
 
 void gof_file_update_trash_info (GOFFile *file)
@@ -947,6 +1099,8 @@ static void gof_file_init (GOFFile *file) {
     file->target_location = NULL;
     file->icon = NULL;
     file->pix = NULL;
+    file->pix_lru_link = NULL;
+    file->pix_bytes = 0;
     file->color = 0;
     file->width = 0;
     file->height = 0;
@@ -1003,6 +1157,7 @@ static void gof_file_finalize (GObject* obj) {
     _g_free0(file->format_size);
     _g_free0(file->formated_modified);
     _g_object_unref0 (file->icon);
+    gof_file_pix_residency_remove (file);
     _g_object_unref0 (file->pix);
     //g_clear_object (&file->pix);
 
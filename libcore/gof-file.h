@@ -89,6 +89,10 @@ struct _GOFFile {
     gchar           *custom_icon_name;
     GdkPixbuf       *pix;
     gint            pix_size;
+    /* pixbuf residency bookkeeping, see gof_file_set_pixbuf_budget () */
+    GList           *pix_lru_link;
+    gsize           pix_bytes;
+    gint64          pix_last_used;
     gint            width;
     gint            height;
     guint64         modified;
@@ -227,6 +231,10 @@ void            gof_file_set_thumb_state (GOFFile *file, GOFFileThumbState state
 void            gof_file_add_emblem(GOFFile* file, const gchar* emblem);
 GMount*         gof_file_get_mount_at (GFile* target);
 
+void            gof_file_add_pixbuf_bytes (GOFFile *file, gsize n_bytes);
+void            gof_file_set_pixbuf_budget (guint64 max_bytes, guint grace_ms);
+void            gof_file_get_pixbuf_residency (guint *n_files, guint64 *n_bytes, guint64 *n_evictions);
+
 /* To provide a wrapper around g_file_get_uri (not sure it is really useful tough) */
 #define gof_file_get_uri(obj) g_file_get_uri(obj->location)
 /**
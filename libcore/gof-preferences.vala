@@ -26,6 +26,9 @@ namespace GOF {
         public bool show_hidden_files {get; set; default=false;}
         public bool show_remote_thumbnails {set; get; default=false;}
         public bool confirm_trash {set; get; default=true;}
+        public bool journal_transfers {set; get; default=true;}
+        public bool prescan_conflicts {set; get; default=true;}
+        public bool verify_copies {set; get; default=false;}
         public bool force_icon_size {set; get; default=true;}
         public string date_format {set; get; default="iso";}
         public string clock_format {set; get; default="24h";}
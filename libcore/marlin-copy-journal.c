@@ -0,0 +1,798 @@
+/* marlin-copy-journal.c - on-disk journal of copy and move jobs
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+/* A copy or move job writes down what it has done, so that the job can be resumed when the application
+ * goes away before it is finished. The journal is a text file with one record per line, each made of
+ * tab separated fields (URIs never contain tabs or newlines):
+ *
+ *   pantheon-files-journal  1
+ *   op      copy | move
+ *   dest    <destination folder>
+ *   src     <source>                                  (one line for each source)
+ *   d       <source>  <target>                        (folder created)
+ *   f       <source>  <target>                        (file copied or moved)
+ *   p       <source>  <target>  <offset>  <size>  <mtime>   (file copied up to offset)
+ *
+ * Records are only ever appended. They are buffered and written out at least once a second, and the
+ * offset of the file being copied is recorded once a second too, once the data before it has been
+ * synced to disk, so whatever the job did in the last second before it was interrupted may be done
+ * again. Offsets are only recorded for local files written in place. A job removes its journal when it ends, whether
+ * it finished or was cancelled, so a journal left behind by a process that is no longer running is one
+ * to offer for resuming.
+ *
+ * The job thread is the only one recording, the mutex only keeps the journal consistent should that
+ * ever change.
+ */
+
+#define _GNU_SOURCE
+
+#include "marlin-copy-journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <glib/gstdio.h>
+
+#define JOURNAL_APP_DIR "io.elementary.files"
+#define JOURNAL_MAGIC "pantheon-files-journal"
+#define JOURNAL_VERSION 1
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_FLUSH_SIZE (64 * 1024)
+#define JOURNAL_FLUSH_INTERVAL_USEC G_USEC_PER_SEC
+#define JOURNAL_PARTIAL_INTERVAL_USEC G_USEC_PER_SEC
+#define JOURNAL_RESUME_BUFFER_SIZE (256 * 1024)
+
+#define JOURNAL_FILE_ATTRIBUTES \
+    G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+    G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+    G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+    G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC
+
+typedef struct {
+    goffset offset;
+    goffset size;
+    guint64 mtime;
+} JournalPartial;
+
+struct _MarlinCopyJournal {
+    GMutex mutex;
+    char *path;
+    int fd;
+    gboolean failed;
+    gboolean is_move;
+    GList *sources;
+    GFile *destination;
+    /* Only set for journals loaded from disk, and not written to afterwards */
+    GHashTable *states;
+    GHashTable *partials;
+    /* Protected by mutex */
+    GString *buffer;
+    gint64 last_flush_time;
+    char *partial_key;
+    guint64 partial_mtime;
+    gint64 last_partial_time;
+};
+
+static volatile gint journal_counter = 0;
+
+static char *
+journal_get_dir (void)
+{
+    return g_build_filename (g_get_user_data_dir (), JOURNAL_APP_DIR, "journals", NULL);
+}
+
+/* Journals are named after the process writing them, which tells a journal of a running job from one
+ * left behind */
+static char *
+journal_new_path (void)
+{
+    char *dir, *name, *path;
+
+    dir = journal_get_dir ();
+    if (g_mkdir_with_parents (dir, 0700) != 0) {
+        g_warning ("Could not create %s: %s", dir, g_strerror (errno));
+        g_free (dir);
+        return NULL;
+    }
+
+    name = g_strdup_printf ("%d-%d" JOURNAL_SUFFIX, (int) getpid (),
+                            g_atomic_int_add (&journal_counter, 1));
+    path = g_build_filename (dir, name, NULL);
+    g_free (name);
+    g_free (dir);
+
+    return path;
+}
+
+static char *
+journal_key (GFile *src,
+             GFile *dest)
+{
+    char *src_uri, *dest_uri, *key;
+
+    src_uri = g_file_get_uri (src);
+    dest_uri = g_file_get_uri (dest);
+    key = g_strconcat (src_uri, "\t", dest_uri, NULL);
+    g_free (src_uri);
+    g_free (dest_uri);
+
+    return key;
+}
+
+static guint64
+journal_info_get_mtime (GFileInfo *info)
+{
+    return g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+           g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+}
+
+static MarlinCopyJournal *
+journal_new (const char *path)
+{
+    MarlinCopyJournal *journal;
+
+    journal = g_slice_new0 (MarlinCopyJournal);
+    g_mutex_init (&journal->mutex);
+    journal->path = g_strdup (path);
+    journal->fd = -1;
+    journal->buffer = g_string_new (NULL);
+
+    return journal;
+}
+
+static void
+journal_free (MarlinCopyJournal *journal)
+{
+    if (journal->fd >= 0) {
+        close (journal->fd);
+    }
+
+    g_mutex_clear (&journal->mutex);
+    g_free (journal->path);
+    g_list_free_full (journal->sources, g_object_unref);
+    g_clear_object (&journal->destination);
+    if (journal->states != NULL) {
+        g_hash_table_destroy (journal->states);
+        g_hash_table_destroy (journal->partials);
+    }
+    g_string_free (journal->buffer, TRUE);
+    g_free (journal->partial_key);
+    g_slice_free (MarlinCopyJournal, journal);
+}
+
+/* Writes out the buffered records. Journaling is given up on the first error, the job itself goes on */
+static void
+journal_flush_locked (MarlinCopyJournal *journal)
+{
+    const char *data;
+    gsize left;
+    gssize written;
+
+    journal->last_flush_time = g_get_monotonic_time ();
+
+    if (journal->buffer->len == 0 || journal->failed) {
+        return;
+    }
+
+    if (journal->fd < 0) {
+        journal->fd = open (journal->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        if (journal->fd < 0) {
+            g_warning ("Could not open %s: %s", journal->path, g_strerror (errno));
+            journal->failed = TRUE;
+            return;
+        }
+    }
+
+    data = journal->buffer->str;
+    left = journal->buffer->len;
+    while (left > 0) {
+        written = write (journal->fd, data, left);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            g_warning ("Could not write to %s: %s", journal->path, g_strerror (errno));
+            journal->failed = TRUE;
+            break;
+        }
+
+        data += written;
+        left -= written;
+    }
+
+    g_string_truncate (journal->buffer, 0);
+}
+
+static void
+journal_append (MarlinCopyJournal *journal,
+                char kind,
+                GFile *src,
+                GFile *dest)
+{
+    char *key;
+
+    if (journal->failed) {
+        return;
+    }
+
+    key = journal_key (src, dest);
+
+    g_mutex_lock (&journal->mutex);
+
+    if (kind == 'f' && g_strcmp0 (journal->partial_key, key) == 0) {
+        g_clear_pointer (&journal->partial_key, g_free);
+    }
+
+    g_string_append_printf (journal->buffer, "%c\t%s\n", kind, key);
+
+    if (journal->buffer->len >= JOURNAL_FLUSH_SIZE ||
+        g_get_monotonic_time () - journal->last_flush_time >= JOURNAL_FLUSH_INTERVAL_USEC) {
+        journal_flush_locked (journal);
+    }
+
+    g_mutex_unlock (&journal->mutex);
+
+    g_free (key);
+}
+
+/**
+ * marlin_copy_journal_new:
+ * @is_move: whether the job moves its sources
+ * @sources: the files the job copies or moves
+ * @destination: the folder they go to
+ *
+ * Starts the journal of a job and writes its description to disk.
+ *
+ * Returns: the journal, or %NULL when it could not be created.
+ */
+MarlinCopyJournal *
+marlin_copy_journal_new (gboolean is_move,
+                         GList *sources,
+                         GFile *destination)
+{
+    MarlinCopyJournal *journal;
+    char *path, *uri;
+    GList *l;
+
+    path = journal_new_path ();
+    if (path == NULL) {
+        return NULL;
+    }
+
+    journal = journal_new (path);
+    g_free (path);
+
+    journal->is_move = is_move;
+    journal->destination = g_object_ref (destination);
+    for (l = sources; l != NULL; l = l->next) {
+        journal->sources = g_list_prepend (journal->sources, g_object_ref (l->data));
+    }
+    journal->sources = g_list_reverse (journal->sources);
+
+    g_string_append_printf (journal->buffer, "%s\t%d\n", JOURNAL_MAGIC, JOURNAL_VERSION);
+    g_string_append_printf (journal->buffer, "op\t%s\n", is_move ? "move" : "copy");
+    uri = g_file_get_uri (destination);
+    g_string_append_printf (journal->buffer, "dest\t%s\n", uri);
+    g_free (uri);
+    for (l = journal->sources; l != NULL; l = l->next) {
+        uri = g_file_get_uri (l->data);
+        g_string_append_printf (journal->buffer, "src\t%s\n", uri);
+        g_free (uri);
+    }
+
+    journal_flush_locked (journal);
+    if (journal->failed) {
+        g_unlink (journal->path);
+        journal_free (journal);
+        return NULL;
+    }
+
+    return journal;
+}
+
+/* Reads a journal written by another process. A line cut short by the end of that process is ignored */
+static MarlinCopyJournal *
+journal_load (const char *path)
+{
+    MarlinCopyJournal *journal;
+    JournalPartial *partial;
+    char *contents, *key;
+    char **lines, **fields;
+    guint i, n_lines;
+    MarlinCopyJournalState state;
+
+    if (!g_file_get_contents (path, &contents, NULL, NULL)) {
+        return NULL;
+    }
+
+    lines = g_strsplit (contents, "\n", -1);
+    g_free (contents);
+
+    n_lines = g_strv_length (lines);
+    if (n_lines < 1 || g_strcmp0 (lines[0], JOURNAL_MAGIC "\t1") != 0) {
+        g_strfreev (lines);
+        return NULL;
+    }
+
+    journal = journal_new (path);
+    journal->states = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    journal->partials = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+    /* The last element is whatever follows the last newline */
+    for (i = 1; i + 1 < n_lines; i++) {
+        fields = g_strsplit (lines[i], "\t", -1);
+
+        if (g_strv_length (fields) == 2 && strcmp (fields[0], "op") == 0) {
+            journal->is_move = strcmp (fields[1], "move") == 0;
+        } else if (g_strv_length (fields) == 2 && strcmp (fields[0], "dest") == 0) {
+            g_clear_object (&journal->destination);
+            journal->destination = g_file_new_for_uri (fields[1]);
+        } else if (g_strv_length (fields) == 2 && strcmp (fields[0], "src") == 0) {
+            journal->sources = g_list_prepend (journal->sources, g_file_new_for_uri (fields[1]));
+        } else if (g_strv_length (fields) >= 3 && fields[0][0] != '\0' && fields[0][1] == '\0') {
+            key = g_strconcat (fields[1], "\t", fields[2], NULL);
+            state = MARLIN_COPY_JOURNAL_NONE;
+
+            if (fields[0][0] == 'd') {
+                state = MARLIN_COPY_JOURNAL_FOLDER_CREATED;
+            } else if (fields[0][0] == 'f') {
+                state = MARLIN_COPY_JOURNAL_FILE_DONE;
+                g_hash_table_remove (journal->partials, key);
+            } else if (fields[0][0] == 'p' && g_strv_length (fields) == 6) {
+                state = MARLIN_COPY_JOURNAL_FILE_PARTIAL;
+                partial = g_new (JournalPartial, 1);
+                partial->offset = g_ascii_strtoll (fields[3], NULL, 10);
+                partial->size = g_ascii_strtoll (fields[4], NULL, 10);
+                partial->mtime = g_ascii_strtoull (fields[5], NULL, 10);
+                g_hash_table_replace (journal->partials, g_strdup (key), partial);
+            }
+
+            if (state != MARLIN_COPY_JOURNAL_NONE) {
+                g_hash_table_replace (journal->states, key, GINT_TO_POINTER (state));
+            } else {
+                g_free (key);
+            }
+        }
+
+        g_strfreev (fields);
+    }
+
+    g_strfreev (lines);
+
+    journal->sources = g_list_reverse (journal->sources);
+    if (journal->destination == NULL || journal->sources == NULL) {
+        journal_free (journal);
+        return NULL;
+    }
+
+    return journal;
+}
+
+static gboolean
+journal_pid_is_running (const char *name)
+{
+    char *end;
+    long pid;
+
+    pid = strtol (name, &end, 10);
+    if (end == name || *end != '-' || pid <= 0) {
+        return FALSE;
+    }
+
+    if (pid == getpid ()) {
+        return TRUE;
+    }
+
+    return kill ((pid_t) pid, 0) == 0 || errno == EPERM;
+}
+
+/**
+ * marlin_copy_journal_list_interrupted:
+ *
+ * Loads the journals left behind by jobs that did not end, and takes them over so that no other
+ * instance offers them as well. Unreadable journals are removed.
+ *
+ * Returns: (transfer full): a list of #MarlinCopyJournal, to be resumed through a new job or discarded.
+ */
+GList *
+marlin_copy_journal_list_interrupted (void)
+{
+    MarlinCopyJournal *journal;
+    GList *journals;
+    GDir *dir;
+    const char *name;
+    char *dir_path, *path, *new_path;
+
+    journals = NULL;
+    dir_path = journal_get_dir ();
+    dir = g_dir_open (dir_path, 0, NULL);
+    if (dir == NULL) {
+        g_free (dir_path);
+        return NULL;
+    }
+
+    while ((name = g_dir_read_name (dir)) != NULL) {
+        if (!g_str_has_suffix (name, JOURNAL_SUFFIX) || journal_pid_is_running (name)) {
+            continue;
+        }
+
+        path = g_build_filename (dir_path, name, NULL);
+        journal = journal_load (path);
+
+        if (journal == NULL) {
+            g_unlink (path);
+        } else {
+            new_path = journal_new_path ();
+            if (new_path != NULL && g_rename (path, new_path) == 0) {
+                g_free (journal->path);
+                journal->path = new_path;
+                journals = g_list_prepend (journals, journal);
+            } else {
+                g_free (new_path);
+                journal_free (journal);
+            }
+        }
+
+        g_free (path);
+    }
+
+    g_dir_close (dir);
+    g_free (dir_path);
+
+    return g_list_reverse (journals);
+}
+
+/**
+ * marlin_copy_journal_discard:
+ *
+ * Removes the journal from disk and frees it. Jobs do this when they end, finished or cancelled.
+ */
+void
+marlin_copy_journal_discard (MarlinCopyJournal *journal)
+{
+    g_unlink (journal->path);
+    journal_free (journal);
+}
+
+gboolean
+marlin_copy_journal_get_is_move (MarlinCopyJournal *journal)
+{
+    return journal->is_move;
+}
+
+/**
+ * marlin_copy_journal_get_sources:
+ *
+ * Returns: (transfer none): the files the job was started on.
+ */
+GList *
+marlin_copy_journal_get_sources (MarlinCopyJournal *journal)
+{
+    return journal->sources;
+}
+
+/**
+ * marlin_copy_journal_get_destination:
+ *
+ * Returns: (transfer none): the folder the files go to.
+ */
+GFile *
+marlin_copy_journal_get_destination (MarlinCopyJournal *journal)
+{
+    return journal->destination;
+}
+
+/**
+ * marlin_copy_journal_is_resuming:
+ *
+ * Returns: whether @journal was left behind by an interrupted job, i.e. whether there is anything
+ * to look up in it.
+ */
+gboolean
+marlin_copy_journal_is_resuming (MarlinCopyJournal *journal)
+{
+    return journal->states != NULL;
+}
+
+/**
+ * marlin_copy_journal_lookup:
+ *
+ * Tells what the interrupted job did with @src. A copy the job made but did not get to record in its
+ * last second is recognised by having the size and modification time of its source, as the copy
+ * takes these from the source. Moves do not go by that since they also have to delete the source.
+ *
+ * Returns: %MARLIN_COPY_JOURNAL_NONE for anything the job did not get to, and always for journals
+ * that are not resuming.
+ */
+MarlinCopyJournalState
+marlin_copy_journal_lookup (MarlinCopyJournal *journal,
+                            GFile *src,
+                            GFile *dest)
+{
+    MarlinCopyJournalState state;
+    GFileInfo *src_info, *dest_info;
+    char *key;
+
+    if (journal->states == NULL) {
+        return MARLIN_COPY_JOURNAL_NONE;
+    }
+
+    key = journal_key (src, dest);
+    state = GPOINTER_TO_INT (g_hash_table_lookup (journal->states, key));
+    g_free (key);
+
+    if (state != MARLIN_COPY_JOURNAL_NONE || journal->is_move) {
+        return state;
+    }
+
+    dest_info = g_file_query_info (dest, JOURNAL_FILE_ATTRIBUTES, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                   NULL, NULL);
+    if (dest_info == NULL) {
+        return MARLIN_COPY_JOURNAL_NONE;
+    }
+
+    src_info = g_file_query_info (src, JOURNAL_FILE_ATTRIBUTES, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                  NULL, NULL);
+    if (src_info != NULL &&
+        g_file_info_get_file_type (src_info) == G_FILE_TYPE_REGULAR &&
+        g_file_info_get_file_type (dest_info) == G_FILE_TYPE_REGULAR &&
+        g_file_info_get_size (src_info) == g_file_info_get_size (dest_info) &&
+        g_file_info_get_attribute_uint64 (src_info, G_FILE_ATTRIBUTE_TIME_MODIFIED) ==
+        g_file_info_get_attribute_uint64 (dest_info, G_FILE_ATTRIBUTE_TIME_MODIFIED)) {
+        state = MARLIN_COPY_JOURNAL_FILE_DONE;
+    }
+
+    g_clear_object (&src_info);
+    g_object_unref (dest_info);
+
+    return state;
+}
+
+/**
+ * marlin_copy_journal_resume_file:
+ *
+ * Finishes the copy of a file the interrupted job copied part of, starting from the recorded offset.
+ * This is only done when the source has the size and modification time it had then and the partial
+ * copy is not shorter than recorded; otherwise this fails with %G_IO_ERROR_NOT_SUPPORTED, and the
+ * caller is expected to copy the file again from the start on any failure.
+ *
+ * @progress_callback is called with the offset in the whole file, as the copy would have.
+ */
+gboolean
+marlin_copy_journal_resume_file (MarlinCopyJournal *journal,
+                                 GFile *src,
+                                 GFile *dest,
+                                 GFileCopyFlags flags,
+                                 GCancellable *cancellable,
+                                 GFileProgressCallback progress_callback,
+                                 gpointer progress_callback_data,
+                                 GError **error)
+{
+    JournalPartial *partial;
+    GFileInfo *info;
+    GFileInputStream *in;
+    GFileIOStream *io;
+    GOutputStream *out;
+    goffset offset;
+    gssize n_read;
+    gboolean res;
+    char *key, *buffer;
+
+    partial = NULL;
+    if (journal->partials != NULL) {
+        key = journal_key (src, dest);
+        partial = g_hash_table_lookup (journal->partials, key);
+        g_free (key);
+    }
+
+    if (partial == NULL) {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "No partial copy recorded");
+        return FALSE;
+    }
+
+    info = g_file_query_info (src, JOURNAL_FILE_ATTRIBUTES, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                              cancellable, error);
+    if (info == NULL) {
+        return FALSE;
+    }
+
+    res = g_file_info_get_size (info) == partial->size &&
+          journal_info_get_mtime (info) == partial->mtime;
+    g_object_unref (info);
+
+    if (res) {
+        info = g_file_query_info (dest, G_FILE_ATTRIBUTE_STANDARD_SIZE, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                  cancellable, error);
+        if (info == NULL) {
+            return FALSE;
+        }
+
+        res = g_file_info_get_size (info) >= partial->offset;
+        g_object_unref (info);
+    }
+
+    if (!res) {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "The file changed since the copy was interrupted");
+        return FALSE;
+    }
+
+    in = g_file_read (src, cancellable, error);
+    if (in == NULL) {
+        return FALSE;
+    }
+
+    /* Anything beyond the recorded offset may not have been written completely */
+    io = NULL;
+    res = g_seekable_seek (G_SEEKABLE (in), partial->offset, G_SEEK_SET, cancellable, error) &&
+          (io = g_file_open_readwrite (dest, cancellable, error)) != NULL &&
+          g_seekable_truncate (G_SEEKABLE (io), partial->offset, cancellable, error) &&
+          g_seekable_seek (G_SEEKABLE (io), partial->offset, G_SEEK_SET, cancellable, error);
+
+    offset = partial->offset;
+    buffer = g_malloc (JOURNAL_RESUME_BUFFER_SIZE);
+
+    while (res) {
+        n_read = g_input_stream_read (G_INPUT_STREAM (in), buffer, JOURNAL_RESUME_BUFFER_SIZE,
+                                      cancellable, error);
+        if (n_read <= 0) {
+            res = n_read == 0;
+            break;
+        }
+
+        out = g_io_stream_get_output_stream (G_IO_STREAM (io));
+        res = g_output_stream_write_all (out, buffer, n_read, NULL, cancellable, error);
+        offset += n_read;
+
+        if (res && progress_callback != NULL) {
+            progress_callback (offset, partial->size, progress_callback_data);
+        }
+    }
+
+    g_free (buffer);
+
+    if (io != NULL) {
+        res = g_io_stream_close (G_IO_STREAM (io), cancellable, res ? error : NULL) && res;
+        g_object_unref (io);
+    }
+
+    g_input_stream_close (G_INPUT_STREAM (in), NULL, NULL);
+    g_object_unref (in);
+
+    if (res) {
+        /* Ignore errors here. Failure to copy metadata is not a hard error */
+        g_file_copy_attributes (src, dest, flags, cancellable, NULL);
+    }
+
+    return res;
+}
+
+void
+marlin_copy_journal_folder_created (MarlinCopyJournal *journal,
+                                    GFile *src,
+                                    GFile *dest)
+{
+    journal_append (journal, 'd', src, dest);
+}
+
+void
+marlin_copy_journal_file_done (MarlinCopyJournal *journal,
+                               GFile *src,
+                               GFile *dest)
+{
+    journal_append (journal, 'f', src, dest);
+}
+
+/* Makes sure what was written to @file so far is on disk */
+static gboolean
+journal_sync_file (GFile *file)
+{
+    char *path;
+    int fd, res;
+
+    /* Remote files cannot be synced from here */
+    path = g_file_get_path (file);
+    if (path == NULL) {
+        return FALSE;
+    }
+
+    fd = open (path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    g_free (path);
+    if (fd < 0) {
+        return FALSE;
+    }
+
+    res = fdatasync (fd);
+    close (fd);
+
+    return res == 0;
+}
+
+/**
+ * marlin_copy_journal_file_progress:
+ *
+ * Records how far the copy of @src has got, at most once a second. The size and modification time of
+ * @src are kept along with the offset, to check on resuming that the source did not change.
+ *
+ * The data of @dest is synced before, so that the offset never gets to disk ahead of the data it
+ * stands for: resuming truncates @dest to it, and would otherwise leave a run of zeros in the copy.
+ * Nothing is recorded when @dest cannot be synced, and its copy is then started again on resuming.
+ */
+void
+marlin_copy_journal_file_progress (MarlinCopyJournal *journal,
+                                   GFile *src,
+                                   GFile *dest,
+                                   goffset offset,
+                                   goffset size)
+{
+    GFileInfo *info;
+    char *key;
+    gint64 now;
+
+    now = g_get_monotonic_time ();
+
+    g_mutex_lock (&journal->mutex);
+
+    if (journal->failed || now - journal->last_partial_time < JOURNAL_PARTIAL_INTERVAL_USEC) {
+        g_mutex_unlock (&journal->mutex);
+        return;
+    }
+
+    journal->last_partial_time = now;
+
+    if (!journal_sync_file (dest)) {
+        g_mutex_unlock (&journal->mutex);
+        return;
+    }
+
+    key = journal_key (src, dest);
+    if (g_strcmp0 (journal->partial_key, key) != 0) {
+        info = g_file_query_info (src, JOURNAL_FILE_ATTRIBUTES, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                  NULL, NULL);
+        if (info == NULL) {
+            g_mutex_unlock (&journal->mutex);
+            g_free (key);
+            return;
+        }
+
+        journal->partial_mtime = journal_info_get_mtime (info);
+        g_object_unref (info);
+
+        g_free (journal->partial_key);
+        journal->partial_key = key;
+    } else {
+        g_free (key);
+    }
+
+    g_string_append_printf (journal->buffer,
+                            "p\t%s\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%" G_GUINT64_FORMAT "\n",
+                            journal->partial_key, (gint64) offset, (gint64) size, journal->partial_mtime);
+
+    /* Written out right away, together with the records before it */
+    journal_flush_locked (journal);
+
+    g_mutex_unlock (&journal->mutex);
+}
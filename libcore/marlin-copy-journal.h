@@ -0,0 +1,70 @@
+/* marlin-copy-journal.h - on-disk journal of copy and move jobs
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+#ifndef MARLIN_COPY_JOURNAL_H
+#define MARLIN_COPY_JOURNAL_H
+
+#include <gio/gio.h>
+
+typedef struct _MarlinCopyJournal MarlinCopyJournal;
+
+typedef enum {
+    MARLIN_COPY_JOURNAL_NONE,
+    MARLIN_COPY_JOURNAL_FOLDER_CREATED,
+    MARLIN_COPY_JOURNAL_FILE_PARTIAL,
+    MARLIN_COPY_JOURNAL_FILE_DONE
+} MarlinCopyJournalState;
+
+MarlinCopyJournal      *marlin_copy_journal_new                 (gboolean                is_move,
+                                                                 GList                  *sources,
+                                                                 GFile                  *destination);
+GList                  *marlin_copy_journal_list_interrupted    (void);
+void                    marlin_copy_journal_discard             (MarlinCopyJournal      *journal);
+
+gboolean                marlin_copy_journal_get_is_move         (MarlinCopyJournal      *journal);
+GList                  *marlin_copy_journal_get_sources         (MarlinCopyJournal      *journal);
+GFile                  *marlin_copy_journal_get_destination     (MarlinCopyJournal      *journal);
+gboolean                marlin_copy_journal_is_resuming         (MarlinCopyJournal      *journal);
+
+MarlinCopyJournalState  marlin_copy_journal_lookup              (MarlinCopyJournal      *journal,
+                                                                 GFile                  *src,
+                                                                 GFile                  *dest);
+gboolean                marlin_copy_journal_resume_file         (MarlinCopyJournal      *journal,
+                                                                 GFile                  *src,
+                                                                 GFile                  *dest,
+                                                                 GFileCopyFlags          flags,
+                                                                 GCancellable           *cancellable,
+                                                                 GFileProgressCallback   progress_callback,
+                                                                 gpointer                progress_callback_data,
+                                                                 GError                **error);
+
+void                    marlin_copy_journal_folder_created      (MarlinCopyJournal      *journal,
+                                                                 GFile                  *src,
+                                                                 GFile                  *dest);
+void                    marlin_copy_journal_file_progress       (MarlinCopyJournal      *journal,
+                                                                 GFile                  *src,
+                                                                 GFile                  *dest,
+                                                                 goffset                 offset,
+                                                                 goffset                 size);
+void                    marlin_copy_journal_file_done           (MarlinCopyJournal      *journal,
+                                                                 GFile                  *src,
+                                                                 GFile                  *dest);
+
+#endif /* MARLIN_COPY_JOURNAL_H */
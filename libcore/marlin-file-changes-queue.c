@@ -27,13 +27,17 @@ typedef enum {
     CHANGE_FILE_ADDED,
     CHANGE_FILE_CHANGED,
     CHANGE_FILE_REMOVED,
-    CHANGE_FILE_MOVED
+    CHANGE_FILES_REMOVED,
+    CHANGE_FILE_MOVED,
+    CHANGE_FILES_MOVED
 } MarlinFileChangeKind;
 
 typedef struct {
     MarlinFileChangeKind kind;
     GFile *from;
     GFile *to;
+    GList *locations;
+    GList *pairs;
     GdkPoint point;
     int screen;
 } MarlinFileChange;
@@ -122,6 +126,29 @@ marlin_file_changes_queue_file_removed (GFile *location)
     marlin_file_changes_queue_add_common (queue, new_item);
 }
 
+/* Queues the removal of a batch of files as a single change, so that it reaches the views in one go */
+void
+marlin_file_changes_queue_files_removed (GList *locations)
+{
+    MarlinFileChange *new_item;
+    MarlinFileChangesQueue *queue;
+    GList *l;
+
+    if (locations == NULL) {
+        return;
+    }
+
+    queue = marlin_file_changes_queue_get();
+
+    new_item = g_new0 (MarlinFileChange, 1);
+    new_item->kind = CHANGE_FILES_REMOVED;
+    for (l = locations; l != NULL; l = l->next) {
+        new_item->locations = g_list_prepend (new_item->locations, g_object_ref (l->data));
+    }
+    new_item->locations = g_list_reverse (new_item->locations);
+    marlin_file_changes_queue_add_common (queue, new_item);
+}
+
 void
 marlin_file_changes_queue_file_moved (GFile *from,
                                       GFile *to)
@@ -138,6 +165,38 @@ marlin_file_changes_queue_file_moved (GFile *from,
     marlin_file_changes_queue_add_common (queue, new_item);
 }
 
+/* Queues the moves of a batch of files as a single change. @from and @to are lists of the same length,
+ * the nth file of @from was moved to the nth file of @to */
+void
+marlin_file_changes_queue_files_moved (GList *from,
+                                       GList *to)
+{
+    MarlinFileChange *new_item;
+    MarlinFileChangesQueue *queue;
+    GArray *pair;
+    GFile *file;
+    GList *f, *t;
+
+    if (from == NULL) {
+        return;
+    }
+
+    queue = marlin_file_changes_queue_get ();
+
+    new_item = g_new0 (MarlinFileChange, 1);
+    new_item->kind = CHANGE_FILES_MOVED;
+    for (f = from, t = to; f != NULL && t != NULL; f = f->next, t = t->next) {
+        pair = g_array_sized_new (FALSE, FALSE, sizeof (GFile *), 2);
+        file = g_object_ref (f->data);
+        g_array_append_val (pair, file);
+        file = g_object_ref (t->data);
+        g_array_append_val (pair, file);
+        new_item->pairs = g_list_prepend (new_item->pairs, pair);
+    }
+    new_item->pairs = g_list_reverse (new_item->pairs);
+    marlin_file_changes_queue_add_common (queue, new_item);
+}
+
 static MarlinFileChange *
 marlin_file_changes_queue_get_change (MarlinFileChangesQueue *queue)
 {
@@ -231,10 +290,12 @@ marlin_file_changes_consume_changes (gboolean consume_all)
                 && change->kind != CHANGE_FILE_CHANGED;
 
             flush_needed |= moves != NULL
-                && change->kind != CHANGE_FILE_MOVED;
+                && change->kind != CHANGE_FILE_MOVED
+                && change->kind != CHANGE_FILES_MOVED;
 
             flush_needed |= deletions != NULL
-                && change->kind != CHANGE_FILE_REMOVED;
+                && change->kind != CHANGE_FILE_REMOVED
+                && change->kind != CHANGE_FILES_REMOVED;
 
             /*flush_needed |= position_set_requests != NULL
                 && change->kind != CHANGE_POSITION_SET
@@ -297,6 +358,11 @@ marlin_file_changes_consume_changes (gboolean consume_all)
             deletions = g_list_prepend (deletions, change->from);
             break;
 
+        case CHANGE_FILES_REMOVED:
+            /* deletions is built in reverse */
+            deletions = g_list_concat (g_list_reverse (change->locations), deletions);
+            break;
+
         case CHANGE_FILE_MOVED:
             pair = g_array_sized_new (FALSE, FALSE, sizeof (GFile *), 2);
             g_array_append_val (pair, change->from);
@@ -304,6 +370,11 @@ marlin_file_changes_consume_changes (gboolean consume_all)
             moves = g_list_prepend (moves, pair);
             break;
 
+        case CHANGE_FILES_MOVED:
+            /* moves is built in reverse */
+            moves = g_list_concat (g_list_reverse (change->pairs), moves);
+            break;
+
         default:
             g_assert_not_reached ();
             break;
@@ -28,8 +28,11 @@
 void marlin_file_changes_queue_file_added                      (GFile      *location);
 void marlin_file_changes_queue_file_changed                    (GFile      *location);
 void marlin_file_changes_queue_file_removed                    (GFile      *location);
+void marlin_file_changes_queue_files_removed                   (GList      *locations);
 void marlin_file_changes_queue_file_moved                      (GFile      *from,
                                                                 GFile      *to);
+void marlin_file_changes_queue_files_moved                     (GList      *from,
+                                                                GList      *to);
 
 void marlin_file_changes_consume_changes                       (gboolean    consume_all);
 
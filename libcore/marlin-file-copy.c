@@ -0,0 +1,503 @@
+/* marlin-file-copy.c - copying of local files through the kernel
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+/* Regular local files are copied without passing their data through user space: the destination is
+ * cloned (FICLONE) where the filesystem supports reflinks, otherwise the data is copied in the kernel
+ * with copy_file_range () and, failing that, with sendfile (). The holes of sparse files (VM images,
+ * databases) are skipped with SEEK_DATA/SEEK_HOLE so that the copy stays sparse. Anything else (remote
+ * files, folders, symlinks, special files, files of /proc or /sys, or a kernel that supports none of
+ * these) goes through g_file_copy () as before.
+ */
+
+#define _GNU_SOURCE
+
+#include "marlin-file-copy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <sys/vfs.h>
+#include <linux/fs.h>
+#include <linux/magic.h>
+#endif
+
+/* Amount copied between progress reports and cancellation checks */
+#define COPY_CHUNK_SIZE (8 * 1024 * 1024)
+
+typedef enum {
+    KERNEL_COPY_DONE,
+    KERNEL_COPY_FAILED,
+    KERNEL_COPY_UNSUPPORTED
+} KernelCopyResult;
+
+const char *
+marlin_file_copy_method_to_string (MarlinFileCopyMethod method)
+{
+    switch (method) {
+    case MARLIN_FILE_COPY_METHOD_CLONE:
+        return "clone";
+    case MARLIN_FILE_COPY_METHOD_COPY_FILE_RANGE:
+        return "copy_file_range";
+    case MARLIN_FILE_COPY_METHOD_SENDFILE:
+        return "sendfile";
+    case MARLIN_FILE_COPY_METHOD_GIO:
+    default:
+        return "gio";
+    }
+}
+
+static void
+set_error_from_errno (GError **error,
+                      int errsv,
+                      const char *format,
+                      const char *path)
+{
+    char *display_name;
+
+    display_name = g_filename_display_name (path);
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 format, display_name, g_strerror (errsv));
+    g_free (display_name);
+}
+
+/* Errors meaning the kernel or the filesystems cannot do this kind of copy, rather than that it failed */
+static gboolean
+is_unsupported_errno (int errsv)
+{
+    return errsv == ENOSYS || errsv == EXDEV || errsv == EINVAL || errsv == EOPNOTSUPP || errsv == ENOTTY;
+}
+
+#ifdef __linux__
+static gssize
+kernel_copy_chunk (MarlinFileCopyMethod method,
+                   int src_fd,
+                   int dest_fd,
+                   gsize count)
+{
+    if (method == MARLIN_FILE_COPY_METHOD_COPY_FILE_RANGE) {
+#ifdef __NR_copy_file_range
+        /* Through syscall () so as not to depend on the C library version */
+        return syscall (__NR_copy_file_range, src_fd, NULL, dest_fd, NULL, count, 0);
+#else
+        errno = ENOSYS;
+        return -1;
+#endif
+    }
+
+    return sendfile (dest_fd, src_fd, NULL, count);
+}
+
+/* Copies @length bytes from the current offset of @src_fd to the current offset of @dest_fd.
+ * @position is the logical offset reported as progress, @written the number of bytes written so far */
+static KernelCopyResult
+kernel_copy_range (MarlinFileCopyMethod method,
+                   int src_fd,
+                   int dest_fd,
+                   goffset length,
+                   const char *dest_path,
+                   goffset *position,
+                   goffset *written,
+                   goffset total,
+                   GCancellable *cancellable,
+                   GFileProgressCallback progress_callback,
+                   gpointer progress_callback_data,
+                   GError **error)
+{
+    goffset done = 0;
+    gssize n;
+
+    while (done < length) {
+        if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+            return KERNEL_COPY_FAILED;
+        }
+
+        n = kernel_copy_chunk (method, src_fd, dest_fd, MIN (COPY_CHUNK_SIZE, length - done));
+        if (n < 0) {
+            int errsv = errno;
+
+            if (errsv == EINTR) {
+                continue;
+            }
+
+            if (*written == 0 && is_unsupported_errno (errsv)) {
+                return KERNEL_COPY_UNSUPPORTED;
+            }
+
+            set_error_from_errno (error, errsv, _("Error writing to file “%s”: %s"), dest_path);
+            return KERNEL_COPY_FAILED;
+        } else if (n == 0) {
+            char *display_name;
+
+            /* Some filesystems (FUSE, NFS, or procfs on some kernels) read as empty through the
+             * kernel copy even though the file has data: GIO can still copy it. Ending anywhere else
+             * before the size the file had when it was opened must not pass for a complete copy */
+            if (*written == 0) {
+                return KERNEL_COPY_UNSUPPORTED;
+            }
+
+            display_name = g_filename_display_name (dest_path);
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                         _("Error writing to file “%s”: %s"), display_name,
+                         _("The source file ended before all of it was copied"));
+            g_free (display_name);
+            return KERNEL_COPY_FAILED;
+        }
+
+        done += n;
+        *written += n;
+        *position += n;
+
+        if (progress_callback != NULL) {
+            progress_callback (*position, total, progress_callback_data);
+        }
+    }
+
+    return KERNEL_COPY_DONE;
+}
+
+/* Copies only the data segments of a sparse file, seeking over its holes so that they stay holes in
+ * the copy. Progress is reported against the logical size, holes included. */
+static KernelCopyResult
+kernel_copy_sparse (MarlinFileCopyMethod method,
+                    int src_fd,
+                    int dest_fd,
+                    goffset size,
+                    const char *dest_path,
+                    goffset *written,
+                    GCancellable *cancellable,
+                    GFileProgressCallback progress_callback,
+                    gpointer progress_callback_data,
+                    GError **error)
+{
+    KernelCopyResult result;
+    goffset position, data, hole;
+    int errsv;
+
+    position = 0;
+    while (position < size) {
+        data = lseek (src_fd, position, SEEK_DATA);
+        if (data < 0) {
+            errsv = errno;
+            if (errsv == ENXIO) {
+                /* Only a hole is left */
+                break;
+            }
+
+            set_error_from_errno (error, errsv, _("Error seeking in file “%s”: %s"), dest_path);
+            return KERNEL_COPY_FAILED;
+        }
+
+        hole = lseek (src_fd, data, SEEK_HOLE);
+        if (hole < 0 || lseek (src_fd, data, SEEK_SET) < 0 || lseek (dest_fd, data, SEEK_SET) < 0) {
+            errsv = errno;
+            set_error_from_errno (error, errsv, _("Error seeking in file “%s”: %s"), dest_path);
+            return KERNEL_COPY_FAILED;
+        }
+
+        position = data;
+        result = kernel_copy_range (method, src_fd, dest_fd, MIN (hole, size) - data, dest_path,
+                                    &position, written, size,
+                                    cancellable, progress_callback, progress_callback_data, error);
+        if (result != KERNEL_COPY_DONE) {
+            return result;
+        }
+
+        position = hole;
+    }
+
+    /* Extend the copy over a trailing hole */
+    if (ftruncate (dest_fd, size) != 0) {
+        errsv = errno;
+        set_error_from_errno (error, errsv, _("Error writing to file “%s”: %s"), dest_path);
+        return KERNEL_COPY_FAILED;
+    }
+
+    if (progress_callback != NULL) {
+        progress_callback (size, size, progress_callback_data);
+    }
+
+    return KERNEL_COPY_DONE;
+}
+#endif
+
+/* The files of pseudo filesystems are generated when read, and their size says nothing about how much
+ * there is to read */
+static gboolean
+is_pseudo_file (int fd)
+{
+#ifdef __linux__
+    struct statfs buf;
+
+    if (fstatfs (fd, &buf) != 0) {
+        return FALSE;
+    }
+
+    return buf.f_type == PROC_SUPER_MAGIC || buf.f_type == SYSFS_MAGIC || buf.f_type == DEBUGFS_MAGIC;
+#else
+    return FALSE;
+#endif
+}
+
+static KernelCopyResult
+kernel_copy_data (int src_fd,
+                  int dest_fd,
+                  goffset size,
+                  gboolean sparse,
+                  const char *dest_path,
+                  GCancellable *cancellable,
+                  GFileProgressCallback progress_callback,
+                  gpointer progress_callback_data,
+                  MarlinFileCopyMethod *method,
+                  GError **error)
+{
+#ifdef __linux__
+    static const MarlinFileCopyMethod methods[] = {
+        MARLIN_FILE_COPY_METHOD_COPY_FILE_RANGE,
+        MARLIN_FILE_COPY_METHOD_SENDFILE
+    };
+    KernelCopyResult result;
+    goffset position, written;
+    guint i;
+
+#ifdef FICLONE
+    /* Clones share the source extents, holes included */
+    if (ioctl (dest_fd, FICLONE, src_fd) == 0) {
+        *method = MARLIN_FILE_COPY_METHOD_CLONE;
+        if (progress_callback != NULL) {
+            progress_callback (size, size, progress_callback_data);
+        }
+
+        return KERNEL_COPY_DONE;
+    }
+#endif
+
+    /* Without SEEK_DATA the holes cannot be found, and the file is copied densely */
+    if (sparse && lseek (src_fd, 0, SEEK_DATA) < 0 && errno != ENXIO) {
+        sparse = FALSE;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS (methods); i++) {
+        *method = methods[i];
+        position = 0;
+        written = 0;
+
+        if (lseek (src_fd, 0, SEEK_SET) < 0 || lseek (dest_fd, 0, SEEK_SET) < 0) {
+            return KERNEL_COPY_UNSUPPORTED;
+        }
+
+        if (sparse) {
+            result = kernel_copy_sparse (methods[i], src_fd, dest_fd, size, dest_path, &written,
+                                         cancellable, progress_callback, progress_callback_data, error);
+        } else {
+            result = kernel_copy_range (methods[i], src_fd, dest_fd, size, dest_path, &position, &written, size,
+                                        cancellable, progress_callback, progress_callback_data, error);
+        }
+
+        if (result != KERNEL_COPY_UNSUPPORTED) {
+            return result;
+        }
+    }
+#endif
+
+    return KERNEL_COPY_UNSUPPORTED;
+}
+
+static KernelCopyResult
+kernel_copy_file (GFile *source,
+                  GFile *destination,
+                  GFileCopyFlags flags,
+                  GCancellable *cancellable,
+                  GFileProgressCallback progress_callback,
+                  gpointer progress_callback_data,
+                  MarlinFileCopyMethod *method,
+                  GError **error)
+{
+    KernelCopyResult result;
+    char *src_path, *dest_path, *tmp_path, *dirname, *basename;
+    const char *write_path;
+    struct stat src_stat, dest_stat;
+    int src_fd, dest_fd, errsv, res;
+    gboolean sparse;
+    mode_t mode;
+
+    result = KERNEL_COPY_UNSUPPORTED;
+    src_fd = -1;
+    dest_fd = -1;
+    tmp_path = NULL;
+
+    src_path = g_file_get_path (source);
+    dest_path = g_file_get_path (destination);
+
+    /* Leave everything but plain copies of regular local files to GIO, including reporting errors
+     * about the source */
+    if (src_path == NULL || dest_path == NULL || (flags & G_FILE_COPY_BACKUP) != 0) {
+        goto out;
+    }
+
+    if ((flags & G_FILE_COPY_NOFOLLOW_SYMLINKS) != 0) {
+        res = lstat (src_path, &src_stat);
+    } else {
+        res = stat (src_path, &src_stat);
+    }
+
+    if (res != 0 || !S_ISREG (src_stat.st_mode)) {
+        goto out;
+    }
+
+    src_fd = open (src_path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (src_fd < 0 || is_pseudo_file (src_fd)) {
+        goto out;
+    }
+
+    mode = (flags & G_FILE_COPY_TARGET_DEFAULT_PERMS) != 0 ? 0666 : (src_stat.st_mode & 0777);
+
+    if ((flags & G_FILE_COPY_OVERWRITE) != 0 && lstat (dest_path, &dest_stat) == 0) {
+        if (S_ISDIR (dest_stat.st_mode)) {
+            g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY,
+                                 _("Can’t copy over directory"));
+            result = KERNEL_COPY_FAILED;
+            goto out;
+        }
+
+        if (dest_stat.st_dev == src_stat.st_dev && dest_stat.st_ino == src_stat.st_ino) {
+            goto out;
+        }
+
+        /* Replacing: as GIO does, the copy goes to a new file next to the old one, which is only
+         * renamed over it once the copy is complete. The old file is kept if the copy fails */
+        dirname = g_path_get_dirname (dest_path);
+        basename = g_path_get_basename (dest_path);
+        tmp_path = g_strdup_printf ("%s/.%s.XXXXXX", dirname, basename);
+        g_free (dirname);
+        g_free (basename);
+
+        dest_fd = g_mkstemp_full (tmp_path, O_WRONLY | O_CLOEXEC, mode);
+    } else {
+        dest_fd = open (dest_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+    }
+
+    if (dest_fd < 0) {
+        errsv = errno;
+        if (errsv == EEXIST && tmp_path == NULL) {
+            g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_EXISTS, _("Target file exists"));
+        } else {
+            set_error_from_errno (error, errsv, _("Error opening file “%s”: %s"), dest_path);
+        }
+
+        result = KERNEL_COPY_FAILED;
+        goto out;
+    }
+
+    write_path = tmp_path != NULL ? tmp_path : dest_path;
+
+    /* Fewer blocks allocated than the size needs means the file has holes */
+    sparse = (goffset) src_stat.st_blocks * 512 < (goffset) src_stat.st_size;
+    result = kernel_copy_data (src_fd, dest_fd, src_stat.st_size, sparse, dest_path,
+                               cancellable, progress_callback, progress_callback_data,
+                               method, error);
+
+    if (close (dest_fd) != 0 && result == KERNEL_COPY_DONE) {
+        errsv = errno;
+        set_error_from_errno (error, errsv, _("Error closing file “%s”: %s"), dest_path);
+        result = KERNEL_COPY_FAILED;
+    }
+    dest_fd = -1;
+
+    if (result == KERNEL_COPY_DONE && tmp_path != NULL && g_rename (tmp_path, dest_path) != 0) {
+        errsv = errno;
+        set_error_from_errno (error, errsv, _("Error renaming file “%s”: %s"), dest_path);
+        result = KERNEL_COPY_FAILED;
+    }
+
+    if (result == KERNEL_COPY_DONE) {
+        /* As g_file_copy () does; failing to copy metadata is not a hard error */
+        g_file_copy_attributes (source, destination, flags, cancellable, NULL);
+    } else {
+        /* Nothing is left behind, GIO starts afresh if the copy was unsupported */
+        g_unlink (write_path);
+    }
+
+out:
+    if (src_fd >= 0) {
+        close (src_fd);
+    }
+
+    g_free (src_path);
+    g_free (dest_path);
+    g_free (tmp_path);
+
+    return result;
+}
+
+/**
+ * marlin_file_copy:
+ * @method_used: (out) (optional): how the data was copied
+ *
+ * A drop-in replacement for g_file_copy () which copies regular local files in the kernel where it can.
+ */
+gboolean
+marlin_file_copy (GFile *source,
+                  GFile *destination,
+                  GFileCopyFlags flags,
+                  GCancellable *cancellable,
+                  GFileProgressCallback progress_callback,
+                  gpointer progress_callback_data,
+                  MarlinFileCopyMethod *method_used,
+                  GError **error)
+{
+    MarlinFileCopyMethod method;
+    KernelCopyResult result;
+    gboolean res;
+
+    method = MARLIN_FILE_COPY_METHOD_GIO;
+    result = kernel_copy_file (source, destination, flags, cancellable,
+                               progress_callback, progress_callback_data,
+                               &method, error);
+
+    if (result == KERNEL_COPY_UNSUPPORTED) {
+        method = MARLIN_FILE_COPY_METHOD_GIO;
+        res = g_file_copy (source, destination, flags, cancellable,
+                           progress_callback, progress_callback_data, error);
+    } else {
+        res = result == KERNEL_COPY_DONE;
+    }
+
+    if (res) {
+        char *uri = g_file_get_uri (destination);
+        g_debug ("Copied %s using %s", uri, marlin_file_copy_method_to_string (method));
+        g_free (uri);
+    }
+
+    if (method_used != NULL) {
+        *method_used = method;
+    }
+
+    return res;
+}
@@ -0,0 +1,44 @@
+/* marlin-file-copy.h - copying of local files through the kernel
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+#ifndef MARLIN_FILE_COPY_H
+#define MARLIN_FILE_COPY_H
+
+#include <gio/gio.h>
+
+typedef enum {
+    MARLIN_FILE_COPY_METHOD_GIO,
+    MARLIN_FILE_COPY_METHOD_CLONE,
+    MARLIN_FILE_COPY_METHOD_COPY_FILE_RANGE,
+    MARLIN_FILE_COPY_METHOD_SENDFILE
+} MarlinFileCopyMethod;
+
+gboolean    marlin_file_copy                (GFile                  *source,
+                                             GFile                  *destination,
+                                             GFileCopyFlags          flags,
+                                             GCancellable           *cancellable,
+                                             GFileProgressCallback   progress_callback,
+                                             gpointer                progress_callback_data,
+                                             MarlinFileCopyMethod   *method_used,
+                                             GError                **error);
+
+const char *marlin_file_copy_method_to_string (MarlinFileCopyMethod method);
+
+#endif /* MARLIN_FILE_COPY_H */
@@ -0,0 +1,438 @@
+/* marlin-file-delete.c - fast deletion of local folder trees
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+/* Local folders are deleted the way rm -rf does it: every folder is opened once and its entries are
+ * removed with unlinkat () relative to the folder, without building a path or a GFile for each of them.
+ * Subfolders are handed to a pool of threads, so separate subtrees are deleted in parallel. A folder
+ * keeps its descriptor open until all of its subfolders are gone and is then removed itself.
+ *
+ * Several folders can be given at once, they then share the pool and are deleted side by side. The
+ * same walk also serves to count what a deletion would remove, so that a caller can show how far it
+ * got out of a known total.
+ *
+ * Nothing is reported to the user from here. When anything cannot be deleted the deletion carries on
+ * with the rest, leaves the folders above it in place and returns the first error; the caller is then
+ * expected to go over what is left with its usual error handling.
+ */
+
+#define _GNU_SOURCE
+
+#include "marlin-file-delete.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define DELETE_THREADS 8
+/* Beyond this many queued folders, subfolders are deleted by the thread that found them. This bounds
+ * the number of descriptors held open by folders waiting for their subfolders */
+#define DELETE_MAX_QUEUED 64
+#define DELETE_PROGRESS_INTERVAL_USEC (G_USEC_PER_SEC / 10)
+
+typedef struct _DeleteNode DeleteNode;
+
+struct _DeleteNode {
+    DeleteNode *parent;
+    char *name;
+    int fd;
+    /* One for the thread reading the folder, plus one for each subfolder not yet deleted */
+    volatile gint pending;
+    volatile gint failed;
+};
+
+typedef struct {
+    MarlinFileDeleteFlags flags;
+    GThreadPool *threads;
+    GCancellable *cancellable;
+    volatile gint n_deleted;
+    GMutex mutex;
+    GCond done_cond;
+    /* Protected by mutex */
+    guint n_roots_left;
+    GError *error;
+} DeleteTree;
+
+static void delete_node_read (DeleteTree *tree,
+                              DeleteNode *node);
+
+static void
+set_error_from_errno (GError **error,
+                      int errsv,
+                      const char *name)
+{
+    char *display_name;
+
+    if (errsv == ECANCELED) {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                             g_strerror (errsv));
+    } else {
+        display_name = g_filename_display_name (name);
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                     "Error removing %s: %s", display_name, g_strerror (errsv));
+        g_free (display_name);
+    }
+}
+
+/* Keeps the first error met by any of the threads */
+static void
+delete_tree_set_error (DeleteTree *tree,
+                       int errsv,
+                       const char *name)
+{
+    g_mutex_lock (&tree->mutex);
+    if (tree->error == NULL) {
+        set_error_from_errno (&tree->error, errsv, name);
+    }
+    g_mutex_unlock (&tree->mutex);
+}
+
+static DeleteNode *
+delete_node_new (DeleteNode *parent,
+                 const char *name)
+{
+    DeleteNode *node;
+
+    node = g_slice_new0 (DeleteNode);
+    node->parent = parent;
+    node->name = g_strdup (name);
+    node->fd = -1;
+    node->pending = 1;
+
+    if (parent != NULL) {
+        g_atomic_int_inc (&parent->pending);
+    }
+
+    return node;
+}
+
+/* Drops a reference of @node. The last one removes the folder and drops the reference it held on its
+ * parent, which may in turn remove that */
+static void
+delete_node_unref (DeleteTree *tree,
+                   DeleteNode *node)
+{
+    DeleteNode *parent;
+    int res;
+
+    while (node != NULL && g_atomic_int_dec_and_test (&node->pending)) {
+        parent = node->parent;
+
+        if (node->fd >= 0) {
+            close (node->fd);
+        }
+
+        if (g_atomic_int_get (&node->failed)) {
+            /* Nothing to remove */
+        } else if (parent == NULL && (tree->flags & MARLIN_FILE_DELETE_KEEP_ROOTS)) {
+            /* Only the contents of the folders given were asked for */
+        } else if (tree->flags & MARLIN_FILE_DELETE_DRY_RUN) {
+            g_atomic_int_inc (&tree->n_deleted);
+        } else {
+            /* The name of a folder given is its full path */
+            if (parent != NULL) {
+                res = unlinkat (parent->fd, node->name, AT_REMOVEDIR);
+            } else {
+                res = rmdir (node->name);
+            }
+
+            if (res == 0) {
+                g_atomic_int_inc (&tree->n_deleted);
+            } else {
+                delete_tree_set_error (tree, errno, node->name);
+                g_atomic_int_set (&node->failed, TRUE);
+            }
+        }
+
+        /* A folder cannot go while anything below it is left */
+        if (parent != NULL && g_atomic_int_get (&node->failed)) {
+            g_atomic_int_set (&parent->failed, TRUE);
+        }
+
+        if (parent == NULL) {
+            g_mutex_lock (&tree->mutex);
+            if (--tree->n_roots_left == 0) {
+                g_cond_broadcast (&tree->done_cond);
+            }
+            g_mutex_unlock (&tree->mutex);
+        }
+
+        g_free (node->name);
+        g_slice_free (DeleteNode, node);
+
+        node = parent;
+    }
+}
+
+static gboolean
+delete_entry_is_dir (int dir_fd,
+                     struct dirent *entry)
+{
+    struct stat st;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+    if (entry->d_type != DT_UNKNOWN) {
+        return entry->d_type == DT_DIR;
+    }
+#endif
+
+    if (fstatat (dir_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        return FALSE;
+    }
+
+    return S_ISDIR (st.st_mode);
+}
+
+/* Removes the entries of the folder of @node, handing subfolders to the pool or deleting them right
+ * away when it is busy, and drops the reference on @node held by the reader */
+static void
+delete_node_read (DeleteTree *tree,
+                  DeleteNode *node)
+{
+    DeleteNode *child;
+    struct dirent *entry;
+    DIR *dir;
+    int dir_fd;
+
+    if (g_cancellable_is_cancelled (tree->cancellable)) {
+        delete_tree_set_error (tree, ECANCELED, node->name);
+        g_atomic_int_set (&node->failed, TRUE);
+        delete_node_unref (tree, node);
+        return;
+    }
+
+    if (node->fd < 0) {
+        /* The parent's descriptor stays open as long as this node holds a reference on it */
+        node->fd = openat (node->parent->fd, node->name,
+                           O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+
+    dir = NULL;
+    if (node->fd >= 0) {
+        dir_fd = dup (node->fd);
+        if (dir_fd >= 0) {
+            dir = fdopendir (dir_fd);
+            if (dir == NULL) {
+                int errsv = errno;
+                close (dir_fd);
+                errno = errsv;
+            }
+        }
+    }
+
+    if (dir == NULL) {
+        delete_tree_set_error (tree, errno, node->name);
+        g_atomic_int_set (&node->failed, TRUE);
+        delete_node_unref (tree, node);
+        return;
+    }
+
+    errno = 0;
+    while ((entry = readdir (dir)) != NULL) {
+        if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        if (g_cancellable_is_cancelled (tree->cancellable)) {
+            delete_tree_set_error (tree, ECANCELED, node->name);
+            g_atomic_int_set (&node->failed, TRUE);
+            break;
+        }
+
+        if (delete_entry_is_dir (node->fd, entry)) {
+            child = delete_node_new (node, entry->d_name);
+            if (g_thread_pool_unprocessed (tree->threads) < DELETE_MAX_QUEUED) {
+                g_thread_pool_push (tree->threads, child, NULL);
+            } else {
+                delete_node_read (tree, child);
+            }
+        } else if ((tree->flags & MARLIN_FILE_DELETE_DRY_RUN) ||
+                   unlinkat (node->fd, entry->d_name, 0) == 0) {
+            g_atomic_int_inc (&tree->n_deleted);
+        } else {
+            delete_tree_set_error (tree, errno, entry->d_name);
+            g_atomic_int_set (&node->failed, TRUE);
+        }
+
+        errno = 0;
+    }
+
+    if (entry == NULL && errno != 0) {
+        delete_tree_set_error (tree, errno, node->name);
+        g_atomic_int_set (&node->failed, TRUE);
+    }
+
+    closedir (dir);
+    delete_node_unref (tree, node);
+}
+
+static void
+delete_tree_thread (gpointer data,
+                    gpointer user_data)
+{
+    delete_node_read (user_data, data);
+}
+
+static gboolean
+open_root (GFile *dir,
+           int *fd,
+           char **path,
+           GError **error)
+{
+    int errsv;
+
+    *path = g_file_get_path (dir);
+    if (*path == NULL) {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "Not a local file");
+        return FALSE;
+    }
+
+    *fd = open (*path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (*fd < 0) {
+        errsv = errno;
+        if (errsv == ENOTDIR || errsv == ELOOP) {
+            g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                 "Not a folder");
+        } else {
+            set_error_from_errno (error, errsv, *path);
+        }
+
+        g_free (*path);
+        *path = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Deletes the local folders in @dirs and everything in them, all of them at the same time, reporting
+ * progress through @progress_callback on the calling thread about ten times a second. The number of
+ * files and folders deleted is stored in @n_deleted, also when the deletion fails part way. With
+ * MARLIN_FILE_DELETE_KEEP_ROOTS the folders in @dirs are emptied but left in place, with
+ * MARLIN_FILE_DELETE_DRY_RUN nothing is deleted and @n_deleted is what would have been.
+ *
+ * Fails with G_IO_ERROR_NOT_SUPPORTED without deleting anything when any of @dirs is not a local
+ * folder (e.g. a remote file or a symbolic link). */
+gboolean
+marlin_file_delete_trees (GList                             *dirs,
+                          MarlinFileDeleteFlags              flags,
+                          GCancellable                      *cancellable,
+                          MarlinFileDeleteProgressCallback   progress_callback,
+                          gpointer                           progress_callback_data,
+                          guint64                           *n_deleted,
+                          GError                           **error)
+{
+    DeleteTree tree;
+    DeleteNode *root;
+    GList *roots, *l;
+    gint64 end_time;
+    gboolean done;
+    char *path;
+    int fd;
+
+    *n_deleted = 0;
+
+    /* All of them are opened before anything is deleted */
+    roots = NULL;
+    for (l = dirs; l != NULL; l = l->next) {
+        if (!open_root (l->data, &fd, &path, error)) {
+            for (l = roots; l != NULL; l = l->next) {
+                root = l->data;
+                close (root->fd);
+                g_free (root->name);
+                g_slice_free (DeleteNode, root);
+            }
+            g_list_free (roots);
+            return FALSE;
+        }
+
+        root = delete_node_new (NULL, path);
+        root->fd = fd;
+        roots = g_list_prepend (roots, root);
+        g_free (path);
+    }
+
+    if (roots == NULL) {
+        return TRUE;
+    }
+
+    memset (&tree, 0, sizeof (tree));
+    tree.flags = flags;
+    tree.cancellable = cancellable;
+    tree.n_roots_left = g_list_length (roots);
+    g_mutex_init (&tree.mutex);
+    g_cond_init (&tree.done_cond);
+    tree.threads = g_thread_pool_new (delete_tree_thread, &tree, DELETE_THREADS, FALSE, NULL);
+
+    for (l = roots; l != NULL; l = l->next) {
+        g_thread_pool_push (tree.threads, l->data, NULL);
+    }
+    /* The nodes free themselves once their folders are done */
+    g_list_free (roots);
+
+    do {
+        end_time = g_get_monotonic_time () + DELETE_PROGRESS_INTERVAL_USEC;
+        g_mutex_lock (&tree.mutex);
+        while (tree.n_roots_left > 0 && g_cond_wait_until (&tree.done_cond, &tree.mutex, end_time)) {
+            /* Spurious wakeup */
+        }
+        done = tree.n_roots_left == 0;
+        g_mutex_unlock (&tree.mutex);
+
+        if (progress_callback != NULL) {
+            progress_callback (g_atomic_int_get (&tree.n_deleted), progress_callback_data);
+        }
+    } while (!done);
+
+    /* Nothing is queued any more, this only waits for the threads to return */
+    g_thread_pool_free (tree.threads, FALSE, TRUE);
+
+    *n_deleted = g_atomic_int_get (&tree.n_deleted);
+
+    g_mutex_clear (&tree.mutex);
+    g_cond_clear (&tree.done_cond);
+
+    if (tree.error != NULL) {
+        g_propagate_error (error, tree.error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Deletes the local folder @dir and everything in it, see marlin_file_delete_trees () */
+gboolean
+marlin_file_delete_tree (GFile                             *dir,
+                         GCancellable                      *cancellable,
+                         MarlinFileDeleteProgressCallback   progress_callback,
+                         gpointer                           progress_callback_data,
+                         guint64                           *n_deleted,
+                         GError                           **error)
+{
+    GList dirs = { dir, NULL, NULL };
+
+    return marlin_file_delete_trees (&dirs, MARLIN_FILE_DELETE_DEFAULT, cancellable,
+                                     progress_callback, progress_callback_data,
+                                     n_deleted, error);
+}
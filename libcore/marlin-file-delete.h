@@ -0,0 +1,52 @@
+/* marlin-file-delete.h - fast deletion of local folder trees
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+#ifndef MARLIN_FILE_DELETE_H
+#define MARLIN_FILE_DELETE_H
+
+#include <gio/gio.h>
+
+/* Called on the thread running the deletion with the number of files and folders deleted so far */
+typedef void (* MarlinFileDeleteProgressCallback) (guint64  n_deleted,
+                                                   gpointer user_data);
+
+typedef enum {
+    MARLIN_FILE_DELETE_DEFAULT = 0,
+    /* Empties the folders given instead of deleting them */
+    MARLIN_FILE_DELETE_KEEP_ROOTS = 1 << 0,
+    /* Only counts what would be deleted */
+    MARLIN_FILE_DELETE_DRY_RUN = 1 << 1
+} MarlinFileDeleteFlags;
+
+gboolean    marlin_file_delete_trees        (GList                             *dirs,
+                                             MarlinFileDeleteFlags              flags,
+                                             GCancellable                      *cancellable,
+                                             MarlinFileDeleteProgressCallback   progress_callback,
+                                             gpointer                           progress_callback_data,
+                                             guint64                           *n_deleted,
+                                             GError                           **error);
+gboolean    marlin_file_delete_tree         (GFile                             *dir,
+                                             GCancellable                      *cancellable,
+                                             MarlinFileDeleteProgressCallback   progress_callback,
+                                             gpointer                           progress_callback_data,
+                                             guint64                           *n_deleted,
+                                             GError                           **error);
+
+#endif /* MARLIN_FILE_DELETE_H */
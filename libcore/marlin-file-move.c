@@ -0,0 +1,150 @@
+/* marlin-file-move.c - renaming batches of local files into a folder
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+/* Moves local files into a folder on the same filesystem with one renameat2 () each, relative to
+ * descriptors of the source and destination folders that are opened once for the whole batch. The
+ * rename never replaces anything (RENAME_NOREPLACE), so an existing file of the same name is left for
+ * the caller to deal with.
+ *
+ * Remote files, files on another filesystem, files whose name is taken in the destination and files
+ * that fail to be renamed for any other reason are handed back to the caller to go through
+ * g_file_move () as before. So is everything when the kernel cannot rename without replacing.
+ */
+
+#define _GNU_SOURCE
+
+#include "marlin-file-move.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+
+static int
+rename_noreplace (int src_dir_fd,
+                  const char *src_name,
+                  int dest_dir_fd,
+                  const char *dest_name)
+{
+#ifdef __NR_renameat2
+    /* Through syscall () so as not to depend on the C library version */
+    return syscall (__NR_renameat2, src_dir_fd, src_name, dest_dir_fd, dest_name, RENAME_NOREPLACE);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * marlin_file_move_local:
+ * @files: (element-type GFile): the files to move
+ * @dest_dir: the folder to move them into, under their own names
+ *
+ * Renames the local files among @files into @dest_dir in one pass, calling @moved_callback for each
+ * one with its new location.
+ *
+ * Returns: (transfer container) (element-type GFile): the files which were not moved, in their
+ * original order, for the caller to move one by one with g_file_move ()
+ */
+GList *
+marlin_file_move_local (GList                    *files,
+                        GFile                    *dest_dir,
+                        GCancellable             *cancellable,
+                        MarlinFileMovedCallback   moved_callback,
+                        gpointer                  user_data)
+{
+    GList *leftover, *l;
+    GFile *dest;
+    char *dest_path, *path, *src_dir_path, *dirname, *basename;
+    gboolean supported;
+    int dest_fd, src_dir_fd;
+
+    dest_path = g_file_get_path (dest_dir);
+    dest_fd = -1;
+    if (dest_path != NULL) {
+        dest_fd = open (dest_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        g_free (dest_path);
+    }
+
+    if (dest_fd < 0) {
+        return g_list_copy (files);
+    }
+
+    leftover = NULL;
+    src_dir_path = NULL;
+    src_dir_fd = -1;
+    supported = TRUE;
+
+    for (l = files; l != NULL; l = l->next) {
+        if (!supported || g_cancellable_is_cancelled (cancellable)) {
+            leftover = g_list_prepend (leftover, l->data);
+            continue;
+        }
+
+        path = g_file_get_path (l->data);
+        if (path == NULL) {
+            leftover = g_list_prepend (leftover, l->data);
+            continue;
+        }
+
+        /* The files of a batch mostly come from the same folder */
+        dirname = g_path_get_dirname (path);
+        if (g_strcmp0 (dirname, src_dir_path) != 0) {
+            if (src_dir_fd >= 0) {
+                close (src_dir_fd);
+            }
+            g_free (src_dir_path);
+            src_dir_path = dirname;
+            src_dir_fd = open (src_dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        } else {
+            g_free (dirname);
+        }
+
+        basename = g_path_get_basename (path);
+        if (src_dir_fd >= 0 && rename_noreplace (src_dir_fd, basename, dest_fd, basename) == 0) {
+            if (moved_callback != NULL) {
+                dest = g_file_get_child (dest_dir, basename);
+                moved_callback (l->data, dest, user_data);
+                g_object_unref (dest);
+            }
+        } else {
+            if (src_dir_fd >= 0 && errno == ENOSYS) {
+                supported = FALSE;
+            }
+            leftover = g_list_prepend (leftover, l->data);
+        }
+
+        g_free (basename);
+        g_free (path);
+    }
+
+    if (src_dir_fd >= 0) {
+        close (src_dir_fd);
+    }
+    g_free (src_dir_path);
+    close (dest_fd);
+
+    return g_list_reverse (leftover);
+}
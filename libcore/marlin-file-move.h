@@ -0,0 +1,37 @@
+/* marlin-file-move.h - renaming batches of local files into a folder
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+#ifndef MARLIN_FILE_MOVE_H
+#define MARLIN_FILE_MOVE_H
+
+#include <gio/gio.h>
+
+/* Called for each file moved, with its location in the destination folder */
+typedef void (* MarlinFileMovedCallback) (GFile    *source,
+                                          GFile    *destination,
+                                          gpointer  user_data);
+
+GList      *marlin_file_move_local          (GList                      *files,
+                                             GFile                      *dest_dir,
+                                             GCancellable               *cancellable,
+                                             MarlinFileMovedCallback     moved_callback,
+                                             gpointer                    user_data);
+
+#endif /* MARLIN_FILE_MOVE_H */
@@ -62,8 +62,16 @@
 #include "nautilus-trash-monitor.h"
 #include "nautilus-file-utilities.h"
 #include "nautilus-file-conflict-dialog.h"*/
+#include "marlin-copy-journal.h"
 #include "marlin-file-changes-queue.h"
 #include "marlin-file-conflict-dialog.h"
+#include "marlin-file-copy.h"
+#include "marlin-file-delete.h"
+#include "marlin-file-move.h"
+#include "marlin-file-permissions.h"
+#include "marlin-file-trash.h"
+#include "marlin-file-verify.h"
+#include "marlin-rate-estimator.h"
 #include "marlin-undostack-manager.h"
 #include "pantheon-files-core.h"
 
@@ -77,6 +85,13 @@ typedef struct {
     TaskviewIO *tv_io;
 #else
     MarlinProgressInfo *progress;
+    /* Left by the job thread for sample_job_progress () */
+    volatile gint progress_phase;
+    volatile gint progress_op;
+    volatile gint progress_counting;
+    /* Main loop only */
+    int last_sampled_files_left;
+    MarlinRateEstimator *rate;
 #endif
     GCancellable *cancellable;
     GHashTable *skip_files;
@@ -89,11 +104,18 @@ typedef struct {
     MarlinUndoActionData *undo_redo_data;
 } CommonJob;
 
+typedef struct _CopyPool CopyPool;
+
 typedef struct {
     CommonJob common;
     gboolean is_move;
     GList *files;
     GFile *destination;
+    CopyPool *copy_pool;
+    MarlinFileVerifier *verifier;
+    MarlinCopyJournal *journal;
+    /* Names in the folders duplicates are made in, see get_unique_target_file () */
+    GHashTable *name_indexes;
     //GFile *desktop_location;
     GdkPoint *icon_positions;
     int n_icon_positions;
@@ -106,6 +128,7 @@ typedef struct {
     CommonJob common;
     GList *files;
     gboolean try_trash;
+    gboolean confirm;
     gboolean user_cancel;
     MarlinDeleteCallback done_callback;
     gpointer done_callback_data;
@@ -142,6 +165,7 @@ typedef struct {
     MarlinOpCallback done_callback;
     gpointer done_callback_data;
 } MarkTrustedJob;
+#endif
 
 typedef struct {
     CommonJob common;
@@ -152,8 +176,11 @@ typedef struct {
     guint32 file_mask;
     guint32 dir_permissions;
     guint32 dir_mask;
+    /* Owned by the undo data, NULL when redoing */
+    MarlinPermissionsUndo *undo;
+    /* Set when the job puts back the modes in it instead */
+    MarlinPermissionsUndo *restore;
 } SetPermissionsJob;
-#endif
 
 typedef enum {
     JOB_COPY,
@@ -170,14 +197,28 @@ typedef enum {
     OP_KIND_COPY,
     OP_KIND_MOVE,
     OP_KIND_DELETE,
-    OP_KIND_TRASH
+    OP_KIND_TRASH,
+    OP_KIND_EMPTY_TRASH
 } OpKind;
 
+/* What the progress counts of a job stand for */
+typedef enum {
+    PROGRESS_PHASE_NONE,
+    PROGRESS_PHASE_COUNTING,
+    PROGRESS_PHASE_COPYING,
+    PROGRESS_PHASE_DELETING,
+    PROGRESS_PHASE_VERIFYING
+} ProgressPhase;
+
+typedef struct _ParallelScan ParallelScan;
+
 typedef struct {
     int num_files;
     goffset num_bytes;
     int num_files_since_progress;
     OpKind op;
+    /* Non-NULL while the sources are still being counted in the background */
+    ParallelScan *scan;
 } SourceInfo;
 
 typedef struct {
@@ -188,7 +229,6 @@ typedef struct {
     int last_reported_files_left;
 } TransferInfo;
 
-#define SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE 15
 //#define NSEC_PER_SEC 1000000000
 #define NSEC_PER_MSEC 1000000
 
@@ -226,7 +266,12 @@ is_all_button_text (const char *button_text)
 static void scan_sources (GList *files,
                           SourceInfo *source_info,
                           CommonJob *job,
-                          OpKind kind);
+                          OpKind kind,
+                          gboolean background);
+static void parallel_scan_push (ParallelScan *scan,
+                                GFile *dir);
+static void source_info_update (SourceInfo *source_info);
+static void source_info_finish_scan (SourceInfo *source_info);
 
 static gboolean empty_trash_job (GIOSchedulerJob *io_job,
                                  GCancellable *cancellable,
@@ -933,6 +978,11 @@ cancel_callback (TaskviewGeneric *origin, GError **error, CommonJob *job)
 
 #define op_job_new(jobtype, __type, parent_window) ((__type *)(init_common (jobtype, sizeof(__type), parent_window)))
 
+#ifndef ENABLE_TASKVIEW
+static void sample_job_progress (MarlinProgressInfo *info,
+                                 gpointer user_data);
+#endif
+
 static gpointer
 init_common (JobTypes jobtype,
              gsize job_size,
@@ -984,6 +1034,8 @@ init_common (JobTypes jobtype,
 #else
     common->progress = marlin_progress_info_new ();
     common->cancellable = marlin_progress_info_get_cancellable (common->progress);
+    marlin_progress_info_set_sample_func (common->progress, sample_job_progress, common);
+    common->rate = marlin_rate_estimator_new ();
 #endif
     common->time = g_timer_new ();
     common->inhibit_cookie = -1;
@@ -1003,7 +1055,9 @@ finalize_common (CommonJob *common)
 #ifdef ENABLE_TASKVIEW
     g_object_set (common->tv_io, "state", TASKVIEW_FINISHED, NULL);
 #else
+    marlin_progress_info_set_sample_func (common->progress, NULL, NULL);
     marlin_progress_info_finish (common->progress);
+    marlin_rate_estimator_free (common->rate);
 #endif
     if (common->inhibit_cookie != -1) {
         gtk_application_uninhibit (GTK_APPLICATION (g_application_get_default ()),
@@ -1357,6 +1411,319 @@ job_aborted (CommonJob *job)
     return g_cancellable_is_cancelled (job->cancellable);
 }
 
+/* Scheduling of jobs by filesystem.
+ *
+ * Copies, moves and deletes run one at a time on any one filesystem: a job waits, shown as queued,
+ * until no earlier job uses any of the filesystems of its sources and destination, then takes them all
+ * at once. Jobs on different filesystems run in parallel as before. Several jobs on the same disk
+ * would make it seek back and forth between them and each would run slower than on its own.
+ *
+ * Only looking up the filesystems happens on an I/O thread. The queue itself is kept in the main loop,
+ * and a job is only handed to the I/O scheduler once it may run, so waiting jobs do not hold threads
+ * of the pool shared with the rest of GIO. Moves within a single filesystem are renames and trashing
+ * is one too, so neither waits behind a long copy.
+ */
+#define MAX_JOBS_PER_FILESYSTEM 1
+
+typedef struct {
+    GIOSchedulerJobFunc func;
+    CommonJob *job;
+    GList *files;
+    GFile *destination;
+    gboolean is_move;
+    /* Filesystem ids of files and destination */
+    GList *filesystems;
+    gulong cancelled_id;
+    gboolean queued;
+    gboolean running;
+} ScheduledJob;
+
+/* Only used from the main loop. Filesystem id to number of running jobs, and waiting jobs in order
+ * of arrival */
+static GHashTable *scheduler_running;
+static GList *scheduler_waiting;
+
+static void
+scheduled_job_add_filesystem (ScheduledJob *scheduled,
+                              GFile *file)
+{
+    GFileInfo *info;
+    const char *id;
+
+    info = g_file_query_info (file,
+                              G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+                              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                              scheduled->job->cancellable,
+                              NULL);
+    if (info == NULL) {
+        return;
+    }
+
+    id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+    if (id != NULL &&
+        g_list_find_custom (scheduled->filesystems, id, (GCompareFunc) g_strcmp0) == NULL) {
+        scheduled->filesystems = g_list_prepend (scheduled->filesystems, g_strdup (id));
+    }
+
+    g_object_unref (info);
+}
+
+/* Looks up the filesystems of the job, once for each folder the sources are in */
+static void
+scheduled_job_find_filesystems (ScheduledJob *scheduled)
+{
+    GHashTable *parents;
+    GFile *parent;
+    GList *l;
+
+    parents = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal, g_object_unref, NULL);
+
+    for (l = scheduled->files; l != NULL && !job_aborted (scheduled->job); l = l->next) {
+        parent = g_file_get_parent (l->data);
+        if (parent == NULL) {
+            scheduled_job_add_filesystem (scheduled, l->data);
+        } else if (g_hash_table_lookup (parents, parent) == NULL) {
+            g_hash_table_insert (parents, parent, parent);
+            scheduled_job_add_filesystem (scheduled, parent);
+        } else {
+            g_object_unref (parent);
+        }
+    }
+
+    if (scheduled->destination != NULL) {
+        scheduled_job_add_filesystem (scheduled, scheduled->destination);
+    }
+
+    g_hash_table_destroy (parents);
+}
+
+static gboolean
+scheduled_job_can_run (ScheduledJob *scheduled)
+{
+    ScheduledJob *earlier;
+    GList *l, *w;
+
+    for (l = scheduled->filesystems; l != NULL; l = l->next) {
+        if (GPOINTER_TO_UINT (g_hash_table_lookup (scheduler_running, l->data)) >= MAX_JOBS_PER_FILESYSTEM) {
+            return FALSE;
+        }
+
+        /* First come, first served */
+        for (w = scheduler_waiting; w != NULL && w->data != scheduled; w = w->next) {
+            earlier = w->data;
+            if (g_list_find_custom (earlier->filesystems, l->data, (GCompareFunc) g_strcmp0) != NULL) {
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+scheduled_job_free (ScheduledJob *scheduled)
+{
+    g_list_free_full (scheduled->files, g_object_unref);
+    g_clear_object (&scheduled->destination);
+    g_list_free_full (scheduled->filesystems, g_free);
+    g_slice_free (ScheduledJob, scheduled);
+}
+
+static void scheduler_dispatch (void);
+
+static gboolean
+scheduled_job_done (gpointer user_data)
+{
+    ScheduledJob *scheduled = user_data;
+    GList *l;
+    guint count;
+
+    if (scheduled->running) {
+        for (l = scheduled->filesystems; l != NULL; l = l->next) {
+            count = GPOINTER_TO_UINT (g_hash_table_lookup (scheduler_running, l->data));
+            if (count > 1) {
+                g_hash_table_replace (scheduler_running, g_strdup (l->data), GUINT_TO_POINTER (count - 1));
+            } else {
+                g_hash_table_remove (scheduler_running, l->data);
+            }
+        }
+    }
+
+    scheduled_job_free (scheduled);
+
+    /* Jobs waiting for these filesystems may be free to go now */
+    scheduler_dispatch ();
+
+    return FALSE;
+}
+
+static gboolean
+scheduled_job_func (GIOSchedulerJob *io_job,
+                    GCancellable *cancellable,
+                    gpointer user_data)
+{
+    ScheduledJob *scheduled = user_data;
+    gboolean res;
+
+    /* The job may be freed once this returns */
+    res = scheduled->func (io_job, cancellable, scheduled->job);
+    scheduled->job = NULL;
+
+    g_io_scheduler_job_send_to_mainloop_async (io_job,
+                                               scheduled_job_done,
+                                               scheduled,
+                                               NULL);
+
+    return res;
+}
+
+/* Takes the filesystems of the job, unless it was cancelled, and hands it to the I/O scheduler */
+static void
+scheduled_job_start (ScheduledJob *scheduled)
+{
+    CommonJob *job = scheduled->job;
+    GList *l;
+    guint count;
+
+    scheduler_waiting = g_list_remove (scheduler_waiting, scheduled);
+
+    if (scheduled->cancelled_id != 0) {
+        g_cancellable_disconnect (job->cancellable, scheduled->cancelled_id);
+        scheduled->cancelled_id = 0;
+    }
+
+    if (!job_aborted (job)) {
+        for (l = scheduled->filesystems; l != NULL; l = l->next) {
+            count = GPOINTER_TO_UINT (g_hash_table_lookup (scheduler_running, l->data));
+            g_hash_table_replace (scheduler_running, g_strdup (l->data), GUINT_TO_POINTER (count + 1));
+        }
+        scheduled->running = TRUE;
+    }
+
+#ifndef ENABLE_TASKVIEW
+    if (scheduled->queued) {
+        marlin_progress_info_set_queued (job->progress, FALSE);
+        marlin_progress_info_set_details (job->progress, "");
+    }
+#endif
+
+    g_io_scheduler_push_job (scheduled_job_func,
+                             scheduled,
+                             NULL,
+                             0,
+                             job->cancellable);
+}
+
+/* Starts the waiting jobs that may run now, and those that were cancelled so that they finish */
+static void
+scheduler_dispatch (void)
+{
+    ScheduledJob *scheduled;
+    GList *l, *next;
+
+    for (l = scheduler_waiting; l != NULL; l = next) {
+        next = l->next;
+        scheduled = l->data;
+        if (job_aborted (scheduled->job) || scheduled_job_can_run (scheduled)) {
+            scheduled_job_start (scheduled);
+        }
+    }
+}
+
+static gboolean
+scheduler_dispatch_idle (gpointer user_data)
+{
+    scheduler_dispatch ();
+
+    return FALSE;
+}
+
+/* May be called from any thread */
+static void
+scheduled_job_cancelled (GCancellable *cancellable,
+                         gpointer user_data)
+{
+    g_idle_add (scheduler_dispatch_idle, NULL);
+}
+
+static gboolean
+scheduled_job_enqueue (gpointer user_data)
+{
+    ScheduledJob *scheduled = user_data;
+    CommonJob *job = scheduled->job;
+
+    if (scheduler_running == NULL) {
+        scheduler_running = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    }
+
+    /* Renames keep the disk busy for no time */
+    if (scheduled->is_move && g_list_length (scheduled->filesystems) == 1) {
+        g_list_free_full (scheduled->filesystems, g_free);
+        scheduled->filesystems = NULL;
+    }
+
+    scheduler_waiting = g_list_append (scheduler_waiting, scheduled);
+
+    if (job_aborted (job) || scheduled_job_can_run (scheduled)) {
+        scheduled_job_start (scheduled);
+        return FALSE;
+    }
+
+    scheduled->queued = TRUE;
+    scheduled->cancelled_id = g_cancellable_connect (job->cancellable,
+                                                     G_CALLBACK (scheduled_job_cancelled),
+                                                     NULL, NULL);
+#ifndef ENABLE_TASKVIEW
+    marlin_progress_info_start (job->progress);
+    marlin_progress_info_set_queued (job->progress, TRUE);
+    marlin_progress_info_take_status (job->progress,
+                                      f (_("Waiting for other operations on the same disk")));
+    marlin_progress_info_set_details (job->progress, _("Queued"));
+#endif
+
+    return FALSE;
+}
+
+static gboolean
+scheduled_job_lookup_func (GIOSchedulerJob *io_job,
+                           GCancellable *cancellable,
+                           gpointer user_data)
+{
+    scheduled_job_find_filesystems (user_data);
+
+    g_io_scheduler_job_send_to_mainloop_async (io_job,
+                                               scheduled_job_enqueue,
+                                               user_data,
+                                               NULL);
+
+    return FALSE;
+}
+
+/* Like g_io_scheduler_push_job (), but the job waits for running jobs on the filesystems of @files
+ * and @destination. Moves within a single filesystem do not wait */
+static void
+push_scheduled_job (GIOSchedulerJobFunc func,
+                    CommonJob *job,
+                    GList *files,
+                    GFile *destination,
+                    gboolean is_move)
+{
+    ScheduledJob *scheduled;
+
+    scheduled = g_slice_new0 (ScheduledJob);
+    scheduled->func = func;
+    scheduled->job = job;
+    scheduled->files = eel_g_object_list_copy (files);
+    scheduled->destination = destination != NULL ? g_object_ref (destination) : NULL;
+    scheduled->is_move = is_move;
+
+    g_io_scheduler_push_job (scheduled_job_lookup_func,
+                             scheduled,
+                             NULL,
+                             0,
+                             job->cancellable);
+}
+
 /* Since this happens on a thread we can't use the global prefs object */
 static gboolean
 should_confirm_trash (void)
@@ -1364,6 +1731,24 @@ should_confirm_trash (void)
     return gof_preferences_get_confirm_trash (gof_preferences_get_default ());
 }
 
+static gboolean
+should_journal_transfers (void)
+{
+    return gof_preferences_get_journal_transfers (gof_preferences_get_default ());
+}
+
+static gboolean
+should_prescan_conflicts (void)
+{
+    return gof_preferences_get_prescan_conflicts (gof_preferences_get_default ());
+}
+
+static gboolean
+should_verify_copies (void)
+{
+    return gof_preferences_get_verify_copies (gof_preferences_get_default ());
+}
+
 static gboolean
 confirm_delete_from_trash (CommonJob *job,
                            GList *files)
@@ -1483,6 +1868,34 @@ confirm_delete_directly (CommonJob *job,
     return response == 1;
 }
 
+#ifndef ENABLE_TASKVIEW
+/* Job threads only leave their counts in the progress info, the text is made by
+ * sample_job_progress () on the main loop */
+static void
+publish_progress (CommonJob *job,
+                  ProgressPhase phase,
+                  SourceInfo *source_info,
+                  TransferInfo *transfer_info)
+{
+    guint64 now;
+
+    /* Collecting the count of a background scan takes its lock, so that is done every 100 ms only */
+    if (source_info->scan != NULL) {
+        now = g_thread_gettime ();
+        if (transfer_info->last_report_time == 0 ||
+            ABS ((gint64)(transfer_info->last_report_time - now)) >= 100 * NSEC_PER_MSEC) {
+            transfer_info->last_report_time = now;
+            source_info_update (source_info);
+        }
+    }
+
+    marlin_progress_info_set_totals (job->progress, source_info->num_files, source_info->num_bytes);
+    marlin_progress_info_set_counts (job->progress, transfer_info->num_files, transfer_info->num_bytes);
+    g_atomic_int_set (&job->progress_counting, source_info->scan != NULL);
+    g_atomic_int_set (&job->progress_phase, phase);
+}
+#endif
+
 static void
 report_delete_progress (CommonJob *job,
                         SourceInfo *source_info,
@@ -1496,20 +1909,22 @@ report_delete_progress (CommonJob *job,
                   "total-items", (guint64) source_info->num_files,
                   NULL);
 #else
+    publish_progress (job, PROGRESS_PHASE_DELETING, source_info, transfer_info);
+#endif
+}
+
+#ifndef ENABLE_TASKVIEW
+static void
+sample_delete_progress (CommonJob *job,
+                        guint64 files_done,
+                        guint64 files_total)
+{
     int files_left;
-    double elapsed, transfer_rate;
+    double seconds_left;
     int remaining_time;
-    guint64 now;
     char *files_left_s;
 
-    now = g_thread_gettime ();
-    if (transfer_info->last_report_time != 0 &&
-        ABS ((gint64)(transfer_info->last_report_time - now)) < 100 * NSEC_PER_MSEC) {
-        return;
-    }
-    transfer_info->last_report_time = now;
-
-    files_left = source_info->num_files - transfer_info->num_files;
+    files_left = (int) files_total - (int) files_done;
 
     /* Races and whatnot could cause this to be negative... */
     if (files_left < 0) {
@@ -1524,14 +1939,13 @@ report_delete_progress (CommonJob *job,
     marlin_progress_info_take_status (job->progress,
                                       f (_("Deleting files")));
 
-    elapsed = g_timer_elapsed (job->time, NULL);
-    if (elapsed < SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE) {
+    marlin_rate_estimator_add_sample (job->rate, g_timer_elapsed (job->time, NULL), 0, files_done);
+    if (!marlin_rate_estimator_get_time_left (job->rate, 0, files_left, &seconds_left)) {
 
         marlin_progress_info_set_details (job->progress, files_left_s);
     } else {
         char *details, *time_left_s;
-        transfer_rate = transfer_info->num_files / elapsed;
-        remaining_time = files_left / transfer_rate;
+        remaining_time = MIN (seconds_left, G_MAXINT);
 
         /// TRANSLATORS: %T will expand to a time like "2 minutes".
         /// The singular/plural form will be used depending on the remaining time (i.e. the %T argument).
@@ -1548,11 +1962,11 @@ report_delete_progress (CommonJob *job,
 
     g_free (files_left_s);
 
-    if (source_info->num_files != 0) {
-        marlin_progress_info_set_progress (job->progress, transfer_info->num_files, source_info->num_files);
+    if (files_total != 0) {
+        marlin_progress_info_set_progress (job->progress, files_done, files_total);
     }
-#endif
 }
+#endif
 
 static void delete_file (CommonJob *job, GFile *file,
                          gboolean *skipped_file,
@@ -1560,6 +1974,66 @@ static void delete_file (CommonJob *job, GFile *file,
                          TransferInfo *transfer_info,
                          gboolean toplevel);
 
+typedef struct {
+    CommonJob *job;
+    SourceInfo *source_info;
+    TransferInfo *transfer_info;
+    int num_files_before;
+} DeleteTreeProgressData;
+
+static void
+delete_tree_progress_callback (guint64 n_deleted,
+                               gpointer user_data)
+{
+    DeleteTreeProgressData *pdata = user_data;
+
+    pdata->transfer_info->num_files = pdata->num_files_before + n_deleted;
+    report_delete_progress (pdata->job, pdata->source_info, pdata->transfer_info);
+}
+
+/* Deletes a local folder through the descriptor based marlin_file_delete_tree (). Returns FALSE when
+ * anything is left, which is then gone through file by file so that errors get their usual dialogs.
+ * Only the removal of @dir itself is queued; monitors notice what went inside it */
+static gboolean
+delete_dir_fast (CommonJob *job, GFile *dir,
+                 SourceInfo *source_info,
+                 TransferInfo *transfer_info)
+{
+    DeleteTreeProgressData pdata;
+    GError *error;
+    guint64 n_deleted;
+    gboolean deleted;
+
+    /* Files the user chose to skip while scanning must be left in place */
+    if (job->skip_files != NULL || job->skip_readdir_error != NULL) {
+        return FALSE;
+    }
+
+    pdata.job = job;
+    pdata.source_info = source_info;
+    pdata.transfer_info = transfer_info;
+    pdata.num_files_before = transfer_info->num_files;
+
+    error = NULL;
+    deleted = marlin_file_delete_tree (dir, job->cancellable,
+                                       delete_tree_progress_callback, &pdata,
+                                       &n_deleted, &error);
+    transfer_info->num_files = pdata.num_files_before + n_deleted;
+
+    if (deleted) {
+        marlin_file_changes_queue_file_removed (dir);
+        report_delete_progress (job, source_info, transfer_info);
+        return TRUE;
+    }
+
+    if (!IS_IO_ERROR (error, NOT_SUPPORTED) && !IS_IO_ERROR (error, CANCELLED)) {
+        g_debug ("Deleting the rest of a folder through GIO: %s", error->message);
+    }
+
+    g_error_free (error);
+    return FALSE;
+}
+
 static void
 delete_dir (CommonJob *job, GFile *dir,
             gboolean *skipped_file,
@@ -1578,6 +2052,10 @@ delete_dir (CommonJob *job, GFile *dir,
 
     local_skipped_file = FALSE;
 
+    if (toplevel && delete_dir_fast (job, dir, source_info, transfer_info)) {
+        return;
+    }
+
     skip_error = should_skip_readdir_error (job, dir);
 retry:
     error = NULL;
@@ -1797,7 +2275,8 @@ delete_files (CommonJob *job, GList *files, int *files_skipped)
     scan_sources (files,
                   &source_info,
                   job,
-                  OP_KIND_DELETE);
+                  OP_KIND_DELETE,
+                  FALSE);
     if (job_aborted (job)) {
         return;
     }
@@ -1860,13 +2339,68 @@ report_trash_progress (CommonJob *job,
 #endif
 }
 
+typedef struct {
+    CommonJob *job;
+    int files_trashed;
+    int total_files;
+    gint64 last_report_time;
+    /* Trashed files not queued as removed yet, all in removed_parent */
+    GFile *removed_parent;
+    GList *removed;
+} TrashBatchData;
+
+static void
+trash_batch_queue_removed (TrashBatchData *batch)
+{
+    batch->removed = g_list_reverse (batch->removed);
+    marlin_file_changes_queue_files_removed (batch->removed);
+    g_list_free (batch->removed);
+    batch->removed = NULL;
+    g_clear_object (&batch->removed_parent);
+}
+
+static void
+trash_batch_callback (GFile *file,
+                      guint64 mtime,
+                      gpointer user_data)
+{
+    TrashBatchData *batch = user_data;
+    GFile *parent;
+    gint64 now;
+
+    /* One change for each folder files were trashed from */
+    parent = g_file_get_parent (file);
+    if (batch->removed_parent != NULL && !g_file_equal (parent, batch->removed_parent)) {
+        trash_batch_queue_removed (batch);
+    }
+    if (batch->removed_parent == NULL) {
+        batch->removed_parent = parent;
+    } else {
+        g_object_unref (parent);
+    }
+    batch->removed = g_list_prepend (batch->removed, file);
+
+    // Start UNDO-REDO
+    marlin_undo_manager_data_add_trashed_file (batch->job->undo_redo_data, file, mtime);
+    // End UNDO-REDO
+
+    batch->files_trashed++;
+
+    now = g_get_monotonic_time ();
+    if (now - batch->last_report_time >= 100 * G_TIME_SPAN_MILLISECOND) {
+        batch->last_report_time = now;
+        report_trash_progress (batch->job, batch->files_trashed, batch->total_files);
+    }
+}
 
 static void
 trash_files (CommonJob *job, GList *files, int *files_skipped)
 {
     GList *l;
     GFile *file;
+    GList *local_leftover;
     GList *to_delete;
+    TrashBatchData batch;
     GError *error;
     GFileInfo *info;
     GFileInfo *parent_info;
@@ -1893,8 +2427,19 @@ trash_files (CommonJob *job, GList *files, int *files_skipped)
 
     report_trash_progress (job, files_trashed, total_files);
 
+    /* Local files are trashed in one batch. Those it leaves, remote ones or ones it failed to
+     * trash, go through g_file_trash () one by one below */
+    memset (&batch, 0, sizeof (batch));
+    batch.job = job;
+    batch.total_files = total_files;
+    local_leftover = marlin_file_trash_local (files, job->cancellable, trash_batch_callback, &batch);
+    trash_batch_queue_removed (&batch);
+
+    files_trashed = batch.files_trashed;
+    report_trash_progress (job, files_trashed, total_files);
+
     to_delete = NULL;
-    for (l = files;
+    for (l = local_leftover;
          l != NULL && !job_aborted (job);
          l = l->next) {
         file = l->data;
@@ -2018,6 +2563,8 @@ skip:
         }
     }
 
+    g_list_free (local_leftover);
+
     if (to_delete) {
         to_delete = g_list_reverse (to_delete);
         delete_files (job, to_delete, files_skipped);
@@ -2098,9 +2645,9 @@ delete_job (GIOSchedulerJob *io_job,
     if (to_delete_files != NULL) {
         to_delete_files = g_list_reverse (to_delete_files);
         confirmed = TRUE;
-        if (must_confirm_delete_in_trash) {
+        if (job->confirm && must_confirm_delete_in_trash) {
             confirmed = confirm_delete_from_trash (common, to_delete_files);
-        } else if (must_confirm_delete) {
+        } else if (job->confirm && must_confirm_delete) {
             confirmed = confirm_delete_directly (common, to_delete_files);
         }
         if (confirmed) {
@@ -2136,6 +2683,7 @@ static void
 trash_or_delete_internal (GList                  *files,
                           GtkWindow              *parent_window,
                           gboolean                try_trash,
+                          gboolean                confirm,
                           MarlinDeleteCallback  done_callback,
                           gpointer                done_callback_data)
 {
@@ -2148,6 +2696,7 @@ trash_or_delete_internal (GList                  *files,
     job = op_job_new (JOB_DELETE, DeleteJob, parent_window);
     job->files = eel_g_object_list_copy (files);
     job->try_trash = try_trash;
+    job->confirm = confirm;
     job->user_cancel = FALSE;
     job->done_callback = done_callback;
     job->done_callback_data = done_callback_data;
@@ -2164,11 +2713,16 @@ trash_or_delete_internal (GList                  *files,
         marlin_undo_manager_data_set_src_dir (job->common.undo_redo_data, src_dir);
     }
 
-    g_io_scheduler_push_job (delete_job,
-                             job,
-                             NULL,
-                             0,
-                             NULL);
+    if (try_trash || !confirm) {
+        /* Trashing is a rename, and the copies an undo takes back should not wait behind other jobs */
+        g_io_scheduler_push_job (delete_job,
+                                 job,
+                                 NULL,
+                                 0,
+                                 NULL);
+    } else {
+        push_scheduled_job (delete_job, (CommonJob *)job, job->files, NULL, FALSE);
+    }
 }
 
 void
@@ -2178,7 +2732,7 @@ marlin_file_operations_trash_or_delete (GList                   *files,
                                         gpointer                done_callback_data)
 {
     trash_or_delete_internal (files, parent_window,
-                              TRUE,
+                              TRUE, TRUE,
                               done_callback,  done_callback_data);
 }
 
@@ -2189,7 +2743,18 @@ marlin_file_operations_delete (GList                    *files,
                                gpointer                 done_callback_data)
 {
     trash_or_delete_internal (files, parent_window,
-                              FALSE,
+                              FALSE, TRUE,
+                              done_callback,  done_callback_data);
+}
+
+/* Deletes @files without asking first, e.g. the copies an undo takes back */
+void
+marlin_file_operations_delete_without_confirm (GList                    *files,
+                                               MarlinDeleteCallback     done_callback,
+                                               gpointer                 done_callback_data)
+{
+    trash_or_delete_internal (files, NULL,
+                              FALSE, FALSE,
                               done_callback,  done_callback_data);
 }
 
@@ -2304,8 +2869,11 @@ static GList *
 prepend_if_exists (GList *list, GFile *file) {
     if (file != NULL && G_IS_FILE (file) && g_file_query_exists (file, NULL))
         return g_list_prepend (list, file);
-    else
-        return list;
+
+    if (file != NULL)
+        g_object_unref (file);
+
+    return list;
 }
 
 static GList *
@@ -2596,41 +3164,49 @@ marlin_file_operations_mount_volume_full (GtkWindow *parent_window,
     g_volume_mount (volume, 0, mount_op, NULL, volume_mount_cb, mount_op);
 }
 
-static void
-report_count_progress (CommonJob *job,
-                       SourceInfo *source_info)
+static char *
+format_count_progress (OpKind op,
+                       int num_files,
+                       goffset num_bytes)
 {
-    char *s;
-
-    switch (source_info->op) {
+    switch (op) {
     default:
     case OP_KIND_COPY:
-        s = f (ngettext("Preparing to copy %'d file (%S)",
-                        "Preparing to copy %'d files (%S)",
-                        source_info->num_files),
-               source_info->num_files, source_info->num_bytes);
-        break;
+        return f (ngettext("Preparing to copy %'d file (%S)",
+                           "Preparing to copy %'d files (%S)",
+                           num_files),
+                  num_files, num_bytes);
     case OP_KIND_MOVE:
-        s = f (ngettext("Preparing to move %'d file (%S)",
-                        "Preparing to move %'d files (%S)",
-                        source_info->num_files),
-               source_info->num_files, source_info->num_bytes);
-        break;
+        return f (ngettext("Preparing to move %'d file (%S)",
+                           "Preparing to move %'d files (%S)",
+                           num_files),
+                  num_files, num_bytes);
     case OP_KIND_DELETE:
-        s = f (ngettext("Preparing to delete %'d file (%S)",
-                        "Preparing to delete %'d files (%S)",
-                        source_info->num_files),
-               source_info->num_files, source_info->num_bytes);
-        break;
+        return f (ngettext("Preparing to delete %'d file (%S)",
+                           "Preparing to delete %'d files (%S)",
+                           num_files),
+                  num_files, num_bytes);
     case OP_KIND_TRASH:
-        s = f (ngettext("Preparing to trash %'d file",
-                        "Preparing to trash %'d files",
-                        source_info->num_files),
-               source_info->num_files);
-        break;
+        return f (ngettext("Preparing to trash %'d file",
+                           "Preparing to trash %'d files",
+                           num_files),
+                  num_files);
+    case OP_KIND_EMPTY_TRASH:
+        return f (ngettext("Preparing to delete %'d file from the trash",
+                           "Preparing to delete %'d files from the trash",
+                           num_files),
+                  num_files);
     }
+}
 
+static void
+report_count_progress (CommonJob *job,
+                       SourceInfo *source_info)
+{
 #ifdef ENABLE_TASKVIEW
+    char *s;
+
+    s = format_count_progress (source_info->op, source_info->num_files, source_info->num_bytes);
     g_object_set (job->tv_io,
                   "state", TASKVIEW_PREPARING,
                   "description", s,
@@ -2640,10 +3216,10 @@ report_count_progress (CommonJob *job,
                   NULL);
     g_free (s);
 #else
-    marlin_progress_info_take_details (job->progress, s);
-    marlin_progress_info_pulse_progress (job->progress);
+    g_atomic_int_set (&job->progress_op, source_info->op);
+    marlin_progress_info_set_totals (job->progress, source_info->num_files, source_info->num_bytes);
+    g_atomic_int_set (&job->progress_phase, PROGRESS_PHASE_COUNTING);
 #endif
-
 }
 
 static void
@@ -2827,7 +3403,11 @@ retry:
         count_file (info, job, source_info);
 
         if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
-            g_queue_push_head (dirs, g_object_ref (file));
+            if (source_info->scan != NULL) {
+                parallel_scan_push (source_info->scan, file);
+            } else {
+                g_queue_push_head (dirs, g_object_ref (file));
+            }
         }
 
         g_object_unref (info);
@@ -2885,13 +3465,261 @@ retry:
     g_queue_free (dirs);
 }
 
+/* Parallel scanning of the sources.
+ *
+ * Folders are enumerated by a pool of threads. Every subfolder found becomes a new task of the pool,
+ * so that idle threads take over work from any part of the tree instead of one thread walking it depth
+ * first. The threads only add up what they find; when a folder cannot be read it is handed back to the
+ * job thread, which scans it again serially with the usual dialogs.
+ *
+ * Copies and moves do not wait for the scan to complete: after a head start they begin transferring
+ * while the counting continues, and show the totals found so far as an estimate. Errors met while
+ * scanning in the background are ignored, as the transfer itself reports them.
+ */
+#define SCAN_THREADS 8
+#define SCAN_HEAD_START_USEC (G_USEC_PER_SEC / 2)
+#define SCAN_PROGRESS_INTERVAL_USEC (G_USEC_PER_SEC / 10)
+
+struct _ParallelScan {
+    GThreadPool *threads;
+    GCancellable *cancellable;
+    gboolean background;
+    GMutex mutex;
+    GCond done_cond;
+    /* Protected by mutex */
+    gboolean stopped;
+    guint pending;
+    int num_files;
+    goffset num_bytes;
+    GList *failed_dirs;
+};
+
+static void
+parallel_scan_push (ParallelScan *scan,
+                    GFile *dir)
+{
+    /* Pushed under the lock, so that no folder is queued once the pool is being freed */
+    g_mutex_lock (&scan->mutex);
+    if (!scan->stopped) {
+        scan->pending++;
+        g_thread_pool_push (scan->threads, g_object_ref (dir), NULL);
+    }
+    g_mutex_unlock (&scan->mutex);
+}
+
+static void
+parallel_scan_dir (gpointer data,
+                   gpointer user_data)
+{
+    GFile *dir = data;
+    ParallelScan *scan = user_data;
+    GFileEnumerator *enumerator;
+    GFileInfo *info;
+    GFile *subdir;
+    GList *subdirs, *l;
+    GError *error;
+    int num_files;
+    goffset num_bytes;
+    gboolean stopped;
+
+    error = NULL;
+    subdirs = NULL;
+    num_files = 0;
+    num_bytes = 0;
+
+    /* The folders still queued when the scan is stopped are dropped */
+    g_mutex_lock (&scan->mutex);
+    stopped = scan->stopped;
+    g_mutex_unlock (&scan->mutex);
+
+    enumerator = NULL;
+    if (!stopped) {
+        enumerator = g_file_enumerate_children (dir,
+                                                G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                                G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                                                G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                                G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                                scan->cancellable,
+                                                &error);
+    }
+    if (enumerator) {
+        while ((info = g_file_enumerator_next_file (enumerator, scan->cancellable, &error)) != NULL) {
+            num_files++;
+            num_bytes += g_file_info_get_size (info);
+
+            if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+                subdir = g_file_get_child (dir, g_file_info_get_name (info));
+                subdirs = g_list_prepend (subdirs, subdir);
+            }
+
+            g_object_unref (info);
+        }
+
+        g_file_enumerator_close (enumerator, scan->cancellable, NULL);
+        g_object_unref (enumerator);
+    }
+
+    if (error == NULL) {
+        for (l = subdirs; l != NULL; l = l->next) {
+            parallel_scan_push (scan, l->data);
+        }
+    }
+
+    g_mutex_lock (&scan->mutex);
+    if (error == NULL) {
+        scan->num_files += num_files;
+        scan->num_bytes += num_bytes;
+    } else if (!scan->background && !IS_IO_ERROR (error, CANCELLED)) {
+        /* Counted again by the job thread */
+        scan->failed_dirs = g_list_prepend (scan->failed_dirs, g_object_ref (dir));
+    }
+
+    if (--scan->pending == 0) {
+        g_cond_broadcast (&scan->done_cond);
+    }
+    g_mutex_unlock (&scan->mutex);
+
+    if (error != NULL) {
+        g_error_free (error);
+    }
+
+    g_list_free_full (subdirs, g_object_unref);
+    g_object_unref (dir);
+}
+
+static ParallelScan *
+parallel_scan_new (CommonJob *job,
+                   gboolean background)
+{
+    ParallelScan *scan;
+
+    scan = g_slice_new0 (ParallelScan);
+    scan->cancellable = g_object_ref (job->cancellable);
+    scan->background = background;
+    g_mutex_init (&scan->mutex);
+    g_cond_init (&scan->done_cond);
+    scan->threads = g_thread_pool_new (parallel_scan_dir, scan, SCAN_THREADS, FALSE, NULL);
+
+    return scan;
+}
+
+/* Adds what the scan threads found since the last call to @source_info.
+ * Returns whether the scan is complete */
+static gboolean
+parallel_scan_collect (ParallelScan *scan,
+                       SourceInfo *source_info)
+{
+    gboolean done;
+
+    g_mutex_lock (&scan->mutex);
+    source_info->num_files += scan->num_files;
+    source_info->num_bytes += scan->num_bytes;
+    scan->num_files = 0;
+    scan->num_bytes = 0;
+    done = scan->pending == 0;
+    g_mutex_unlock (&scan->mutex);
+
+    return done;
+}
+
+/* Waits for the scan to complete, or at most @timeout_usec when it is not negative,
+ * reporting the count meanwhile. Returns whether the scan is complete */
+static gboolean
+parallel_scan_wait (ParallelScan *scan,
+                    CommonJob *job,
+                    SourceInfo *source_info,
+                    gint64 timeout_usec)
+{
+    gint64 start_time, end_time;
+    gboolean done;
+
+    start_time = g_get_monotonic_time ();
+    end_time = start_time + timeout_usec;
+    do {
+        g_mutex_lock (&scan->mutex);
+        if (scan->pending > 0) {
+            g_cond_wait_until (&scan->done_cond, &scan->mutex,
+                               g_get_monotonic_time () + SCAN_PROGRESS_INTERVAL_USEC);
+        }
+        g_mutex_unlock (&scan->mutex);
+
+        done = parallel_scan_collect (scan, source_info);
+        report_count_progress (job, source_info);
+    } while (!done && (timeout_usec < 0 || g_get_monotonic_time () < end_time));
+
+    return done;
+}
+
+/* Waits for the scan threads and frees the scan */
+static void
+source_info_finish_scan (SourceInfo *source_info)
+{
+    ParallelScan *scan = source_info->scan;
+
+    if (scan == NULL) {
+        return;
+    }
+
+    source_info->scan = NULL;
+
+    g_mutex_lock (&scan->mutex);
+    scan->stopped = TRUE;
+    g_mutex_unlock (&scan->mutex);
+
+    g_thread_pool_free (scan->threads, FALSE, TRUE);
+    parallel_scan_collect (scan, source_info);
+
+    g_list_free_full (scan->failed_dirs, g_object_unref);
+
+    g_object_unref (scan->cancellable);
+    g_mutex_clear (&scan->mutex);
+    g_cond_clear (&scan->done_cond);
+    g_slice_free (ParallelScan, scan);
+}
+
+/* Picks up the latest count of a background scan, and frees it once complete */
+static void
+source_info_update (SourceInfo *source_info)
+{
+    if (source_info->scan != NULL &&
+        parallel_scan_collect (source_info->scan, source_info)) {
+        source_info_finish_scan (source_info);
+    }
+}
+
+static void
+scan_failed_dirs (GList *dirs,
+                  SourceInfo *source_info,
+                  CommonJob *job)
+{
+    GQueue *queue;
+    GFile *dir;
+    GList *l;
+
+    queue = g_queue_new ();
+    for (l = dirs; l != NULL; l = l->next) {
+        g_queue_push_head (queue, g_object_ref (l->data));
+    }
+
+    while (!job_aborted (job) &&
+           (dir = g_queue_pop_head (queue)) != NULL) {
+        scan_dir (dir, source_info, job, queue);
+        g_object_unref (dir);
+    }
+
+    /* Free all from queue if we exited early */
+    g_queue_foreach (queue, (GFunc)g_object_unref, NULL);
+    g_queue_free (queue);
+}
+
 static void
 scan_sources (GList *files,
               SourceInfo *source_info,
               CommonJob *job,
-              OpKind kind)
+              OpKind kind,
+              gboolean background)
 {
-    GList *l;
+    GList *l, *failed_dirs;
     GFile *file;
 
     memset (source_info, 0, sizeof (SourceInfo));
@@ -2899,6 +3727,8 @@ scan_sources (GList *files,
 
     report_count_progress (job, source_info);
 
+    source_info->scan = parallel_scan_new (job, background);
+
     for (l = files; l != NULL && !job_aborted (job); l = l->next) {
         file = l->data;
 
@@ -2907,10 +3737,316 @@ scan_sources (GList *files,
                    job);
     }
 
+    if (parallel_scan_wait (source_info->scan, job, source_info,
+                            background ? SCAN_HEAD_START_USEC : -1)) {
+        failed_dirs = source_info->scan->failed_dirs;
+        source_info->scan->failed_dirs = NULL;
+        source_info_finish_scan (source_info);
+
+        /* Folders the threads could not read are scanned again here, where dialogs can be shown */
+        scan_failed_dirs (failed_dirs, source_info, job);
+        g_list_free_full (failed_dirs, g_object_unref);
+    }
+
     /* Make sure we report the final count */
     report_count_progress (job, source_info);
 }
 
+/* Pre-scan for conflicts.
+ *
+ * Without it, every file that already exists at the destination stops the job with a dialog when the
+ * transfer gets to it, so an unattended copy may wait for an answer after a few files. A thread looks
+ * for them while the sources are being counted: it reads each destination folder the sources would be
+ * merged into once and compares the names with those of the source folder. When there is more than one
+ * conflict, they are all settled in a single question before the transfer starts, through the same
+ * "apply to all" choices the conflict dialog offers. A single conflict is left to the conflict dialog.
+ */
+#define CONFLICT_SCAN_MAX_NAMES 10
+
+typedef struct {
+    GThread *thread;
+    GCancellable *cancellable;
+    GList *files;
+    GFile *destination;
+    GMutex mutex;
+    GCond done_cond;
+    /* Protected by mutex */
+    gboolean done;
+    /* Only touched by the thread until done */
+    int n_files;
+    int n_folders;
+    GString *names;
+} ConflictScan;
+
+/* Remembers that @dest exists, and its name for the first few of them */
+static void
+conflict_scan_add (ConflictScan *scan,
+                   GFile *dest,
+                   gboolean is_merge)
+{
+    char *relative_path, *display_name;
+
+    if (is_merge) {
+        scan->n_folders++;
+        return;
+    }
+
+    scan->n_files++;
+    if (scan->n_files <= CONFLICT_SCAN_MAX_NAMES) {
+        relative_path = g_file_get_relative_path (scan->destination, dest);
+        display_name = g_filename_display_name (relative_path != NULL ? relative_path : "");
+        g_string_append_printf (scan->names, "%s\n", display_name);
+        g_free (display_name);
+        g_free (relative_path);
+    } else if (scan->n_files == CONFLICT_SCAN_MAX_NAMES + 1) {
+        g_string_append (scan->names, "...\n");
+    }
+}
+
+static void
+conflict_scan_dir (ConflictScan *scan,
+                   GFile *src_dir,
+                   GFile *dest_dir)
+{
+    GFileEnumerator *enumerator;
+    GFileInfo *info;
+    GHashTable *dest_types;
+    GFile *src, *dest;
+    const char *name;
+    gpointer type;
+
+    dest_types = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    enumerator = g_file_enumerate_children (dest_dir,
+                                            G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                            G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                            scan->cancellable,
+                                            NULL);
+    if (enumerator == NULL) {
+        g_hash_table_destroy (dest_types);
+        return;
+    }
+
+    while ((info = g_file_enumerator_next_file (enumerator, scan->cancellable, NULL)) != NULL) {
+        g_hash_table_insert (dest_types, g_strdup (g_file_info_get_name (info)),
+                             GINT_TO_POINTER (g_file_info_get_file_type (info)));
+        g_object_unref (info);
+    }
+    g_object_unref (enumerator);
+
+    /* Nothing can conflict with an empty folder */
+    enumerator = NULL;
+    if (g_hash_table_size (dest_types) > 0) {
+        enumerator = g_file_enumerate_children (src_dir,
+                                                G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                                G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                                G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                                scan->cancellable,
+                                                NULL);
+    }
+
+    if (enumerator != NULL) {
+        while ((info = g_file_enumerator_next_file (enumerator, scan->cancellable, NULL)) != NULL) {
+            name = g_file_info_get_name (info);
+            if (g_hash_table_lookup_extended (dest_types, name, NULL, &type)) {
+                dest = g_file_get_child (dest_dir, name);
+                if (GPOINTER_TO_INT (type) == G_FILE_TYPE_DIRECTORY &&
+                    g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+                    conflict_scan_add (scan, dest, TRUE);
+                    src = g_file_get_child (src_dir, name);
+                    conflict_scan_dir (scan, src, dest);
+                    g_object_unref (src);
+                } else {
+                    conflict_scan_add (scan, dest, FALSE);
+                }
+                g_object_unref (dest);
+            }
+            g_object_unref (info);
+        }
+        g_object_unref (enumerator);
+    }
+
+    g_hash_table_destroy (dest_types);
+}
+
+static gpointer
+conflict_scan_thread (gpointer data)
+{
+    ConflictScan *scan = data;
+    GFileInfo *src_info, *dest_info;
+    GFile *src, *dest;
+    char *basename;
+    gboolean is_merge;
+    GList *l;
+
+    for (l = scan->files; l != NULL && !g_cancellable_is_cancelled (scan->cancellable); l = l->next) {
+        src = l->data;
+
+        /* Copying a file onto itself or into itself is reported by the transfer */
+        basename = g_file_get_basename (src);
+        dest = g_file_get_child (scan->destination, basename);
+        g_free (basename);
+        if (g_file_equal (src, dest) || g_file_has_prefix (scan->destination, src)) {
+            g_object_unref (dest);
+            continue;
+        }
+
+        dest_info = g_file_query_info (dest, G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                       G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                       scan->cancellable, NULL);
+        if (dest_info != NULL) {
+            src_info = g_file_query_info (src, G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                          scan->cancellable, NULL);
+            is_merge = src_info != NULL &&
+                       g_file_info_get_file_type (src_info) == G_FILE_TYPE_DIRECTORY &&
+                       g_file_info_get_file_type (dest_info) == G_FILE_TYPE_DIRECTORY;
+
+            conflict_scan_add (scan, dest, is_merge);
+            if (is_merge) {
+                conflict_scan_dir (scan, src, dest);
+            }
+
+            g_clear_object (&src_info);
+            g_object_unref (dest_info);
+        }
+
+        g_object_unref (dest);
+    }
+
+    g_mutex_lock (&scan->mutex);
+    scan->done = TRUE;
+    g_cond_broadcast (&scan->done_cond);
+    g_mutex_unlock (&scan->mutex);
+
+    return NULL;
+}
+
+/* Starts looking for the @files that already exist in @destination. Returns NULL when conflicts
+ * are to be handled as the transfer meets them */
+static ConflictScan *
+conflict_scan_start (CopyMoveJob *job,
+                     GList *files)
+{
+    ConflictScan *scan;
+
+    /* Duplicates never conflict, and a resumed job finds what it made itself */
+    if (files == NULL || job->destination == NULL ||
+        (job->journal != NULL && marlin_copy_journal_is_resuming (job->journal)) ||
+        !should_prescan_conflicts ()) {
+        return NULL;
+    }
+
+    scan = g_slice_new0 (ConflictScan);
+    scan->cancellable = g_object_ref (job->common.cancellable);
+    scan->files = eel_g_object_list_copy (files);
+    scan->destination = g_object_ref (job->destination);
+    scan->names = g_string_new (NULL);
+    g_mutex_init (&scan->mutex);
+    g_cond_init (&scan->done_cond);
+    scan->thread = g_thread_new ("conflict-scan", conflict_scan_thread, scan);
+
+    return scan;
+}
+
+/* Waits for @scan, keeping the count of @source_info going meanwhile when not NULL, and asks once
+ * what to do with all the conflicts found. Frees @scan */
+static void
+conflict_scan_finish (ConflictScan *scan,
+                      CopyMoveJob *job,
+                      SourceInfo *source_info)
+{
+    CommonJob *common = (CommonJob *)job;
+    char *primary, *secondary, *count;
+    int response;
+
+    if (scan == NULL) {
+        return;
+    }
+
+    g_mutex_lock (&scan->mutex);
+    while (!scan->done) {
+        g_cond_wait_until (&scan->done_cond, &scan->mutex,
+                           g_get_monotonic_time () + SCAN_PROGRESS_INTERVAL_USEC);
+        g_mutex_unlock (&scan->mutex);
+
+        if (source_info != NULL) {
+            source_info_update (source_info);
+            report_count_progress (common, source_info);
+        }
+
+        g_mutex_lock (&scan->mutex);
+    }
+    g_mutex_unlock (&scan->mutex);
+
+    g_thread_join (scan->thread);
+
+    if (!job_aborted (common) && scan->n_files + scan->n_folders > 1) {
+        primary = f (_("Some of the items already exist in \"%B\"."), scan->destination);
+
+        if (scan->n_files == 0) {
+            secondary = f (ngettext ("%'d folder would be merged with the one already there. "
+                                     "Choose now how to handle it, so that the rest of the operation "
+                                     "does not need your attention.",
+                                     "%'d folders would be merged with the ones already there. "
+                                     "Choose now how to handle them, so that the rest of the operation "
+                                     "does not need your attention.",
+                                     scan->n_folders),
+                           scan->n_folders);
+
+            response = run_question (common, primary, secondary, NULL, FALSE,
+                                     GTK_STOCK_CANCEL, _("Ask for _Each"), MERGE_ALL,
+                                     NULL);
+            if (response == 2) {
+                job->merge_all = TRUE;
+            }
+        } else {
+            count = f (ngettext ("%'d file would replace an existing one",
+                                 "%'d files would replace existing ones",
+                                 scan->n_files),
+                       scan->n_files);
+            if (scan->n_folders > 0) {
+                secondary = f (ngettext ("%s, and %'d folder would be merged. Choose now how to handle "
+                                         "them, so that the rest of the operation does not need your attention.",
+                                         "%s, and %'d folders would be merged. Choose now how to handle "
+                                         "them, so that the rest of the operation does not need your attention.",
+                                         scan->n_folders),
+                               count, scan->n_folders);
+            } else {
+                secondary = f (_("%s. Choose now how to handle them, so that the rest of the operation "
+                                 "does not need your attention."),
+                               count);
+            }
+            g_free (count);
+
+            response = run_question (common, primary, secondary, scan->names->str, FALSE,
+                                     GTK_STOCK_CANCEL, _("Ask for _Each"), _("_Skip Existing Files"), REPLACE_ALL,
+                                     NULL);
+            if (response == 2) {
+                /* New files still go into the folders that exist */
+                job->merge_all = TRUE;
+                job->skip_all_conflict = TRUE;
+            } else if (response == 3) {
+                job->merge_all = TRUE;
+                job->replace_all = TRUE;
+            }
+        }
+
+        if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT) {
+            abort_job (common);
+        }
+    }
+
+    g_list_free_full (scan->files, g_object_unref);
+    g_object_unref (scan->destination);
+    g_object_unref (scan->cancellable);
+    g_string_free (scan->names, TRUE);
+    g_mutex_clear (&scan->mutex);
+    g_cond_clear (&scan->done_cond);
+    g_slice_free (ConflictScan, scan);
+}
+
 static void
 verify_destination (CommonJob *job,
                     GFile *dest,
@@ -3068,24 +4204,78 @@ retry:
     g_object_unref (fsinfo);
 }
 
+static char *
+format_copy_status (CopyMoveJob *copy_job,
+                    int files_left,
+                    gboolean single_file)
+{
+    gboolean is_move;
+
+    is_move = copy_job->is_move;
+
+    if (single_file) {
+        if (copy_job->destination != NULL) {
+            return f (is_move ? _("Moving \"%B\" to \"%B\"") :
+                      _("Copying \"%B\" to \"%B\""),
+                      (GFile *)copy_job->files->data,
+                      copy_job->destination);
+        } else {
+            return f (_("Duplicating \"%B\""), (GFile *)copy_job->files->data);
+        }
+    } else if (copy_job->files != NULL && copy_job->files->next == NULL) {
+        if (copy_job->destination != NULL) {
+            return f (is_move ? ngettext ("Moving %'d file (in \"%B\") to \"%B\"",
+                                          "Moving %'d files (in \"%B\") to \"%B\"",
+                                          files_left) :
+                      ngettext ("Copying %'d file (in \"%B\") to \"%B\"",
+                                "Copying %'d files (in \"%B\") to \"%B\"",
+                                files_left),
+                      files_left,
+                      (GFile *)copy_job->files->data,
+                      copy_job->destination);
+        } else {
+            return f (ngettext ("Duplicating %'d file (in \"%B\")",
+                                "Duplicating %'d files (in \"%B\")",
+                                files_left),
+                      files_left,
+                      (GFile *)copy_job->files->data);
+        }
+    } else {
+        if (copy_job->destination != NULL) {
+            return f (is_move?
+                      ngettext ("Moving %'d file to \"%B\"",
+                                "Moving %'d files to \"%B\"",
+                                files_left)
+                      :
+                      ngettext ("Copying %'d file to \"%B\"",
+                                "Copying %'d files to \"%B\"",
+                                files_left),
+                      files_left, copy_job->destination);
+        } else {
+            return f (ngettext ("Duplicating %'d file",
+                                "Duplicating %'d files",
+                                files_left),
+                      files_left);
+        }
+    }
+}
+
 static void
 report_copy_progress (CopyMoveJob *copy_job,
                       SourceInfo *source_info,
                       TransferInfo *transfer_info)
 {
     CommonJob *job;
+#ifdef ENABLE_TASKVIEW
     gboolean is_move;
     int files_left;
-#ifndef ENABLE_TASKVIEW
-    goffset total_size;
-    double elapsed, transfer_rate;
-    int remaining_time;
-#endif
     guint64 now;
     gchar *s = NULL;
+#endif
 
     job = (CommonJob *)copy_job;
 
+#ifdef ENABLE_TASKVIEW
     is_move = copy_job->is_move;
 
     now = g_thread_gettime ();
@@ -3097,6 +4287,7 @@ report_copy_progress (CopyMoveJob *copy_job,
 
     transfer_info->last_report_time = now;
 
+    source_info_update (source_info);
     files_left = source_info->num_files - transfer_info->num_files;
 
     /* Races and whatnot could cause this to be negative... */
@@ -3108,55 +4299,10 @@ report_copy_progress (CopyMoveJob *copy_job,
         transfer_info->last_reported_files_left == 0) {
         /* Avoid changing this unless files_left changed since last time */
         transfer_info->last_reported_files_left = files_left;
-
-        if (source_info->num_files == 1) {
-            if (copy_job->destination != NULL) {
-                s = f (is_move ? _("Moving \"%B\" to \"%B\"") :
-                       _("Copying \"%B\" to \"%B\""),
-                       (GFile *)copy_job->files->data,
-                       copy_job->destination);
-            } else {
-                s = f (_("Duplicating \"%B\""), (GFile *)copy_job->files->data);
-            }
-        } else if (copy_job->files != NULL && copy_job->files->next == NULL) {
-            if (copy_job->destination != NULL) {
-                s = f (is_move ? ngettext ("Moving %'d file (in \"%B\") to \"%B\"",
-                                           "Moving %'d files (in \"%B\") to \"%B\"",
-                                           files_left) :
-                       ngettext ("Copying %'d file (in \"%B\") to \"%B\"",
-                                 "Copying %'d files (in \"%B\") to \"%B\"",
-                                 files_left),
-                       files_left,
-                       (GFile *)copy_job->files->data,
-                       copy_job->destination);
-            } else {
-                s = f (ngettext ("Duplicating %'d file (in \"%B\")",
-                                 "Duplicating %'d files (in \"%B\")",
-                                 files_left),
-                       files_left,
-                       (GFile *)copy_job->files->data);
-            }
-        } else {
-            if (copy_job->destination != NULL) {
-                s = f (is_move?
-                       ngettext ("Moving %'d file to \"%B\"",
-                                 "Moving %'d files to \"%B\"",
-                                 files_left)
-                       :
-                       ngettext ("Copying %'d file to \"%B\"",
-                                 "Copying %'d files to \"%B\"",
-                                 files_left),
-                       files_left, copy_job->destination);
-            } else {
-                s = f (ngettext ("Duplicating %'d file",
-                                 "Duplicating %'d files",
-                                 files_left),
-                       files_left);
-            }
-        }
+        s = format_copy_status (copy_job, files_left,
+                                source_info->num_files == 1 && source_info->scan == NULL);
     }
 
-#ifdef ENABLE_TASKVIEW
     g_object_set (job->tv_io,
                   "state", TASKVIEW_RUNNING,
                   "processed-items", (guint64) transfer_info->num_files,
@@ -3181,30 +4327,60 @@ report_copy_progress (CopyMoveJob *copy_job,
         g_free (current_item);
     }
 #else
-    if (s != NULL)
-    {
-        marlin_progress_info_take_status (job->progress, s);
-    }
+    publish_progress (job, PROGRESS_PHASE_COPYING, source_info, transfer_info);
+#endif
+}
 
+#ifndef ENABLE_TASKVIEW
+static void
+sample_copy_progress (CopyMoveJob *copy_job,
+                      guint64 files_done,
+                      guint64 bytes_done,
+                      guint64 files_total,
+                      guint64 bytes_total,
+                      gboolean counting)
+{
+    CommonJob *job;
+    int files_left;
+    goffset total_size;
+    double seconds_left;
+    int remaining_time;
+    char *s;
 
-    total_size = MAX (source_info->num_bytes, transfer_info->num_bytes);
+    job = (CommonJob *)copy_job;
 
-    elapsed = g_timer_elapsed (job->time, NULL);
-    transfer_rate = 0;
-    if (elapsed > 0) {
-        transfer_rate = transfer_info->num_bytes / elapsed;
+    files_left = (int) files_total - (int) files_done;
+
+    /* Races and whatnot could cause this to be negative... */
+    if (files_left < 0) {
+        files_left = 1;
+    }
+
+    if (files_left != job->last_sampled_files_left ||
+        job->last_sampled_files_left == 0) {
+        /* Avoid changing this unless files_left changed since last time */
+        job->last_sampled_files_left = files_left;
+        marlin_progress_info_take_status (job->progress,
+                                          format_copy_status (copy_job, files_left,
+                                                              files_total == 1 && !counting));
     }
 
-    if (elapsed < SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE &&
-        transfer_rate > 0) {
-        char *s;
+    total_size = MAX (bytes_total, bytes_done);
+
+    marlin_rate_estimator_add_sample (job->rate, g_timer_elapsed (job->time, NULL),
+                                      bytes_done, files_done);
+
+    if (counting) {
+        /// TRANSLATORS: %S will expand to a size like "2 bytes" or "3 MB". The total is an estimate
+        /// as the files to copy are still being counted
+        s = f (_("%S of at least %S"), (goffset) bytes_done, total_size);
+    } else if (!marlin_rate_estimator_get_time_left (job->rate, total_size - bytes_done,
+                                                     files_total - MIN (files_done, files_total),
+                                                     &seconds_left)) {
         /// TRANSLATORS: %S will expand to a size like "2 bytes" or "3 MB", so something like "4 kb of 4 MB"
-        s = f (_("%S of %S"), transfer_info->num_bytes, total_size);
-        marlin_progress_info_take_details (job->progress, s);
+        s = f (_("%S of %S"), (goffset) bytes_done, total_size);
     } else {
-        char *s;
-        remaining_time = (total_size - transfer_info->num_bytes) / transfer_rate;
-
+        remaining_time = MIN (seconds_left, G_MAXINT);
 
         /// TRANSLATORS: %S will expand to a size like "2 bytes" or "3 MB", %T to a time duration like
         /// "2 minutes". So the whole thing will be something like "2 kb of 4 MB -- 2 hours left (4kb/sec)"
@@ -3212,16 +4388,76 @@ report_copy_progress (CopyMoveJob *copy_job,
         s = f (ngettext ("%S of %S \xE2\x80\x94 %T left (%S/sec)",
                  "%S of %S \xE2\x80\x94 %T left (%S/sec)",
                  seconds_count_format_time_units (remaining_time)),
-               transfer_info->num_bytes, total_size,
+               (goffset) bytes_done, total_size,
                remaining_time,
-               (goffset)transfer_rate);
-        marlin_progress_info_take_details (job->progress, s);
+               (goffset) marlin_rate_estimator_get_bytes_per_sec (job->rate));
     }
+    marlin_progress_info_take_details (job->progress, s);
 
-    marlin_progress_info_set_progress (job->progress, transfer_info->num_bytes, total_size);
-#endif
+    marlin_progress_info_set_progress (job->progress, bytes_done, total_size);
 }
 
+static void
+sample_verify_progress (CopyMoveJob *copy_job,
+                        guint64 files_done,
+                        guint64 files_total)
+{
+    CommonJob *job;
+
+    job = (CommonJob *)copy_job;
+
+    marlin_progress_info_take_status (job->progress,
+                                      f (_("Checking the copies in \"%B\""), copy_job->destination));
+    marlin_progress_info_take_details (job->progress,
+                                       f (ngettext ("%'d of %'d file checked",
+                                                    "%'d of %'d files checked",
+                                                    (int) files_total),
+                                          (int) files_done, (int) files_total));
+
+    if (files_total != 0) {
+        marlin_progress_info_set_progress (job->progress, files_done, files_total);
+    }
+}
+
+/* Called on the main loop ten times a second for every job, see publish_progress () */
+static void
+sample_job_progress (MarlinProgressInfo *info,
+                     gpointer user_data)
+{
+    CommonJob *job = user_data;
+    guint64 files_done, bytes_done, files_total, bytes_total;
+
+    marlin_progress_info_get_counts (info, &files_done, &bytes_done, &files_total, &bytes_total);
+
+    switch (g_atomic_int_get (&job->progress_phase)) {
+    case PROGRESS_PHASE_COUNTING:
+        marlin_progress_info_take_details (info,
+                                           format_count_progress (g_atomic_int_get (&job->progress_op),
+                                                                  files_total, bytes_total));
+        marlin_progress_info_pulse_progress (info);
+        break;
+
+    case PROGRESS_PHASE_DELETING:
+        sample_delete_progress (job, files_done, files_total);
+        break;
+
+    case PROGRESS_PHASE_COPYING:
+        /* Only copy and move jobs report copy progress */
+        sample_copy_progress ((CopyMoveJob *)job, files_done, bytes_done, files_total, bytes_total,
+                              g_atomic_int_get (&job->progress_counting));
+        break;
+
+    case PROGRESS_PHASE_VERIFYING:
+        sample_verify_progress ((CopyMoveJob *)job, files_done, files_total);
+        break;
+
+    case PROGRESS_PHASE_NONE:
+    default:
+        break;
+    }
+}
+#endif
+
 static int
 get_max_name_length (GFile *file_dir)
 {
@@ -3312,62 +4548,189 @@ make_file_name_valid_for_dest_fs (char *filename,
     return FALSE;
 }
 
+/* Past this many duplicates in one folder its names are read up front instead of probed per copy */
+#define NAME_INDEX_MAX_PROBED 8
+
+/* The names given to duplicates made in a folder, plus the names already in it once it was read */
+typedef struct {
+    GHashTable *names;
+    int max_length;
+    gboolean loaded;
+    guint n_reserved;
+} NameIndex;
+
+static void
+name_index_free (NameIndex *index)
+{
+    g_hash_table_destroy (index->names);
+    g_slice_free (NameIndex, index);
+}
+
+static NameIndex *
+name_index_new (GFile *dir)
+{
+    NameIndex *index;
+
+    index = g_slice_new0 (NameIndex);
+    index->names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    index->max_length = get_max_name_length (dir);
+
+    return index;
+}
+
+/* Adds the names in @dir to @index. Until then a taken name is only found when creating the
+ * duplicate fails, which is cheaper for the few duplicates of a single Ctrl+D */
+static void
+name_index_load (NameIndex *index,
+                 GFile *dir,
+                 GCancellable *cancellable)
+{
+    GFileEnumerator *enumerator;
+    GFileInfo *info;
+
+    index->loaded = TRUE;
+
+    /* When the folder can't be read the names are still checked when the duplicates are created */
+    enumerator = g_file_enumerate_children (dir,
+                                            G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                            cancellable,
+                                            NULL);
+    if (enumerator != NULL) {
+        while ((info = g_file_enumerator_next_file (enumerator, cancellable, NULL)) != NULL) {
+            g_hash_table_add (index->names, g_strdup (g_file_info_get_name (info)));
+            g_object_unref (info);
+        }
+
+        g_object_unref (enumerator);
+    }
+}
+
+static NameIndex *
+get_name_index (CopyMoveJob *job,
+                GFile *dir)
+{
+    NameIndex *index;
+
+    if (job->name_indexes == NULL) {
+        job->name_indexes = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+                                                   g_object_unref, (GDestroyNotify) name_index_free);
+    }
+
+    index = g_hash_table_lookup (job->name_indexes, dir);
+    if (index == NULL) {
+        index = name_index_new (dir);
+        g_hash_table_insert (job->name_indexes, g_object_ref (dir), index);
+    }
+
+    return index;
+}
+
+/* Returns TRUE and records the name of @file if no other file in the index has it */
+static gboolean
+name_index_reserve (NameIndex *index,
+                    GFile *file)
+{
+    char *name;
+
+    name = g_file_get_basename (file);
+    if (g_hash_table_contains (index->names, name)) {
+        g_free (name);
+        return FALSE;
+    }
+
+    g_hash_table_add (index->names, name);
+    index->n_reserved++;
+    return TRUE;
+}
+
+static GFile *
+make_unique_target_candidate (const char *editname,
+                              const char *basename,
+                              GFile *dest_dir,
+                              const char *dest_fs_type,
+                              int max_length,
+                              int count)
+{
+    const char *end;
+    char *new_name;
+    GFile *dest;
+
+    dest = NULL;
+    if (editname != NULL) {
+        new_name = get_duplicate_name (editname, count, max_length);
+        make_file_name_valid_for_dest_fs (new_name, dest_fs_type);
+        dest = g_file_get_child_for_display_name (dest_dir, new_name, NULL);
+        g_free (new_name);
+    }
+
+    if (dest == NULL && g_utf8_validate (basename, -1, NULL)) {
+        new_name = get_duplicate_name (basename, count, max_length);
+        make_file_name_valid_for_dest_fs (new_name, dest_fs_type);
+        dest = g_file_get_child_for_display_name (dest_dir, new_name, NULL);
+        g_free (new_name);
+    }
+
+    if (dest == NULL) {
+        end = strrchr (basename, '.');
+        if (end != NULL) {
+            count += atoi (end + 1);
+        }
+        new_name = g_strdup_printf ("%s.%d", basename, count);
+        make_file_name_valid_for_dest_fs (new_name, dest_fs_type);
+        dest = g_file_get_child (dest_dir, new_name);
+        g_free (new_name);
+    }
+
+    return dest;
+}
+
+/* Returns the first duplicate name for @src from *@count on that is not taken in @index, reserves it
+ * and stores its number in @count. Copying to it may still fail with G_IO_ERROR_EXISTS when the folder
+ * is not indexed yet or changed since, the caller then asks for the next one */
 static GFile *
 get_unique_target_file (GFile *src,
                         GFile *dest_dir,
                         gboolean same_fs,
                         const char *dest_fs_type,
-                        int count)
+                        NameIndex *index,
+                        GCancellable *cancellable,
+                        int *count)
 {
-    const char *editname, *end;
-    char *basename, *new_name;
+    char *editname, *basename;
     GFileInfo *info;
     GFile *dest;
-    int max_length;
 
-    max_length = get_max_name_length (dest_dir);
-
-    dest = NULL;
+    editname = NULL;
     info = g_file_query_info (src,
-                              G_FILE_ATTRIBUTE_STANDARD_EDIT_NAME,
-                              0, NULL, NULL);
-    if (info != NULL) {
-        editname = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_EDIT_NAME);
-
-        if (editname != NULL) {
-            new_name = get_duplicate_name (editname, count, max_length);
-            make_file_name_valid_for_dest_fs (new_name, dest_fs_type);
-            dest = g_file_get_child_for_display_name (dest_dir, new_name, NULL);
-            g_free (new_name);
-        }
-
+                              G_FILE_ATTRIBUTE_STANDARD_EDIT_NAME,
+                              0, NULL, NULL);
+    if (info != NULL) {
+        editname = g_strdup (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_EDIT_NAME));
         g_object_unref (info);
     }
 
-    if (dest == NULL) {
-        basename = g_file_get_basename (src);
+    basename = g_file_get_basename (src);
 
-        if (g_utf8_validate (basename, -1, NULL)) {
-            new_name = get_duplicate_name (basename, count, max_length);
-            make_file_name_valid_for_dest_fs (new_name, dest_fs_type);
-            dest = g_file_get_child_for_display_name (dest_dir, new_name, NULL);
-            g_free (new_name);
-        }
+    /* A later count means the name before was taken on disk */
+    if (!index->loaded && (*count > 1 || index->n_reserved >= NAME_INDEX_MAX_PROBED)) {
+        name_index_load (index, dest_dir, cancellable);
+    }
 
-        if (dest == NULL) {
-            end = strrchr (basename, '.');
-            if (end != NULL) {
-                count += atoi (end + 1);
-            }
-            new_name = g_strdup_printf ("%s.%d", basename, count);
-            make_file_name_valid_for_dest_fs (new_name, dest_fs_type);
-            dest = g_file_get_child (dest_dir, new_name);
-            g_free (new_name);
+    /* Each count gives a different name, so this ends at the latest after all names in the index */
+    for (;; (*count)++) {
+        dest = make_unique_target_candidate (editname, basename, dest_dir, dest_fs_type,
+                                             index->max_length, *count);
+        if (name_index_reserve (index, dest)) {
+            break;
         }
 
-        g_free (basename);
+        g_object_unref (dest);
     }
 
+    g_free (editname);
+    g_free (basename);
+
     return dest;
 }
 
@@ -3529,6 +4892,22 @@ static void copy_move_file (CopyMoveJob *job,
                             gboolean *skipped_file,
                             gboolean readonly_source_fs);
 
+static gboolean copy_pool_accepts (CopyMoveJob *job,
+                                   GFileInfo *info);
+static void copy_pool_push (CopyMoveJob *job,
+                            GFile *src,
+                            GFile *dest_dir,
+                            gboolean same_fs,
+                            const char *dest_fs_type,
+                            goffset size,
+                            gboolean readonly_source_fs,
+                            SourceInfo *source_info,
+                            TransferInfo *transfer_info);
+static void copy_pool_defer_attributes (CopyPool *pool,
+                                        GFile *src,
+                                        GFile *dest,
+                                        GFileCopyFlags flags);
+
 typedef enum {
     CREATE_DEST_DIR_RETRY,
     CREATE_DEST_DIR_FAILED,
@@ -3681,6 +5060,9 @@ copy_move_directory (CopyMoveJob *copy_job,
             g_hash_table_replace (debuting_files, g_object_ref (*dest), GINT_TO_POINTER (TRUE));
         }
 
+        if (copy_job->journal != NULL) {
+            marlin_copy_journal_folder_created (copy_job->journal, src, *dest);
+        }
     }
 
     local_skipped_file = FALSE;
@@ -3690,7 +5072,9 @@ copy_move_directory (CopyMoveJob *copy_job,
 retry:
     error = NULL;
     enumerator = g_file_enumerate_children (src,
-                                            G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                            G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                            G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                                            G_FILE_ATTRIBUTE_STANDARD_SIZE,
                                             G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                                             job->cancellable,
                                             &error);
@@ -3701,9 +5085,15 @@ retry:
                (info = g_file_enumerator_next_file (enumerator, job->cancellable, skip_error?NULL:&error)) != NULL) {
             src_file = g_file_get_child (src,
                                          g_file_info_get_name (info));
-            copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, &dest_fs_type,
-                            source_info, transfer_info, NULL, NULL, FALSE, &local_skipped_file,
-                            readonly_source_fs);
+            if (copy_pool_accepts (copy_job, info)) {
+                copy_pool_push (copy_job, src_file, *dest, same_fs, dest_fs_type,
+                                g_file_info_get_size (info), readonly_source_fs,
+                                source_info, transfer_info);
+            } else {
+                copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, &dest_fs_type,
+                                source_info, transfer_info, NULL, NULL, FALSE, &local_skipped_file,
+                                readonly_source_fs);
+            }
             g_object_unref (src_file);
             g_object_unref (info);
         }
@@ -3798,10 +5188,15 @@ retry:
     if (create_dest) {
         flags = (readonly_source_fs) ? G_FILE_COPY_NOFOLLOW_SYMLINKS | G_FILE_COPY_TARGET_DEFAULT_PERMS
             : G_FILE_COPY_NOFOLLOW_SYMLINKS;
-        /* Ignore errors here. Failure to copy metadata is not a hard error */
-        g_file_copy_attributes (src, *dest,
-                                flags,
-                                job->cancellable, NULL);
+        if (copy_job->copy_pool != NULL) {
+            /* Files of this folder may still be in flight */
+            copy_pool_defer_attributes (copy_job->copy_pool, src, *dest, flags);
+        } else {
+            /* Ignore errors here. Failure to copy metadata is not a hard error */
+            g_file_copy_attributes (src, *dest,
+                                    flags,
+                                    job->cancellable, NULL);
+        }
     }
 
     if (!job_aborted (job) && copy_job->is_move &&
@@ -3976,7 +5371,11 @@ skip2:
 
 typedef struct {
     CopyMoveJob *job;
+    GFile *src;
+    GFile *dest;
     goffset last_size;
+    /* Whether the data goes straight into dest: replacing a file writes a temporary file instead */
+    gboolean journal_offsets;
     SourceInfo *source_info;
     TransferInfo *transfer_info;
 } ProgressData;
@@ -3999,6 +5398,11 @@ copy_file_progress_callback (goffset current_num_bytes,
         report_copy_progress (pdata->job,
                               pdata->source_info,
                               pdata->transfer_info);
+
+        if (pdata->job->journal != NULL && pdata->journal_offsets) {
+            marlin_copy_journal_file_progress (pdata->job->journal, pdata->src, pdata->dest,
+                                               current_num_bytes, total_num_bytes);
+        }
     }
 }
 
@@ -4210,6 +5614,133 @@ get_target_file_for_display_name (GFile *dir,
     return dest;
 }
 
+/* Verification of copies.
+ *
+ * Every file copied is handed to a MarlinFileVerifier, which reads it back and compares it with the
+ * original on a thread of its own while the job copies the next files (see marlin-file-verify.c). The
+ * job thread picks up the copies found to differ after each file, and reports them with the usual
+ * error dialog; retrying copies the file again and has the new copy checked too. Once everything is
+ * copied, the job waits for the last copies to be checked.
+ */
+#define VERIFY_PROGRESS_INTERVAL_USEC (G_USEC_PER_SEC / 10)
+
+/* Reports the copies found to differ from their originals so far. Returns how many there were */
+static int
+report_verify_failures (CopyMoveJob *job)
+{
+    CommonJob *common = (CommonJob *)job;
+    GFile *src, *dest;
+    GFileCopyFlags flags;
+    GError *error;
+    char *primary, *secondary;
+    gboolean copied;
+    int response;
+    int n_failures;
+
+    n_failures = 0;
+    error = NULL;
+    while (marlin_file_verifier_pop_failure (job->verifier, &src, &dest, &flags, &error)) {
+        n_failures++;
+        copied = TRUE;
+
+retry:
+        if (!job_aborted (common) && !common->skip_all_error) {
+            primary = f (_("Error while copying \"%B\"."), src);
+            if (!copied) {
+                secondary = f (_("There was an error copying the file into \"%F\"."), dest);
+            } else if (IS_IO_ERROR (error, FAILED)) {
+                secondary = f (_("The copy \"%F\" does not match the original. It may have been "
+                                 "damaged on its way to the disk."), dest);
+            } else {
+                secondary = f (_("The copy \"%F\" could not be read back to check it."), dest);
+            }
+
+            response = run_warning (common,
+                                    primary,
+                                    secondary,
+                                    error->message,
+                                    TRUE,
+                                    GTK_STOCK_CANCEL, SKIP_ALL, SKIP, RETRY,
+                                    NULL);
+
+            g_clear_error (&error);
+
+            if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT) {
+                abort_job (common);
+            } else if (response == 1) { /* skip all */
+                common->skip_all_error = TRUE;
+            } else if (response == 2) { /* skip */
+                /* do nothing */
+            } else if (response == 3) { /* retry */
+                /* As the copy was made, over the damaged one */
+                flags |= G_FILE_COPY_OVERWRITE;
+                copied = marlin_file_copy (src, dest, flags,
+                                           common->cancellable,
+                                           NULL, NULL, NULL,
+                                           &error);
+                if (copied) {
+                    marlin_file_verifier_push (job->verifier, src, dest, flags);
+                } else if (!IS_IO_ERROR (error, CANCELLED)) {
+                    goto retry;
+                }
+            } else {
+                g_assert_not_reached ();
+            }
+        }
+
+        g_clear_error (&error);
+        g_object_unref (src);
+        g_object_unref (dest);
+    }
+
+    return n_failures;
+}
+
+/* Queues @dest, copied from @src with @flags, to be checked when the job verifies its copies */
+static void
+verify_copy (CopyMoveJob *job,
+             GFile *src,
+             GFile *dest,
+             GFileCopyFlags flags)
+{
+    if (job->verifier == NULL) {
+        return;
+    }
+
+    marlin_file_verifier_push (job->verifier, src, dest, flags);
+    report_verify_failures (job);
+}
+
+/* Waits for the copies still being checked, reporting those that fail, and frees the verifier */
+static void
+finish_verifying_copies (CopyMoveJob *job)
+{
+    CommonJob *common = (CommonJob *)job;
+    gboolean done;
+#ifndef ENABLE_TASKVIEW
+    guint64 n_checked, n_pushed;
+#endif
+
+    do {
+        done = marlin_file_verifier_wait (job->verifier, VERIFY_PROGRESS_INTERVAL_USEC);
+
+#ifndef ENABLE_TASKVIEW
+        marlin_file_verifier_get_counts (job->verifier, &n_checked, &n_pushed);
+        marlin_progress_info_set_totals (common->progress, n_pushed, 0);
+        marlin_progress_info_set_counts (common->progress, n_checked, 0);
+        g_atomic_int_set (&common->progress_phase, PROGRESS_PHASE_VERIFYING);
+#endif
+
+        /* Copies made again are checked again */
+        if (report_verify_failures (job) > 0) {
+            done = FALSE;
+        }
+    } while (!done && !job_aborted (common));
+
+    marlin_file_verifier_free (job->verifier);
+    job->verifier = NULL;
+}
+
 /* Debuting files is non-NULL only for toplevel items */
 static void
 copy_move_file (CopyMoveJob *copy_job,
@@ -4237,6 +5768,9 @@ copy_move_file (CopyMoveJob *copy_job,
     gboolean res;
     int unique_name_nr;
     gboolean handled_invalid_filename;
+    MarlinCopyJournalState journal_state;
+    GFileInfo *info;
+    NameIndex *name_index;
 
     job = (CommonJob *)copy_job;
 
@@ -4246,6 +5780,7 @@ copy_move_file (CopyMoveJob *copy_job,
     }
 
     unique_name_nr = 1;
+    name_index = NULL;
 
     /* another file in the same directory might have handled the invalid
      * filename condition for us
@@ -4254,7 +5789,9 @@ copy_move_file (CopyMoveJob *copy_job,
 
     //amtest
     if (unique_names) {
-        dest = get_unique_target_file (src, dest_dir, same_fs, *dest_fs_type, unique_name_nr++);
+        name_index = get_name_index (copy_job, dest_dir);
+        dest = get_unique_target_file (src, dest_dir, same_fs, *dest_fs_type, name_index,
+                                       job->cancellable, &unique_name_nr);
     } else {
         dest = get_target_file (src, dest_dir, *dest_fs_type, same_fs);
     }
@@ -4327,6 +5864,31 @@ copy_move_file (CopyMoveJob *copy_job,
         goto out;
     }
 
+    /* Pick up where an interrupted job left off */
+    journal_state = MARLIN_COPY_JOURNAL_NONE;
+    if (copy_job->journal != NULL) {
+        journal_state = marlin_copy_journal_lookup (copy_job->journal, src, dest);
+
+        if (journal_state == MARLIN_COPY_JOURNAL_FILE_DONE) {
+            info = g_file_query_info (src, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                      NULL, NULL);
+            if (info != NULL) {
+                transfer_info->num_bytes += g_file_info_get_size (info);
+                g_object_unref (info);
+            }
+
+            transfer_info->num_files++;
+            report_copy_progress (copy_job, source_info, transfer_info);
+            g_object_unref (dest);
+            return;
+        }
+
+        /* A folder or partial copy the job left behind is its own to merge into or write over */
+        if (journal_state != MARLIN_COPY_JOURNAL_NONE) {
+            overwrite = TRUE;
+        }
+    }
 
 retry:
 
@@ -4340,11 +5902,31 @@ retry:
     }
 
     pdata.job = copy_job;
+    pdata.src = src;
+    pdata.dest = dest;
     pdata.last_size = 0;
+    pdata.journal_offsets = (flags & G_FILE_COPY_OVERWRITE) == 0;
     pdata.source_info = source_info;
     pdata.transfer_info = transfer_info;
 
-    if (copy_job->is_move) {
+    res = FALSE;
+    if (journal_state == MARLIN_COPY_JOURNAL_FILE_PARTIAL) {
+        /* Only tried once, a retry copies the file from the start. The partial copy is finished in
+         * place, so its offsets are recorded */
+        journal_state = MARLIN_COPY_JOURNAL_NONE;
+        pdata.journal_offsets = TRUE;
+        res = marlin_copy_journal_resume_file (copy_job->journal, src, dest, flags,
+                                               job->cancellable,
+                                               copy_file_progress_callback,
+                                               &pdata,
+                                               NULL) &&
+              (!copy_job->is_move || g_file_delete (src, job->cancellable, NULL));
+        pdata.journal_offsets = (flags & G_FILE_COPY_OVERWRITE) == 0;
+    }
+
+    if (res) {
+        /* The partial copy was finished */
+    } else if (copy_job->is_move) {
         res = g_file_move (src, dest,
                            flags,
                            job->cancellable,
@@ -4352,12 +5934,14 @@ retry:
                            &pdata,
                            &error);
     } else {
-        res = g_file_copy (src, dest,
-                           flags,
-                           job->cancellable,
-                           copy_file_progress_callback,
-                           &pdata,
-                           &error);
+        /* Local files are copied in the kernel (reflink, copy_file_range or sendfile) where possible */
+        res = marlin_file_copy (src, dest,
+                                flags,
+                                job->cancellable,
+                                copy_file_progress_callback,
+                                &pdata,
+                                NULL,
+                                &error);
     }
 
     /* NOTE Result is false if file being moved is a folder and the target is on a Samba share even if
@@ -4368,6 +5952,10 @@ retry:
         transfer_info->num_files ++;
         report_copy_progress (copy_job, source_info, transfer_info);
 
+        if (copy_job->journal != NULL) {
+            marlin_copy_journal_file_done (copy_job->journal, src, dest);
+        }
+
         if (debuting_files) {
             /*if (position) {
                 //marlin_file_changes_queue_schedule_position_set (dest, *position, job->screen_num);
@@ -4398,6 +5986,10 @@ retry:
         marlin_undo_manager_data_add_origin_target_pair (job->undo_redo_data, src, dest);
         // End UNDO-REDO
 
+        if (!copy_job->is_move) {
+            verify_copy (copy_job, src, dest, flags);
+        }
+
         g_object_unref (dest);
         return;
     }
@@ -4410,7 +6002,8 @@ retry:
         *dest_fs_type = query_fs_type (dest_dir, job->cancellable);
 
         if (unique_names) {
-            new_dest = get_unique_target_file (src, dest_dir, same_fs, *dest_fs_type, unique_name_nr);
+            new_dest = get_unique_target_file (src, dest_dir, same_fs, *dest_fs_type, name_index,
+                                               job->cancellable, &unique_name_nr);
         } else {
             new_dest = get_target_file (src, dest_dir, *dest_fs_type, same_fs);
         }
@@ -4436,7 +6029,9 @@ retry:
 
         if (unique_names) {
             g_object_unref (dest);
-            dest = get_unique_target_file (src, dest_dir, same_fs, *dest_fs_type, unique_name_nr++);
+            unique_name_nr++;
+            dest = get_unique_target_file (src, dest_dir, same_fs, *dest_fs_type, name_index,
+                                           job->cancellable, &unique_name_nr);
             goto retry;
         }
 
@@ -4615,9 +6210,322 @@ retry:
             g_assert_not_reached ();
         }
     }
-out:
-    *skipped_file = TRUE; /* Or aborted, but same-same */
-    g_object_unref (dest);
+out:
+    *skipped_file = TRUE; /* Or aborted, but same-same */
+    g_object_unref (dest);
+}
+
+/* Parallel copying of small files.
+ *
+ * Copying many small files is bound by the latency of the per file system calls rather than by
+ * bandwidth, so these are copied by a pool of worker threads. On network mounts every file costs
+ * several round trips to the server, so the pool keeps a few of them in flight there as well; fewer
+ * than locally, as they all share the connection of the mount, and the scheduler runs only one job per
+ * filesystem at a time, which makes this a bound per mount. The job thread still walks the tree,
+ * creates the folders (so they always exist before their children are copied) and runs every dialog:
+ * a worker never overwrites, and any file it fails to copy (a conflict, an invalid file name, any other
+ * error) is handed back and copied again through copy_move_file () by the job thread. Progress, undo
+ * data and change notifications are also only handled on the job thread, as each copied file comes back.
+ * Since folders are finished before their files, copying their attributes is deferred to the end.
+ */
+#define COPY_POOL_SMALL_FILE_SIZE (1024 * 1024)
+#define COPY_POOL_DEFAULT_THREADS 8
+#define COPY_POOL_IN_FLIGHT_PER_THREAD 16
+#define COPY_POOL_NETWORK_STREAMS 4
+
+/* GVfs backends which talk to a server, where the latency of each file is worth hiding. Other
+ * non-native locations (cameras, archives, ...) may not cope with concurrent requests */
+static const char * const copy_pool_network_schemes[] = {
+    "sftp", "ssh", "ftp", "ftps", "dav", "davs", "smb", "afp", "nfs", NULL
+};
+
+static guint copy_pool_n_threads = COPY_POOL_DEFAULT_THREADS;
+
+struct _CopyPool {
+    GThreadPool *threads;
+    GAsyncQueue *results;
+    GCancellable *cancellable;
+    guint n_in_flight;
+    guint max_in_flight;
+    GQueue deferred_attributes;
+};
+
+typedef struct {
+    GFile *src;
+    GFile *dest_dir;
+    GFile *dest;
+    char *dest_fs_type;
+    gboolean same_fs;
+    gboolean readonly_source_fs;
+    goffset size;
+    GFileCopyFlags flags;
+    gboolean copied;
+    gboolean dest_written;
+} CopyPoolItem;
+
+typedef struct {
+    GFile *src;
+    GFile *dest;
+    GFileCopyFlags flags;
+} CopyPoolAttributes;
+
+/**
+ * marlin_file_operations_set_copy_threads:
+ * @n_threads: the number of threads copying small files, 0 for the default
+ *
+ * Copies from or to network mounts use at most COPY_POOL_NETWORK_STREAMS of them. Setting 1 copies
+ * every file on the job thread, as before.
+ */
+void
+marlin_file_operations_set_copy_threads (guint n_threads)
+{
+    copy_pool_n_threads = n_threads > 0 ? n_threads : COPY_POOL_DEFAULT_THREADS;
+}
+
+static void
+copy_pool_item_free (CopyPoolItem *item)
+{
+    g_object_unref (item->src);
+    g_object_unref (item->dest_dir);
+    if (item->dest != NULL) {
+        g_object_unref (item->dest);
+    }
+    g_free (item->dest_fs_type);
+    g_slice_free (CopyPoolItem, item);
+}
+
+static void
+copy_pool_worker (gpointer data,
+                  gpointer user_data)
+{
+    CopyPoolItem *item = data;
+    CopyPool *pool = user_data;
+    GFileCopyFlags flags;
+    GError *error = NULL;
+
+    if (!g_cancellable_is_cancelled (pool->cancellable)) {
+        flags = G_FILE_COPY_NOFOLLOW_SYMLINKS;
+        if (item->readonly_source_fs) {
+            flags |= G_FILE_COPY_TARGET_DEFAULT_PERMS;
+        }
+
+        item->flags = flags;
+        item->dest = get_target_file (item->src, item->dest_dir, item->dest_fs_type, item->same_fs);
+        item->copied = marlin_file_copy (item->src, item->dest, flags, pool->cancellable,
+                                         NULL, NULL, NULL, &error);
+
+        if (!item->copied) {
+            /* Without G_FILE_COPY_OVERWRITE an existing file is never touched, so anything but
+             * these errors may have left a partial copy behind */
+            item->dest_written = !IS_IO_ERROR (error, EXISTS) &&
+                                 !IS_IO_ERROR (error, INVALID_FILENAME) &&
+                                 !IS_IO_ERROR (error, NOT_FOUND);
+            g_error_free (error);
+        }
+    }
+
+    g_async_queue_push (pool->results, item);
+}
+
+static gboolean
+copy_pool_is_network_location (GFile *file)
+{
+    char *scheme;
+    gboolean res;
+    int i;
+
+    scheme = g_file_get_uri_scheme (file);
+    res = FALSE;
+    for (i = 0; scheme != NULL && copy_pool_network_schemes[i] != NULL && !res; i++) {
+        res = strcmp (scheme, copy_pool_network_schemes[i]) == 0;
+    }
+    g_free (scheme);
+
+    return res;
+}
+
+/* Returns how many files can be copied at once between @src and @dest, 1 when the pool is no use */
+static guint
+copy_pool_get_n_streams (GFile *src,
+                         GFile *dest)
+{
+    gboolean network;
+
+    if (g_file_is_native (src)) {
+        network = FALSE;
+    } else if (copy_pool_is_network_location (src)) {
+        network = TRUE;
+    } else {
+        return 1;
+    }
+
+    if (g_file_is_native (dest)) {
+        /* Nothing to add */
+    } else if (copy_pool_is_network_location (dest)) {
+        network = TRUE;
+    } else {
+        return 1;
+    }
+
+    return network ? MIN (copy_pool_n_threads, COPY_POOL_NETWORK_STREAMS) : copy_pool_n_threads;
+}
+
+static CopyPool *
+copy_pool_new (GCancellable *cancellable,
+               guint n_streams)
+{
+    CopyPool *pool;
+
+    pool = g_slice_new0 (CopyPool);
+    pool->results = g_async_queue_new ();
+    pool->cancellable = g_object_ref (cancellable);
+    pool->max_in_flight = n_streams * COPY_POOL_IN_FLIGHT_PER_THREAD;
+    pool->threads = g_thread_pool_new (copy_pool_worker, pool, n_streams, FALSE, NULL);
+    g_queue_init (&pool->deferred_attributes);
+
+    return pool;
+}
+
+static gboolean
+copy_pool_accepts (CopyMoveJob *job,
+                   GFileInfo *info)
+{
+    /* Resumed jobs go through copy_move_file (), which knows what was done before */
+    return job->copy_pool != NULL &&
+           (job->journal == NULL || !marlin_copy_journal_is_resuming (job->journal)) &&
+           g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR &&
+           g_file_info_get_size (info) < COPY_POOL_SMALL_FILE_SIZE;
+}
+
+/* Runs on the job thread for every item coming back from a worker */
+static void
+copy_pool_complete_item (CopyMoveJob *job,
+                         CopyPoolItem *item,
+                         SourceInfo *source_info,
+                         TransferInfo *transfer_info)
+{
+    CommonJob *common = (CommonJob *)job;
+    gboolean skipped_file;
+    char *dest_fs_type;
+
+    job->copy_pool->n_in_flight--;
+
+    if (item->copied) {
+        transfer_info->num_files++;
+        transfer_info->num_bytes += item->size;
+        report_copy_progress (job, source_info, transfer_info);
+
+        if (job->journal != NULL) {
+            marlin_copy_journal_file_done (job->journal, item->src, item->dest);
+        }
+
+        marlin_file_changes_queue_file_added (item->dest);
+        // Start UNDO-REDO
+        marlin_undo_manager_data_add_origin_target_pair (common->undo_redo_data, item->src, item->dest);
+        // End UNDO-REDO
+
+        verify_copy (job, item->src, item->dest, item->flags);
+    } else if (!job_aborted (common)) {
+        /* Let the serial path deal with it, including its dialogs */
+        skipped_file = FALSE;
+        dest_fs_type = g_strdup (item->dest_fs_type);
+        copy_move_file (job, item->src, item->dest_dir, item->same_fs, FALSE, &dest_fs_type,
+                        source_info, transfer_info, NULL, NULL, item->dest_written, &skipped_file,
+                        item->readonly_source_fs);
+        g_free (dest_fs_type);
+    }
+
+    copy_pool_item_free (item);
+}
+
+static void
+copy_pool_push (CopyMoveJob *job,
+                GFile *src,
+                GFile *dest_dir,
+                gboolean same_fs,
+                const char *dest_fs_type,
+                goffset size,
+                gboolean readonly_source_fs,
+                SourceInfo *source_info,
+                TransferInfo *transfer_info)
+{
+    CopyPool *pool = job->copy_pool;
+    CopyPoolItem *item;
+
+    if (should_skip_file ((CommonJob *)job, src)) {
+        return;
+    }
+
+    /* Bound the work queued ahead of the workers */
+    while (pool->n_in_flight >= pool->max_in_flight) {
+        copy_pool_complete_item (job, g_async_queue_pop (pool->results), source_info, transfer_info);
+    }
+
+    item = g_slice_new0 (CopyPoolItem);
+    item->src = g_object_ref (src);
+    item->dest_dir = g_object_ref (dest_dir);
+    item->dest_fs_type = g_strdup (dest_fs_type);
+    item->same_fs = same_fs;
+    item->readonly_source_fs = readonly_source_fs;
+    item->size = size;
+
+    pool->n_in_flight++;
+    g_thread_pool_push (pool->threads, item, NULL);
+
+    while ((item = g_async_queue_try_pop (pool->results)) != NULL) {
+        copy_pool_complete_item (job, item, source_info, transfer_info);
+    }
+}
+
+static void
+copy_pool_defer_attributes (CopyPool *pool,
+                            GFile *src,
+                            GFile *dest,
+                            GFileCopyFlags flags)
+{
+    CopyPoolAttributes *attributes;
+
+    attributes = g_slice_new (CopyPoolAttributes);
+    attributes->src = g_object_ref (src);
+    attributes->dest = g_object_ref (dest);
+    attributes->flags = flags;
+
+    /* Folders are finished after their subfolders, so this keeps the innermost first */
+    g_queue_push_tail (&pool->deferred_attributes, attributes);
+}
+
+/* Waits for every file in flight, then copies the attributes of the folders and frees the pool */
+static void
+copy_pool_finish (CopyMoveJob *job,
+                  SourceInfo *source_info,
+                  TransferInfo *transfer_info)
+{
+    CopyPool *pool = job->copy_pool;
+    CopyPoolAttributes *attributes;
+
+    while (pool->n_in_flight > 0) {
+        copy_pool_complete_item (job, g_async_queue_pop (pool->results), source_info, transfer_info);
+    }
+
+    g_thread_pool_free (pool->threads, FALSE, TRUE);
+
+    while ((attributes = g_queue_pop_head (&pool->deferred_attributes)) != NULL) {
+        if (!job_aborted ((CommonJob *)job)) {
+            /* Ignore errors here. Failure to copy metadata is not a hard error */
+            g_file_copy_attributes (attributes->src, attributes->dest,
+                                    attributes->flags,
+                                    job->common.cancellable, NULL);
+        }
+
+        g_object_unref (attributes->src);
+        g_object_unref (attributes->dest);
+        g_slice_free (CopyPoolAttributes, attributes);
+    }
+
+    g_async_queue_unref (pool->results);
+    g_object_unref (pool->cancellable);
+    g_slice_free (CopyPool, pool);
+    job->copy_pool = NULL;
 }
 
 static void
@@ -4639,6 +6547,7 @@ copy_files (CopyMoveJob *job,
     char *dest_fs_type;
     GFileInfo *inf;
     gboolean readonly_source_fs;
+    guint n_streams;
 
     dest_fs_type = NULL;
     readonly_source_fs = FALSE;
@@ -4658,6 +6567,23 @@ copy_files (CopyMoveJob *job,
         g_object_unref (source_dir);
     }
 
+    /* Only folders are walked, so only copies of folders use the pool */
+    if (copy_pool_n_threads > 1 && !job->is_move) {
+        dest = job->destination != NULL ? g_object_ref (job->destination) : g_file_get_parent (job->files->data);
+        if (dest != NULL) {
+            n_streams = copy_pool_get_n_streams (job->files->data, dest);
+            if (n_streams > 1) {
+                job->copy_pool = copy_pool_new (common->cancellable, n_streams);
+            }
+        }
+        g_clear_object (&dest);
+    }
+
+    /* Duplicates are made from files right next to them, there is little point in checking them */
+    if (job->destination != NULL && should_verify_copies ()) {
+        job->verifier = marlin_file_verifier_new (common->cancellable);
+    }
+
     unique_names = (job->destination == NULL);
     i = 0;
     for (l = job->files;
@@ -4697,6 +6623,14 @@ copy_files (CopyMoveJob *job,
         i++;
     }
 
+    if (job->copy_pool != NULL) {
+        copy_pool_finish (job, source_info, transfer_info);
+    }
+
+    if (job->verifier != NULL) {
+        finish_verifying_copies (job);
+    }
+
     g_free (dest_fs_type);
 }
 
@@ -4719,6 +6653,9 @@ copy_job_done (gpointer user_data)
     }*/
     g_hash_table_unref (job->debuting_files);
     g_free (job->icon_positions);
+    if (job->name_indexes) {
+        g_hash_table_destroy (job->name_indexes);
+    }
 
     finalize_common ((CommonJob *)job);
 
@@ -4737,12 +6674,14 @@ copy_job (GIOSchedulerJob *io_job,
     TransferInfo transfer_info;
     char *dest_fs_id;
     GFile *dest;
+    ConflictScan *conflict_scan;
 
     job = user_data;
     common = &job->common;
     common->io_job = io_job;
 
     dest_fs_id = NULL;
+    memset (&source_info, 0, sizeof (source_info));
 
 #ifdef ENABLE_TASKVIEW
     g_object_set (job->common.tv_io, "state", TASKVIEW_RUNNING, NULL);
@@ -4750,10 +6689,15 @@ copy_job (GIOSchedulerJob *io_job,
     marlin_progress_info_start (job->common.progress);
 #endif
 
+    conflict_scan = conflict_scan_start (job, job->files);
+
     scan_sources (job->files,
                   &source_info,
                   common,
-                  OP_KIND_COPY);
+                  OP_KIND_COPY,
+                  TRUE);
+
+    conflict_scan_finish (conflict_scan, job, &source_info);
     if (job_aborted (common)) {
         goto aborted;
     }
@@ -4778,12 +6722,24 @@ copy_job (GIOSchedulerJob *io_job,
 
     g_timer_start (job->common.time);
 
+    /* Duplicates are not journaled, they are quick to do again */
+    if (job->journal == NULL && job->destination != NULL && should_journal_transfers ()) {
+        job->journal = marlin_copy_journal_new (FALSE, job->files, job->destination);
+    }
+
     memset (&transfer_info, 0, sizeof (transfer_info));
     copy_files (job,
                 dest_fs_id,
                 &source_info, &transfer_info);
 
 aborted:
+    source_info_finish_scan (&source_info);
+
+    /* Finished or cancelled, there is nothing to resume */
+    if (job->journal != NULL) {
+        marlin_copy_journal_discard (job->journal);
+        job->journal = NULL;
+    }
 
     g_free (dest_fs_id);
 
@@ -4795,17 +6751,19 @@ aborted:
     return FALSE;
 }
 
-void
-marlin_file_operations_copy (GList *files,
-                             GArray *relative_item_points,
-                             GFile *target_dir,
-                             GtkWindow *parent_window,
-                             MarlinCopyCallback  done_callback,
-                             gpointer done_callback_data)
+static void
+start_copy_job (GList *files,
+                GArray *relative_item_points,
+                GFile *target_dir,
+                GtkWindow *parent_window,
+                MarlinCopyJournal *journal,
+                MarlinCopyCallback  done_callback,
+                gpointer done_callback_data)
 {
     CopyMoveJob *job;
     job = op_job_new (JOB_COPY, CopyMoveJob, parent_window);
     //job->desktop_location = marlin_get_desktop_location ();
+    job->journal = journal;
     job->done_callback = done_callback;
     job->done_callback_data = done_callback_data;
     job->files = eel_g_object_list_copy (files);
@@ -4831,11 +6789,19 @@ marlin_file_operations_copy (GList *files,
     }
     // End UNDO-REDO
 
-    g_io_scheduler_push_job (copy_job,
-                             job,
-                             NULL, /* destroy notify */
-                             0,
-                             job->common.cancellable);
+    push_scheduled_job (copy_job, (CommonJob *)job, job->files, job->destination, FALSE);
+}
+
+void
+marlin_file_operations_copy (GList *files,
+                             GArray *relative_item_points,
+                             GFile *target_dir,
+                             GtkWindow *parent_window,
+                             MarlinCopyCallback  done_callback,
+                             gpointer done_callback_data)
+{
+    start_copy_job (files, relative_item_points, target_dir, parent_window, NULL,
+                    done_callback, done_callback_data);
 }
 
 static void
@@ -4970,6 +6936,14 @@ move_file_prepare (CopyMoveJob *move_job,
         goto out;
     }
 
+    /* Whatever an interrupted job started on is finished by copying */
+    if (move_job->journal != NULL &&
+        marlin_copy_journal_lookup (move_job->journal, src, dest) != MARLIN_COPY_JOURNAL_NONE) {
+        fallback = move_copy_file_callback_new (src, FALSE, position);
+        *fallback_files = g_list_prepend (*fallback_files, fallback);
+        goto out;
+    }
+
 retry:
 
     flags = G_FILE_COPY_NOFOLLOW_SYMLINKS | G_FILE_COPY_NO_FALLBACK_FOR_MOVE;
@@ -5134,6 +7108,45 @@ out:
     g_object_unref (dest);
 }
 
+typedef struct {
+    CopyMoveJob *job;
+    int total;
+    int left;
+    gint64 last_report_time;
+    GList *sources;
+    GList *destinations;
+} MoveBatchData;
+
+static void
+move_batch_callback (GFile *src,
+                     GFile *dest,
+                     gpointer user_data)
+{
+    MoveBatchData *batch = user_data;
+    CopyMoveJob *job;
+    gint64 now;
+
+    job = batch->job;
+
+    g_hash_table_replace (job->debuting_files, g_object_ref (dest), GINT_TO_POINTER (TRUE));
+
+    /* Queued as one change once the batch is done */
+    batch->sources = g_list_prepend (batch->sources, g_object_ref (src));
+    batch->destinations = g_list_prepend (batch->destinations, g_object_ref (dest));
+
+    // Start UNDO-REDO
+    marlin_undo_manager_data_add_origin_target_pair (job->common.undo_redo_data, src, dest);
+    // End UNDO-REDO
+
+    batch->left--;
+
+    now = g_get_monotonic_time ();
+    if (now - batch->last_report_time >= 100 * G_TIME_SPAN_MILLISECOND) {
+        batch->last_report_time = now;
+        report_move_progress (job, batch->total, batch->left);
+    }
+}
+
 static void
 move_files_prepare (CopyMoveJob *job,
                     const char *dest_fs_id,
@@ -5141,7 +7154,8 @@ move_files_prepare (CopyMoveJob *job,
                     GList **fallbacks)
 {
     CommonJob *common;
-    GList *l;
+    MoveBatchData batch;
+    GList *l, *leftover, *next_leftover;
     GFile *src;
     gboolean same_fs;
     int i;
@@ -5154,11 +7168,40 @@ move_files_prepare (CopyMoveJob *job,
 
     report_move_progress (job, total, left);
 
+    /* Local files are renamed in one batch, unless an interrupted job has to be finished. Those it
+     * leaves, remote ones, ones on other file systems or ones with a conflict, go through
+     * move_file_prepare () one by one below */
+    memset (&batch, 0, sizeof (batch));
+    batch.job = job;
+    batch.total = total;
+    batch.left = left;
+    if (job->journal == NULL) {
+        leftover = marlin_file_move_local (job->files, job->destination, common->cancellable,
+                                           move_batch_callback, &batch);
+    } else {
+        leftover = g_list_copy (job->files);
+    }
+
+    batch.sources = g_list_reverse (batch.sources);
+    batch.destinations = g_list_reverse (batch.destinations);
+    marlin_file_changes_queue_files_moved (batch.sources, batch.destinations);
+    g_list_free_full (batch.sources, g_object_unref);
+    g_list_free_full (batch.destinations, g_object_unref);
+
+    left = batch.left;
+    report_move_progress (job, total, left);
+
+    /* The leftover files are in the order of job->files, which the icon positions follow */
+    next_leftover = leftover;
     i = 0;
     for (l = job->files;
-         l != NULL && !job_aborted (common);
-         l = l->next) {
+         l != NULL && next_leftover != NULL && !job_aborted (common);
+         l = l->next, i++) {
         src = l->data;
+        if (src != next_leftover->data) {
+            continue;
+        }
+        next_leftover = next_leftover->next;
 
         if (i < job->n_icon_positions) {
             point = &job->icon_positions[i];
@@ -5179,9 +7222,10 @@ move_files_prepare (CopyMoveJob *job,
                            fallbacks,
                            left);
         report_move_progress (job, total, --left);
-        i++;
     }
 
+    g_list_free (leftover);
+
     *fallbacks = g_list_reverse (*fallbacks);
 
 
@@ -5271,6 +7315,7 @@ move_job (GIOSchedulerJob *io_job,
     char *dest_fs_id;
     char *dest_fs_type;
     GList *fallback_files;
+    ConflictScan *conflict_scan;
 
     job = user_data;
     common = &job->common;
@@ -5278,6 +7323,7 @@ move_job (GIOSchedulerJob *io_job,
 
     dest_fs_id = NULL;
     dest_fs_type = NULL;
+    memset (&source_info, 0, sizeof (source_info));
 
     fallbacks = NULL;
 
@@ -5287,10 +7333,15 @@ move_job (GIOSchedulerJob *io_job,
     marlin_progress_info_start (job->common.progress);
 #endif
 
+    conflict_scan = conflict_scan_start (job, job->files);
+
     verify_destination (&job->common,
                         job->destination,
                         &dest_fs_id,
                         -1);
+
+    /* Renames within a file system meet conflicts too, so this is settled before them */
+    conflict_scan_finish (conflict_scan, job, NULL);
     if (job_aborted (common)) {
         goto aborted;
     }
@@ -5308,7 +7359,8 @@ move_job (GIOSchedulerJob *io_job,
     scan_sources (fallback_files,
                   &source_info,
                   common,
-                  OP_KIND_MOVE);
+                  OP_KIND_MOVE,
+                  TRUE);
 
     g_list_free (fallback_files);
 
@@ -5324,6 +7376,11 @@ move_job (GIOSchedulerJob *io_job,
         goto aborted;
     }
 
+    /* Files renamed within a file system are moved at once, only copies are journaled */
+    if (job->journal == NULL && fallbacks != NULL && should_journal_transfers ()) {
+        job->journal = marlin_copy_journal_new (TRUE, job->files, job->destination);
+    }
+
     memset (&transfer_info, 0, sizeof (transfer_info));
     move_files (job,
                 fallbacks,
@@ -5331,6 +7388,13 @@ move_job (GIOSchedulerJob *io_job,
                 &source_info, &transfer_info);
 
 aborted:
+    source_info_finish_scan (&source_info);
+
+    /* Finished or cancelled, there is nothing to resume */
+    if (job->journal != NULL) {
+        marlin_copy_journal_discard (job->journal);
+        job->journal = NULL;
+    }
     g_list_free_full (fallbacks, g_free);
 
     g_free (dest_fs_id);
@@ -5344,17 +7408,19 @@ aborted:
     return FALSE;
 }
 
-void
-marlin_file_operations_move (GList *files,
-                             GArray *relative_item_points,
-                             GFile *target_dir,
-                             GtkWindow *parent_window,
-                             MarlinCopyCallback  done_callback,
-                             gpointer done_callback_data)
+static void
+start_move_job (GList *files,
+                GArray *relative_item_points,
+                GFile *target_dir,
+                GtkWindow *parent_window,
+                MarlinCopyJournal *journal,
+                MarlinCopyCallback  done_callback,
+                gpointer done_callback_data)
 {
     CopyMoveJob *job;
     job = op_job_new (JOB_MOVE, CopyMoveJob, parent_window);
     job->is_move = TRUE;
+    job->journal = journal;
     job->done_callback = done_callback;
     job->done_callback_data = done_callback_data;
     job->files = eel_g_object_list_copy (files);
@@ -5383,11 +7449,126 @@ marlin_file_operations_move (GList *files,
     }
     // End UNDO-REDO
 
-    g_io_scheduler_push_job (move_job,
-                             job,
-                             NULL, /* destroy notify */
-                             0,
-                             job->common.cancellable);
+    push_scheduled_job (move_job, (CommonJob *)job, job->files, job->destination, TRUE);
+}
+
+void
+marlin_file_operations_move (GList *files,
+                             GArray *relative_item_points,
+                             GFile *target_dir,
+                             GtkWindow *parent_window,
+                             MarlinCopyCallback  done_callback,
+                             gpointer done_callback_data)
+{
+    start_move_job (files, relative_item_points, target_dir, parent_window, NULL,
+                    done_callback, done_callback_data);
+}
+
+/* Resuming copies and moves interrupted when the application went away, through the journal they left */
+
+static void
+resume_dialog_response (GtkDialog *dialog,
+                        gint response_id,
+                        MarlinCopyJournal *journal)
+{
+    GtkWindow *parent_window;
+    GList *sources, *l;
+    gboolean is_move;
+
+    parent_window = gtk_window_get_transient_for (GTK_WINDOW (dialog));
+    gtk_widget_destroy (GTK_WIDGET (dialog));
+
+    if (response_id != GTK_RESPONSE_ACCEPT) {
+        marlin_copy_journal_discard (journal);
+        return;
+    }
+
+    /* Sources that were moved completely are gone */
+    is_move = marlin_copy_journal_get_is_move (journal);
+    sources = NULL;
+    for (l = marlin_copy_journal_get_sources (journal); l != NULL; l = l->next) {
+        if (!is_move || g_file_query_exists (l->data, NULL)) {
+            sources = g_list_prepend (sources, l->data);
+        }
+    }
+    sources = g_list_reverse (sources);
+
+    if (sources == NULL) {
+        marlin_copy_journal_discard (journal);
+    } else if (is_move) {
+        start_move_job (sources, NULL, marlin_copy_journal_get_destination (journal),
+                        parent_window, journal, NULL, NULL);
+    } else {
+        start_copy_job (sources, NULL, marlin_copy_journal_get_destination (journal),
+                        parent_window, journal, NULL, NULL);
+    }
+
+    /* The job holds its own references */
+    g_list_free (sources);
+}
+
+static void
+offer_resume (GtkWindow *parent_window,
+              MarlinCopyJournal *journal)
+{
+    GtkWidget *dialog;
+    GFile *destination;
+    char *primary, *secondary;
+    int n_sources;
+
+    destination = marlin_copy_journal_get_destination (journal);
+    n_sources = g_list_length (marlin_copy_journal_get_sources (journal));
+
+    if (marlin_copy_journal_get_is_move (journal)) {
+        primary = f (_("Resume moving files to \"%B\"?"), destination);
+        secondary = f (ngettext ("Moving %'d item was interrupted when Files closed. "
+                                 "Items already moved will be skipped.",
+                                 "Moving %'d items was interrupted when Files closed. "
+                                 "Items already moved will be skipped.",
+                                 n_sources), n_sources);
+    } else {
+        primary = f (_("Resume copying files to \"%B\"?"), destination);
+        secondary = f (ngettext ("Copying %'d item was interrupted when Files closed. "
+                                 "Items already copied will be skipped.",
+                                 "Copying %'d items was interrupted when Files closed. "
+                                 "Items already copied will be skipped.",
+                                 n_sources), n_sources);
+    }
+
+    dialog = gtk_message_dialog_new (parent_window, GTK_DIALOG_DESTROY_WITH_PARENT,
+                                     GTK_MESSAGE_QUESTION, GTK_BUTTONS_NONE,
+                                     "%s", primary);
+    gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog), "%s", secondary);
+    gtk_dialog_add_buttons (GTK_DIALOG (dialog),
+                            _("_Discard"), GTK_RESPONSE_REJECT,
+                            _("_Resume"), GTK_RESPONSE_ACCEPT, NULL);
+    gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_ACCEPT);
+    gtk_window_set_title (GTK_WINDOW (dialog), ""); /* as per HIG */
+
+    g_signal_connect (dialog, "response", G_CALLBACK (resume_dialog_response), journal);
+    gtk_widget_show (dialog);
+
+    g_free (primary);
+    g_free (secondary);
+}
+
+/**
+ * marlin_file_operations_resume_interrupted:
+ * @parent_window: the window to ask from
+ *
+ * Offers to resume each copy or move that did not get to finish the last time the application ran.
+ */
+void
+marlin_file_operations_resume_interrupted (GtkWindow *parent_window)
+{
+    GList *journals, *l;
+
+    journals = marlin_copy_journal_list_interrupted ();
+    for (l = journals; l != NULL; l = l->next) {
+        offer_resume (parent_window, l->data);
+    }
+
+    g_list_free (journals);
 }
 
 static void
@@ -5759,14 +7940,9 @@ marlin_file_operations_duplicate (GList *files,
     }
     // End UNDO-REDO
 
-    g_io_scheduler_push_job (copy_job,
-                             job,
-                             NULL, /* destroy notify */
-                             0,
-                             job->common.cancellable);
+    push_scheduled_job (copy_job, (CommonJob *)job, job->files, job->destination, FALSE);
 }
 
-#if 0
 static gboolean
 set_permissions_job_done (gpointer user_data)
 {
@@ -5833,16 +8009,22 @@ set_permissions_file (SetPermissionsJob *job,
     if (!job_aborted (common) &&
         g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_MODE)) {
         current = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE);
+        value = (current & ~mask) | value;
 
-        // Start UNDO-REDO
-        marlin_undo_manager_data_add_file_permissions(common->undo_redo_data, file, current);
-        // End UNDO-REDO
+        if (value != current &&
+            g_file_set_attribute_uint32 (file, G_FILE_ATTRIBUTE_UNIX_MODE,
+                                         value, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                         common->cancellable, NULL) &&
+            job->undo != NULL) {
+            char *relative_path;
 
-        current = (current & ~mask) | value;
-
-        g_file_set_attribute_uint32 (file, G_FILE_ATTRIBUTE_UNIX_MODE,
-                                     current, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                     common->cancellable, NULL);
+            // Start UNDO-REDO
+            relative_path = g_file_get_relative_path (job->file, file);
+            marlin_permissions_undo_add (job->undo, relative_path != NULL ? relative_path : "", current,
+                                         g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY);
+            g_free (relative_path);
+            // End UNDO-REDO
+        }
     }
 
     if (!job_aborted (common) &&
@@ -5872,6 +8054,23 @@ set_permissions_file (SetPermissionsJob *job,
     }
 }
 
+static void
+set_permissions_tree_progress (guint64 n_changed,
+                               gpointer user_data)
+{
+    CommonJob *common = user_data;
+
+#ifdef ENABLE_TASKVIEW
+    taskview_generic_set_progress (TASKVIEW_GENERIC (common->tv_io), -1);
+#else
+    marlin_progress_info_take_details (common->progress,
+                                       f (ngettext ("%'d item changed",
+                                                    "%'d items changed",
+                                                    (int) n_changed),
+                                          (int) n_changed));
+    marlin_progress_info_pulse_progress (common->progress);
+#endif
+}
 
 static gboolean
 set_permissions_job (GIOSchedulerJob *io_job,
@@ -5880,6 +8079,8 @@ set_permissions_job (GIOSchedulerJob *io_job,
 {
     SetPermissionsJob *job = user_data;
     CommonJob *common;
+    GError *error;
+    guint64 n_changed;
 
     common = (CommonJob *)job;
     common->io_job = io_job;
@@ -5888,9 +8089,26 @@ set_permissions_job (GIOSchedulerJob *io_job,
     g_object_set (job->common.tv_io, "state", TASKVIEW_RUNNING, "description", _("Setting permissions"), NULL);
 #else
     marlin_progress_info_start (job->common.progress);
-    marlin_progress_info_set_status (common->progress, _("Setting permissions"));
+    marlin_progress_info_set_status (common->progress,
+                                     job->restore != NULL ? _("Restoring permissions") : _("Setting permissions"));
 #endif
-    set_permissions_file (job, job->file, NULL);
+
+    /* Errors are ignored, as they always were for permission changes */
+    error = NULL;
+    if (job->restore != NULL) {
+        marlin_permissions_undo_restore (job->restore, job->file, common->cancellable, NULL);
+    } else if (!marlin_file_set_permissions_tree (job->file,
+                                                  job->file_permissions, job->file_mask,
+                                                  job->dir_permissions, job->dir_mask,
+                                                  job->undo, common->cancellable,
+                                                  set_permissions_tree_progress, job,
+                                                  &n_changed, &error) &&
+               IS_IO_ERROR (error, NOT_SUPPORTED)) {
+        /* Remote folders, or a single file */
+        set_permissions_file (job, job->file, NULL);
+    }
+
+    g_clear_error (&error);
 
     g_io_scheduler_job_send_to_mainloop_async (io_job,
                                                set_permissions_job_done,
@@ -5928,6 +8146,8 @@ marlin_file_set_permissions_recursive (const char *directory,
         g_object_ref (job->file);
         marlin_undo_manager_data_set_dest_dir (job->common.undo_redo_data, job->file);
         marlin_undo_manager_data_set_recursive_permissions(job->common.undo_redo_data, file_permissions, file_mask, dir_permissions, dir_mask);
+        job->undo = marlin_permissions_undo_new ();
+        marlin_undo_manager_data_take_original_permissions (job->common.undo_redo_data, job->undo);
     }
     // End UNDO-REDO
 
@@ -5938,6 +8158,30 @@ marlin_file_set_permissions_recursive (const char *directory,
                              NULL);
 }
 
+/* Puts back the modes in @original_permissions, as recorded by marlin_file_set_permissions_recursive ()
+ * for @directory. @original_permissions must stay around until @callback is called */
+void
+marlin_file_restore_permissions (GFile                 *directory,
+                                 MarlinPermissionsUndo *original_permissions,
+                                 MarlinOpCallback       callback,
+                                 gpointer               callback_data)
+{
+    SetPermissionsJob *job;
+
+    job = op_job_new (JOB_SET_PERMISSIONS, SetPermissionsJob, NULL);
+    job->file = g_object_ref (directory);
+    job->restore = original_permissions;
+    job->done_callback = callback;
+    job->done_callback_data = callback_data;
+
+    g_io_scheduler_push_job (set_permissions_job,
+                             job,
+                             NULL,
+                             0,
+                             NULL);
+}
+
+#if 0
 static GList *
 location_list_from_uri_list (const GList *uris)
 {
@@ -6524,6 +8768,159 @@ marlin_file_operations_new_file (GtkWidget *parent_view,
 }
 
 
+/* The local folders behind the trash dirs of @job, or NULL when any of them is not local. The trash:
+ * root stands for the trash in the home folder plus those on every mount */
+static GList *
+get_local_trash_dirs (EmptyTrashJob *job)
+{
+    GVolumeMonitor *monitor;
+    GList *found, *dirs, *mounts, *l, *m, *d;
+    GFile *dir, *parent, *trash;
+    char *path;
+
+    found = NULL;
+    for (l = job->trash_dirs; l != NULL; l = l->next) {
+        dir = l->data;
+        parent = g_file_get_parent (dir);
+        if (parent != NULL) {
+            g_object_unref (parent);
+        }
+
+        if (g_file_has_uri_scheme (dir, "trash") && parent == NULL) {
+            path = g_build_filename (g_get_user_data_dir (), "Trash", NULL);
+            trash = g_file_new_for_path (path);
+            g_free (path);
+
+            found = prepend_if_exists (found, g_file_get_child (trash, "files"));
+            found = prepend_if_exists (found, g_file_get_child (trash, "info"));
+            g_object_unref (trash);
+
+            monitor = g_volume_monitor_get ();
+            mounts = g_volume_monitor_get_mounts (monitor);
+            for (m = mounts; m != NULL; m = m->next) {
+                found = g_list_concat (get_trash_dirs_for_mount (m->data), found);
+            }
+            g_list_free_full (mounts, g_object_unref);
+            g_object_unref (monitor);
+        } else if (g_file_is_native (dir)) {
+            found = g_list_prepend (found, g_object_ref (dir));
+        } else {
+            g_list_free_full (found, g_object_unref);
+            return NULL;
+        }
+    }
+
+    /* A folder must not be deleted from twice at the same time */
+    dirs = NULL;
+    for (l = found; l != NULL; l = l->next) {
+        for (d = dirs; d != NULL && !g_file_equal (d->data, l->data); d = d->next) {
+        }
+
+        if (d == NULL) {
+            dirs = g_list_prepend (dirs, g_object_ref (l->data));
+        }
+    }
+    g_list_free_full (found, g_object_unref);
+
+    return dirs;
+}
+
+static void
+count_trash_progress_callback (guint64 n_counted,
+                               gpointer user_data)
+{
+    DeleteTreeProgressData *pdata = user_data;
+
+    pdata->source_info->num_files = n_counted;
+    report_count_progress (pdata->job, pdata->source_info);
+}
+
+/* Empties the local trash dirs of @job through marlin_file_delete_trees (), all of them at the same
+ * time. A first pass only counts their contents, so that the deletion can show how far it got.
+ * Whatever cannot be deleted this way is left to delete_trash_file () */
+static void
+empty_trash_fast (EmptyTrashJob *job)
+{
+    CommonJob *common;
+    DeleteTreeProgressData pdata;
+    SourceInfo source_info;
+    TransferInfo transfer_info;
+    GList *dirs, *files_dirs, *info_dirs, *l;
+    GError *error;
+    guint64 n_deleted;
+    char *name;
+    gboolean emptied;
+
+    common = (CommonJob *)job;
+
+    dirs = get_local_trash_dirs (job);
+    if (dirs == NULL) {
+        return;
+    }
+
+    memset (&source_info, 0, sizeof (source_info));
+    memset (&transfer_info, 0, sizeof (transfer_info));
+    source_info.op = OP_KIND_EMPTY_TRASH;
+    transfer_info.op = OP_KIND_EMPTY_TRASH;
+
+    pdata.job = common;
+    pdata.source_info = &source_info;
+    pdata.transfer_info = &transfer_info;
+    pdata.num_files_before = 0;
+
+    /* The count only gives the total, the deletion does not depend on it */
+    report_count_progress (common, &source_info);
+    marlin_file_delete_trees (dirs, MARLIN_FILE_DELETE_KEEP_ROOTS | MARLIN_FILE_DELETE_DRY_RUN,
+                              common->cancellable, count_trash_progress_callback, &pdata,
+                              &n_deleted, NULL);
+    source_info.num_files = n_deleted;
+
+    /* The trash lists what is in the files dirs. Their info files go once all of them are gone, so
+     * that anything left behind still knows where it came from */
+    files_dirs = NULL;
+    info_dirs = NULL;
+    for (l = dirs; l != NULL; l = l->next) {
+        name = g_file_get_basename (l->data);
+        if (g_strcmp0 (name, "info") == 0) {
+            info_dirs = g_list_prepend (info_dirs, l->data);
+        } else {
+            files_dirs = g_list_prepend (files_dirs, l->data);
+        }
+        g_free (name);
+    }
+
+    error = NULL;
+    emptied = FALSE;
+    if (!job_aborted (common)) {
+        report_delete_progress (common, &source_info, &transfer_info);
+        emptied = marlin_file_delete_trees (files_dirs, MARLIN_FILE_DELETE_KEEP_ROOTS,
+                                            common->cancellable, delete_tree_progress_callback, &pdata,
+                                            &n_deleted, &error);
+        transfer_info.num_files = n_deleted;
+    }
+
+    if (emptied) {
+        pdata.num_files_before = transfer_info.num_files;
+        emptied = marlin_file_delete_trees (info_dirs, MARLIN_FILE_DELETE_KEEP_ROOTS,
+                                            common->cancellable, delete_tree_progress_callback, &pdata,
+                                            &n_deleted, &error);
+        transfer_info.num_files = pdata.num_files_before + n_deleted;
+        report_delete_progress (common, &source_info, &transfer_info);
+    }
+
+    if (error != NULL) {
+        if (!IS_IO_ERROR (error, CANCELLED)) {
+            g_debug ("Emptying the rest of the trash through GIO: %s", error->message);
+        }
+        g_error_free (error);
+    }
+
+    g_list_free (files_dirs);
+    g_list_free (info_dirs);
+    g_list_free_full (dirs, g_object_unref);
+}
+
+
 static void
 delete_trash_file (CommonJob *job,
                    GFile *file,
@@ -6610,6 +9007,9 @@ empty_trash_job (GIOSchedulerJob *io_job,
 #endif
 
     if (confirm_empty_trash (job)) {
+        empty_trash_fast (job);
+
+        /* Clears whatever the fast path left, or all of it on other file systems */
         for (l = job->trash_dirs;
              l != NULL && !job_aborted (common);
              l = l->next) {
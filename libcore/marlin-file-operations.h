@@ -27,6 +27,7 @@
 
 #include <gtk/gtk.h>
 #include <gio/gio.h>
+#include "marlin-file-permissions.h"
 
 typedef void (* MarlinCopyCallback)      (GHashTable *debuting_uris,
                                           gpointer    callback_data);
@@ -87,11 +88,13 @@ void marlin_file_operations_delete          (GList                  *files,
                                              GtkWindow              *parent_window,
                                              MarlinDeleteCallback   done_callback,
                                              gpointer               done_callback_data);
+void marlin_file_operations_delete_without_confirm (GList                  *files,
+                                                    MarlinDeleteCallback   done_callback,
+                                                    gpointer               done_callback_data);
 void marlin_file_operations_trash_or_delete (GList                  *files,
                                              GtkWindow              *parent_window,
                                              MarlinDeleteCallback   done_callback,
                                              gpointer               done_callback_data);
-#if 0
 void marlin_file_set_permissions_recursive (const char                     *directory,
                                             guint32                         file_permissions,
                                             guint32                         file_mask,
@@ -99,7 +102,12 @@ void marlin_file_set_permissions_recursive (const char                     *dire
                                             guint32                         folder_mask,
                                             MarlinOpCallback              callback,
                                             gpointer                        callback_data);
+void marlin_file_restore_permissions       (GFile                          *directory,
+                                            MarlinPermissionsUndo          *original_permissions,
+                                            MarlinOpCallback                callback,
+                                            gpointer                        callback_data);
 
+#if 0
 void marlin_file_operations_unmount_mount (GtkWindow                      *parent_window,
                                            GMount                         *mount,
                                            gboolean                        eject,
@@ -126,6 +134,8 @@ void marlin_file_operations_copy      (GList                *files,
                                        MarlinCopyCallback   done_callback,
                                        gpointer             done_callback_data);
 
+void marlin_file_operations_set_copy_threads (guint n_threads);
+
 void marlin_file_operations_copy_move   (GList                  *files,
                                          GArray                 *relative_item_points,
                                          GFile                  *target_dir,
@@ -140,6 +150,8 @@ void marlin_file_operations_move      (GList                *files,
                                        GtkWindow            *parent_window,
                                        MarlinCopyCallback  done_callback,
                                        gpointer              done_callback_data);
+
+void marlin_file_operations_resume_interrupted (GtkWindow *parent_window);
 #if 0
 void marlin_file_operations_duplicate (GList                *files,
                                        GArray               *relative_item_points,
@@ -0,0 +1,868 @@
+/* marlin-file-permissions.c - fast permission changes of local folder trees
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+/* Permissions of local folders are changed the way chmod -R does it: every folder is opened once, its
+ * entries are looked at with fstatat () and changed with fchmodat () relative to the folder, and its
+ * subfolders are handed to a pool of threads. Only entries whose mode actually changes are touched and
+ * remembered for undo.
+ *
+ * A folder gets its new mode once everything in it is done, so taking read or search permission away
+ * from folders does not stop the walk; permissions a folder gains are added before it is read.
+ *
+ * Undo data is kept as NUL separated paths relative to the top folder in a single buffer, next to a
+ * packed array of 16 bit modes. Once the paths outgrow PERMISSIONS_UNDO_MAX_MEMORY the records are
+ * moved to an unlinked temporary file.
+ */
+
+#define _GNU_SOURCE
+
+#include "marlin-file-permissions.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <glib/gstdio.h>
+
+#define PERMISSIONS_THREADS 8
+/* Beyond this many queued folders, subfolders are done by the thread that found them. This bounds
+ * the number of descriptors held open by folders waiting for their subfolders */
+#define PERMISSIONS_MAX_QUEUED 64
+#define PERMISSIONS_PROGRESS_INTERVAL_USEC (G_USEC_PER_SEC / 10)
+#define PERMISSIONS_UNDO_MAX_MEMORY (8 * 1024 * 1024)
+
+#define MODE_BITS 07777
+/* Set in the packed modes of folders */
+#define MODE_IS_DIR 0x8000
+
+struct _MarlinPermissionsUndo {
+    GMutex mutex;
+    GString *paths;
+    GArray *modes;
+    FILE *spill;
+    gboolean spill_failed;
+    guint64 n_entries;
+};
+
+typedef struct _ChmodNode ChmodNode;
+
+struct _ChmodNode {
+    ChmodNode *parent;
+    char *name;
+    /* Relative to the top folder, empty for the top folder itself */
+    char *path;
+    int fd;
+    guint32 old_mode;
+    /* The mode now, which has the permissions the folder gains already */
+    guint32 mode;
+    guint32 new_mode;
+    /* One for the thread reading the folder, plus one for each subfolder not yet done */
+    volatile gint pending;
+};
+
+typedef struct {
+    char *path;
+    guint32 file_permissions;
+    guint32 file_mask;
+    guint32 dir_permissions;
+    guint32 dir_mask;
+    MarlinPermissionsUndo *undo;
+    GThreadPool *threads;
+    GCancellable *cancellable;
+    volatile gint n_changed;
+    GMutex mutex;
+    GCond done_cond;
+    /* Protected by mutex */
+    gboolean done;
+    GError *error;
+} ChmodTree;
+
+typedef struct {
+    char *path;
+    guint16 mode;
+    int depth;
+} RestoreDir;
+
+static void chmod_node_read (ChmodTree *tree,
+                             ChmodNode *node);
+
+static void
+set_error_from_errno (GError **error,
+                      int errsv,
+                      const char *name)
+{
+    char *display_name;
+
+    if (errsv == ECANCELED) {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                             g_strerror (errsv));
+    } else {
+        display_name = g_filename_display_name (name);
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                     "Error setting permissions of %s: %s", display_name, g_strerror (errsv));
+        g_free (display_name);
+    }
+}
+
+MarlinPermissionsUndo *
+marlin_permissions_undo_new (void)
+{
+    MarlinPermissionsUndo *undo;
+
+    undo = g_slice_new0 (MarlinPermissionsUndo);
+    g_mutex_init (&undo->mutex);
+    undo->paths = g_string_new (NULL);
+    undo->modes = g_array_new (FALSE, FALSE, sizeof (guint16));
+
+    return undo;
+}
+
+void
+marlin_permissions_undo_free (MarlinPermissionsUndo *undo)
+{
+    if (undo->spill != NULL) {
+        fclose (undo->spill);
+    }
+
+    g_string_free (undo->paths, TRUE);
+    g_array_free (undo->modes, TRUE);
+    g_mutex_clear (&undo->mutex);
+    g_slice_free (MarlinPermissionsUndo, undo);
+}
+
+/* Moves the records kept in memory to the temporary file. Called with the mutex held */
+static void
+permissions_undo_spill (MarlinPermissionsUndo *undo)
+{
+    const char *path;
+    char *tmp_path;
+    guint16 mode;
+    size_t len;
+    long offset;
+    guint i;
+    int fd;
+
+    if (undo->spill_failed) {
+        return;
+    }
+
+    if (undo->spill == NULL) {
+        fd = g_file_open_tmp ("marlin-permissions-XXXXXX", &tmp_path, NULL);
+        if (fd < 0) {
+            undo->spill_failed = TRUE;
+            return;
+        }
+
+        g_unlink (tmp_path);
+        g_free (tmp_path);
+
+        undo->spill = fdopen (fd, "w+");
+        if (undo->spill == NULL) {
+            close (fd);
+            undo->spill_failed = TRUE;
+            return;
+        }
+    }
+
+    offset = ftell (undo->spill);
+    path = undo->paths->str;
+    for (i = 0; i < undo->modes->len; i++) {
+        mode = g_array_index (undo->modes, guint16, i);
+        len = strlen (path) + 1;
+        fwrite (&mode, sizeof (mode), 1, undo->spill);
+        fwrite (path, 1, len, undo->spill);
+        path += len;
+    }
+
+    /* Keeps everything in memory from now on rather than losing records */
+    if (fflush (undo->spill) != 0 || ferror (undo->spill)) {
+        clearerr (undo->spill);
+        if (ftruncate (fileno (undo->spill), offset) != 0) {
+            /* The records after offset are never read */
+        }
+        fseek (undo->spill, offset, SEEK_SET);
+        undo->spill_failed = TRUE;
+        return;
+    }
+
+    g_string_truncate (undo->paths, 0);
+    g_array_set_size (undo->modes, 0);
+}
+
+static void
+permissions_undo_add_batch (MarlinPermissionsUndo *undo,
+                            GString *paths,
+                            GArray *modes)
+{
+    if (modes->len == 0) {
+        return;
+    }
+
+    g_mutex_lock (&undo->mutex);
+    g_string_append_len (undo->paths, paths->str, paths->len);
+    g_array_append_vals (undo->modes, modes->data, modes->len);
+    undo->n_entries += modes->len;
+
+    if (undo->paths->len > PERMISSIONS_UNDO_MAX_MEMORY) {
+        permissions_undo_spill (undo);
+    }
+    g_mutex_unlock (&undo->mutex);
+}
+
+static void
+batch_add (GString *paths,
+           GArray *modes,
+           const char *relative_path,
+           guint32 mode,
+           gboolean is_dir)
+{
+    guint16 packed;
+
+    packed = (mode & MODE_BITS) | (is_dir ? MODE_IS_DIR : 0);
+    /* Keeps the terminating NUL as separator */
+    g_string_append_len (paths, relative_path, strlen (relative_path) + 1);
+    g_array_append_val (modes, packed);
+}
+
+/* Remembers that the file at @relative_path below the top folder had @mode */
+void
+marlin_permissions_undo_add (MarlinPermissionsUndo *undo,
+                             const char *relative_path,
+                             guint32 mode,
+                             gboolean is_dir)
+{
+    GString *paths;
+    GArray *modes;
+
+    paths = g_string_new (NULL);
+    modes = g_array_new (FALSE, FALSE, sizeof (guint16));
+    batch_add (paths, modes, relative_path, mode, is_dir);
+    permissions_undo_add_batch (undo, paths, modes);
+    g_string_free (paths, TRUE);
+    g_array_free (modes, TRUE);
+}
+
+guint64
+marlin_permissions_undo_get_n_entries (MarlinPermissionsUndo *undo)
+{
+    guint64 n_entries;
+
+    g_mutex_lock (&undo->mutex);
+    n_entries = undo->n_entries;
+    g_mutex_unlock (&undo->mutex);
+
+    return n_entries;
+}
+
+typedef gboolean (* RecordFunc) (const char *path,
+                                 guint16 packed,
+                                 gpointer user_data);
+
+/* Calls @func for every record in the order they were added, until it returns FALSE. Called with the
+ * mutex held */
+static void
+permissions_undo_foreach (MarlinPermissionsUndo *undo,
+                          RecordFunc func,
+                          gpointer user_data)
+{
+    const char *path;
+    char *line;
+    size_t line_size;
+    guint16 packed;
+    guint i;
+
+    if (undo->spill != NULL) {
+        line = NULL;
+        line_size = 0;
+        fflush (undo->spill);
+        rewind (undo->spill);
+        while (fread (&packed, sizeof (packed), 1, undo->spill) == 1 &&
+               getdelim (&line, &line_size, '\0', undo->spill) > 0) {
+            if (!func (line, packed, user_data)) {
+                break;
+            }
+        }
+
+        free (line);
+        clearerr (undo->spill);
+        fseek (undo->spill, 0, SEEK_END);
+    }
+
+    path = undo->paths->str;
+    for (i = 0; i < undo->modes->len; i++) {
+        if (!func (path, g_array_index (undo->modes, guint16, i), user_data)) {
+            break;
+        }
+        path += strlen (path) + 1;
+    }
+}
+
+typedef struct {
+    GFile *dir;
+    char *dir_path;
+    int dir_fd;
+    GCancellable *cancellable;
+    GPtrArray *dirs;
+    GError *error;
+} Restore;
+
+static gboolean
+restore_mode (Restore *restore,
+              const char *path,
+              guint32 mode)
+{
+    GFile *file;
+    GError *error;
+    struct stat st;
+    int res;
+
+    if (g_cancellable_is_cancelled (restore->cancellable)) {
+        if (restore->error == NULL) {
+            set_error_from_errno (&restore->error, ECANCELED, path);
+        }
+        return FALSE;
+    }
+
+    if (restore->dir_fd >= 0) {
+        if (*path == '\0') {
+            res = fchmod (restore->dir_fd, mode);
+            if (res != 0 && errno == EBADF) {
+                /* Opened with O_PATH */
+                res = chmod (restore->dir_path, mode);
+            }
+        } else if (fstatat (restore->dir_fd, path, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            res = -1;
+        } else if (S_ISLNK (st.st_mode)) {
+            /* Replaced since, and fchmodat () would follow it */
+            res = 0;
+        } else {
+            res = fchmodat (restore->dir_fd, path, mode, 0);
+        }
+
+        /* Files deleted since are no error */
+        if (res != 0 && errno != ENOENT && restore->error == NULL) {
+            set_error_from_errno (&restore->error, errno, path);
+        }
+    } else {
+        file = *path != '\0' ? g_file_resolve_relative_path (restore->dir, path) : g_object_ref (restore->dir);
+        error = NULL;
+        if (!g_file_set_attribute_uint32 (file, G_FILE_ATTRIBUTE_UNIX_MODE, mode,
+                                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                          restore->cancellable, &error)) {
+            if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND) && restore->error == NULL) {
+                g_propagate_error (&restore->error, error);
+            } else {
+                g_error_free (error);
+            }
+        }
+        g_object_unref (file);
+    }
+
+    return TRUE;
+}
+
+static int
+restore_dir_depth (const char *path)
+{
+    int depth;
+
+    depth = *path != '\0' ? 1 : 0;
+    for (; *path != '\0'; path++) {
+        if (*path == '/') {
+            depth++;
+        }
+    }
+
+    return depth;
+}
+
+static void
+restore_dir_free (RestoreDir *dir)
+{
+    g_free (dir->path);
+    g_slice_free (RestoreDir, dir);
+}
+
+static gint
+restore_dir_compare (gconstpointer a,
+                     gconstpointer b)
+{
+    const RestoreDir *dir_a = *(RestoreDir **)a;
+    const RestoreDir *dir_b = *(RestoreDir **)b;
+
+    return dir_a->depth - dir_b->depth;
+}
+
+static gboolean
+collect_dir (const char *path,
+             guint16 packed,
+             gpointer user_data)
+{
+    Restore *restore = user_data;
+    RestoreDir *dir;
+
+    if (packed & MODE_IS_DIR) {
+        dir = g_slice_new (RestoreDir);
+        dir->path = g_strdup (path);
+        dir->mode = packed & MODE_BITS;
+        dir->depth = restore_dir_depth (path);
+        g_ptr_array_add (restore->dirs, dir);
+    }
+
+    return TRUE;
+}
+
+static gboolean
+restore_file (const char *path,
+              guint16 packed,
+              gpointer user_data)
+{
+    if (packed & MODE_IS_DIR) {
+        return TRUE;
+    }
+
+    return restore_mode (user_data, path, packed & MODE_BITS);
+}
+
+/* Sets the modes recorded in @undo back on the files below @dir.
+ *
+ * The files are only reachable through folders that can be searched, so folders which could be
+ * searched before get their mode back first, starting at the top, and those which could not get it
+ * back last, starting at the bottom. */
+gboolean
+marlin_permissions_undo_restore (MarlinPermissionsUndo *undo,
+                                 GFile *dir,
+                                 GCancellable *cancellable,
+                                 GError **error)
+{
+    Restore restore;
+    RestoreDir *restore_dir;
+    int i;
+
+    memset (&restore, 0, sizeof (restore));
+    restore.dir = dir;
+    restore.cancellable = cancellable;
+    restore.dir_fd = -1;
+    restore.dirs = g_ptr_array_new_with_free_func ((GDestroyNotify) restore_dir_free);
+
+    restore.dir_path = g_file_get_path (dir);
+    if (restore.dir_path != NULL) {
+        restore.dir_fd = open (restore.dir_path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (restore.dir_fd < 0) {
+            /* The top folder may have lost read permission, which is not needed to change modes below */
+            restore.dir_fd = open (restore.dir_path, O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        }
+    }
+
+    g_mutex_lock (&undo->mutex);
+
+    permissions_undo_foreach (undo, collect_dir, &restore);
+    g_ptr_array_sort (restore.dirs, restore_dir_compare);
+
+    for (i = 0; i < (int) restore.dirs->len; i++) {
+        restore_dir = g_ptr_array_index (restore.dirs, i);
+        if ((restore_dir->mode & S_IXUSR) &&
+            !restore_mode (&restore, restore_dir->path, restore_dir->mode)) {
+            break;
+        }
+    }
+
+    permissions_undo_foreach (undo, restore_file, &restore);
+
+    for (i = restore.dirs->len - 1; i >= 0; i--) {
+        restore_dir = g_ptr_array_index (restore.dirs, i);
+        if (!(restore_dir->mode & S_IXUSR) &&
+            !restore_mode (&restore, restore_dir->path, restore_dir->mode)) {
+            break;
+        }
+    }
+
+    g_mutex_unlock (&undo->mutex);
+
+    g_ptr_array_free (restore.dirs, TRUE);
+    g_free (restore.dir_path);
+    if (restore.dir_fd >= 0) {
+        close (restore.dir_fd);
+    }
+
+    if (restore.error != NULL) {
+        g_propagate_error (error, restore.error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Keeps the first error met by any of the threads */
+static void
+chmod_tree_set_error (ChmodTree *tree,
+                      int errsv,
+                      const char *name)
+{
+    g_mutex_lock (&tree->mutex);
+    if (tree->error == NULL) {
+        set_error_from_errno (&tree->error, errsv, name);
+    }
+    g_mutex_unlock (&tree->mutex);
+}
+
+static ChmodNode *
+chmod_node_new (ChmodNode *parent,
+                const char *name,
+                char *path,
+                guint32 old_mode,
+                guint32 mode,
+                guint32 new_mode)
+{
+    ChmodNode *node;
+
+    node = g_slice_new0 (ChmodNode);
+    node->parent = parent;
+    node->name = g_strdup (name);
+    node->path = path;
+    node->fd = -1;
+    node->old_mode = old_mode;
+    node->mode = mode;
+    node->new_mode = new_mode;
+    node->pending = 1;
+
+    if (parent != NULL) {
+        g_atomic_int_inc (&parent->pending);
+    }
+
+    return node;
+}
+
+/* Drops a reference of @node. The last one gives the folder its new mode and drops the reference it
+ * held on its parent, which may in turn finish that */
+static void
+chmod_node_unref (ChmodTree *tree,
+                  ChmodNode *node)
+{
+    ChmodNode *parent;
+    int res;
+
+    while (node != NULL && g_atomic_int_dec_and_test (&node->pending)) {
+        parent = node->parent;
+
+        res = 0;
+        if (node->new_mode != node->mode) {
+            if (node->fd >= 0) {
+                res = fchmod (node->fd, node->new_mode);
+            } else if (parent != NULL) {
+                res = fchmodat (parent->fd, node->name, node->new_mode, 0);
+            } else {
+                res = chmod (tree->path, node->new_mode);
+            }
+
+            if (res != 0) {
+                chmod_tree_set_error (tree, errno, node->name);
+            }
+        }
+
+        if (res == 0 && node->new_mode != node->old_mode) {
+            g_atomic_int_inc (&tree->n_changed);
+        }
+
+        if (node->fd >= 0) {
+            close (node->fd);
+        }
+
+        if (parent == NULL) {
+            g_mutex_lock (&tree->mutex);
+            tree->done = TRUE;
+            g_cond_broadcast (&tree->done_cond);
+            g_mutex_unlock (&tree->mutex);
+        }
+
+        g_free (node->name);
+        g_free (node->path);
+        g_slice_free (ChmodNode, node);
+
+        node = parent;
+    }
+}
+
+static guint32
+chmod_tree_new_mode (ChmodTree *tree,
+                     guint32 mode,
+                     gboolean is_dir)
+{
+    if (is_dir) {
+        return ((mode & ~tree->dir_mask) | tree->dir_permissions) & MODE_BITS;
+    } else {
+        return ((mode & ~tree->file_mask) | tree->file_permissions) & MODE_BITS;
+    }
+}
+
+/* Changes the entries of the folder of @node, handing subfolders to the pool or doing them right away
+ * when it is busy, and drops the reference on @node held by the reader */
+static void
+chmod_node_read (ChmodTree *tree,
+                 ChmodNode *node)
+{
+    ChmodNode *child;
+    struct dirent *entry;
+    struct stat st;
+    GString *paths;
+    GArray *modes;
+    char *child_path;
+    guint32 old_mode, mode, new_mode;
+    DIR *dir;
+    int dir_fd;
+
+    if (g_cancellable_is_cancelled (tree->cancellable)) {
+        chmod_tree_set_error (tree, ECANCELED, node->name);
+        chmod_node_unref (tree, node);
+        return;
+    }
+
+    if (node->fd < 0) {
+        /* The parent's descriptor stays open as long as this node holds a reference on it */
+        node->fd = openat (node->parent->fd, node->name,
+                           O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+
+    dir = NULL;
+    if (node->fd >= 0) {
+        dir_fd = dup (node->fd);
+        if (dir_fd >= 0) {
+            dir = fdopendir (dir_fd);
+            if (dir == NULL) {
+                int errsv = errno;
+                close (dir_fd);
+                errno = errsv;
+            }
+        }
+    }
+
+    if (dir == NULL) {
+        chmod_tree_set_error (tree, errno, node->name);
+        chmod_node_unref (tree, node);
+        return;
+    }
+
+    paths = g_string_new (NULL);
+    modes = g_array_new (FALSE, FALSE, sizeof (guint16));
+
+    errno = 0;
+    while ((entry = readdir (dir)) != NULL) {
+        if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        if (g_cancellable_is_cancelled (tree->cancellable)) {
+            chmod_tree_set_error (tree, ECANCELED, node->name);
+            break;
+        }
+
+        if (fstatat (node->fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            chmod_tree_set_error (tree, errno, entry->d_name);
+            errno = 0;
+            continue;
+        }
+
+        /* Links have no permissions of their own */
+        if (S_ISLNK (st.st_mode)) {
+            errno = 0;
+            continue;
+        }
+
+        old_mode = mode = st.st_mode & MODE_BITS;
+        new_mode = chmod_tree_new_mode (tree, mode, S_ISDIR (st.st_mode));
+        child_path = *node->path != '\0' ? g_strconcat (node->path, "/", entry->d_name, NULL)
+                                         : g_strdup (entry->d_name);
+
+        if (S_ISDIR (st.st_mode)) {
+            if (new_mode != mode && tree->undo != NULL) {
+                batch_add (paths, modes, child_path, mode, TRUE);
+            }
+
+            /* Permissions the folder gains may be needed to read it */
+            if ((new_mode & ~mode) != 0 &&
+                fchmodat (node->fd, entry->d_name, mode | new_mode, 0) == 0) {
+                mode |= new_mode;
+            }
+
+            child = chmod_node_new (node, entry->d_name, child_path, old_mode, mode, new_mode);
+            if (g_thread_pool_unprocessed (tree->threads) < PERMISSIONS_MAX_QUEUED) {
+                g_thread_pool_push (tree->threads, child, NULL);
+            } else {
+                chmod_node_read (tree, child);
+            }
+        } else {
+            if (new_mode != mode) {
+                if (fchmodat (node->fd, entry->d_name, new_mode, 0) == 0) {
+                    g_atomic_int_inc (&tree->n_changed);
+                    if (tree->undo != NULL) {
+                        batch_add (paths, modes, child_path, mode, FALSE);
+                    }
+                } else {
+                    chmod_tree_set_error (tree, errno, entry->d_name);
+                }
+            }
+
+            g_free (child_path);
+        }
+
+        errno = 0;
+    }
+
+    if (entry == NULL && errno != 0) {
+        chmod_tree_set_error (tree, errno, node->name);
+    }
+
+    closedir (dir);
+
+    if (tree->undo != NULL) {
+        permissions_undo_add_batch (tree->undo, paths, modes);
+    }
+    g_string_free (paths, TRUE);
+    g_array_free (modes, TRUE);
+
+    chmod_node_unref (tree, node);
+}
+
+static void
+chmod_tree_thread (gpointer data,
+                   gpointer user_data)
+{
+    chmod_node_read (user_data, data);
+}
+
+/* Changes the permissions of the local folder @dir and everything in it: the bits in @file_mask or
+ * @dir_mask are replaced by those in @file_permissions or @dir_permissions. The modes replaced are
+ * added to @undo when it is not %NULL. Progress is reported through @progress_callback on the calling
+ * thread about ten times a second, and the number of files and folders changed is stored in
+ * @n_changed, also when changing some of them failed.
+ *
+ * Fails with G_IO_ERROR_NOT_SUPPORTED without changing anything when @dir is not a local folder
+ * (e.g. a remote file or a symbolic link). */
+gboolean
+marlin_file_set_permissions_tree (GFile                                   *dir,
+                                  guint32                                  file_permissions,
+                                  guint32                                  file_mask,
+                                  guint32                                  dir_permissions,
+                                  guint32                                  dir_mask,
+                                  MarlinPermissionsUndo                   *undo,
+                                  GCancellable                            *cancellable,
+                                  MarlinFilePermissionsProgressCallback    progress_callback,
+                                  gpointer                                 progress_callback_data,
+                                  guint64                                 *n_changed,
+                                  GError                                 **error)
+{
+    ChmodTree tree;
+    ChmodNode *root;
+    struct stat st;
+    guint32 mode, new_mode;
+    gint64 end_time;
+    gboolean done;
+    int fd;
+
+    *n_changed = 0;
+
+    memset (&tree, 0, sizeof (tree));
+    tree.path = g_file_get_path (dir);
+    if (tree.path == NULL) {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "Not a local file");
+        return FALSE;
+    }
+
+    if (lstat (tree.path, &st) != 0) {
+        set_error_from_errno (error, errno, tree.path);
+        g_free (tree.path);
+        return FALSE;
+    }
+
+    if (!S_ISDIR (st.st_mode)) {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "Not a folder");
+        g_free (tree.path);
+        return FALSE;
+    }
+
+    tree.file_permissions = file_permissions;
+    tree.file_mask = file_mask;
+    tree.dir_permissions = dir_permissions;
+    tree.dir_mask = dir_mask;
+    tree.undo = undo;
+
+    mode = st.st_mode & MODE_BITS;
+    new_mode = chmod_tree_new_mode (&tree, mode, TRUE);
+    if ((new_mode & ~mode) != 0 && chmod (tree.path, mode | new_mode) == 0) {
+        mode |= new_mode;
+    }
+
+    fd = open (tree.path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        set_error_from_errno (error, errno, tree.path);
+        g_free (tree.path);
+        return FALSE;
+    }
+
+    if (undo != NULL && new_mode != (st.st_mode & MODE_BITS)) {
+        marlin_permissions_undo_add (undo, "", st.st_mode & MODE_BITS, TRUE);
+    }
+
+    tree.cancellable = cancellable;
+    g_mutex_init (&tree.mutex);
+    g_cond_init (&tree.done_cond);
+    tree.threads = g_thread_pool_new (chmod_tree_thread, &tree, PERMISSIONS_THREADS, FALSE, NULL);
+
+    root = chmod_node_new (NULL, tree.path, g_strdup (""), st.st_mode & MODE_BITS, mode, new_mode);
+    root->fd = fd;
+    g_thread_pool_push (tree.threads, root, NULL);
+
+    do {
+        end_time = g_get_monotonic_time () + PERMISSIONS_PROGRESS_INTERVAL_USEC;
+        g_mutex_lock (&tree.mutex);
+        while (!tree.done && g_cond_wait_until (&tree.done_cond, &tree.mutex, end_time)) {
+            /* Spurious wakeup */
+        }
+        done = tree.done;
+        g_mutex_unlock (&tree.mutex);
+
+        if (progress_callback != NULL) {
+            progress_callback (g_atomic_int_get (&tree.n_changed), progress_callback_data);
+        }
+    } while (!done);
+
+    /* Nothing is queued any more, this only waits for the threads to return */
+    g_thread_pool_free (tree.threads, FALSE, TRUE);
+
+    *n_changed = g_atomic_int_get (&tree.n_changed);
+
+    g_mutex_clear (&tree.mutex);
+    g_cond_clear (&tree.done_cond);
+    g_free (tree.path);
+
+    if (tree.error != NULL) {
+        g_propagate_error (error, tree.error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
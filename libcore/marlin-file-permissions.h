@@ -0,0 +1,57 @@
+/* marlin-file-permissions.h - fast permission changes of local folder trees
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+#ifndef MARLIN_FILE_PERMISSIONS_H
+#define MARLIN_FILE_PERMISSIONS_H
+
+#include <gio/gio.h>
+
+/* The permissions a tree had before they were changed, kept as paths relative to the top folder */
+typedef struct _MarlinPermissionsUndo MarlinPermissionsUndo;
+
+/* Called on the thread changing the permissions with the number of files and folders changed so far */
+typedef void (* MarlinFilePermissionsProgressCallback) (guint64  n_changed,
+                                                        gpointer user_data);
+
+MarlinPermissionsUndo  *marlin_permissions_undo_new           (void);
+void                    marlin_permissions_undo_free          (MarlinPermissionsUndo                   *undo);
+void                    marlin_permissions_undo_add           (MarlinPermissionsUndo                   *undo,
+                                                               const char                              *relative_path,
+                                                               guint32                                  mode,
+                                                               gboolean                                 is_dir);
+guint64                 marlin_permissions_undo_get_n_entries (MarlinPermissionsUndo                   *undo);
+gboolean                marlin_permissions_undo_restore       (MarlinPermissionsUndo                   *undo,
+                                                               GFile                                   *dir,
+                                                               GCancellable                            *cancellable,
+                                                               GError                                 **error);
+
+gboolean                marlin_file_set_permissions_tree      (GFile                                   *dir,
+                                                               guint32                                  file_permissions,
+                                                               guint32                                  file_mask,
+                                                               guint32                                  dir_permissions,
+                                                               guint32                                  dir_mask,
+                                                               MarlinPermissionsUndo                   *undo,
+                                                               GCancellable                            *cancellable,
+                                                               MarlinFilePermissionsProgressCallback    progress_callback,
+                                                               gpointer                                 progress_callback_data,
+                                                               guint64                                 *n_changed,
+                                                               GError                                 **error);
+
+#endif /* MARLIN_FILE_PERMISSIONS_H */
@@ -0,0 +1,404 @@
+/* marlin-file-trash.c - batched trashing of local files
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+/* Moves local files to the trash as described by the freedesktop.org trash specification, doing what
+ * g_file_trash () does for each file once for the whole batch: the files are grouped by the trash
+ * folder of their filesystem, the files/ and info/ folders of each trash are opened once, the deletion
+ * date is formatted once and free names are looked up from where the previous file with the same name
+ * left off. Every file then costs the creation of its .trashinfo file and a rename ().
+ *
+ * Only the home trash and existing $topdir/.Trash-$uid folders are used. Files for which GIO would pick
+ * another trash (a shared $topdir/.Trash, or a .Trash-$uid still to be created), remote files, and files
+ * that fail to be trashed are handed back to the caller to go through g_file_trash () as before.
+ */
+
+#define _GNU_SOURCE
+
+#include "marlin-file-trash.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <glib/gstdio.h>
+
+/* Gives up on the file after this many taken names, leaving it to GIO */
+#define TRASH_MAX_NAME_TRIES 1000
+
+typedef struct {
+    GFile *file;
+    char *path;
+    guint64 mtime;
+} TrashItem;
+
+typedef struct {
+    /* Absolute for the home trash, else the mount point the paths in the trash are relative to */
+    char *topdir;
+    int files_fd;
+    int info_fd;
+    GList *items;
+    /* Next number to try for each name, to avoid probing taken names over and over */
+    GHashTable *next_suffix;
+} TrashGroup;
+
+static void
+trash_item_free (TrashItem *item)
+{
+    g_free (item->path);
+    g_slice_free (TrashItem, item);
+}
+
+static void
+trash_group_free (TrashGroup *group)
+{
+    if (group == NULL) {
+        return;
+    }
+
+    if (group->files_fd >= 0) {
+        close (group->files_fd);
+    }
+    if (group->info_fd >= 0) {
+        close (group->info_fd);
+    }
+
+    g_list_free_full (group->items, (GDestroyNotify) trash_item_free);
+    g_hash_table_destroy (group->next_suffix);
+    g_free (group->topdir);
+    g_slice_free (TrashGroup, group);
+}
+
+/* Opens the files/ and info/ folders of the trash at @trash_dir, creating them when @create is set */
+static TrashGroup *
+trash_group_new (const char *trash_dir,
+                 const char *topdir,
+                 gboolean create)
+{
+    TrashGroup *group;
+    char *files_dir, *info_dir;
+
+    files_dir = g_build_filename (trash_dir, "files", NULL);
+    info_dir = g_build_filename (trash_dir, "info", NULL);
+
+    if (create) {
+        g_mkdir_with_parents (files_dir, 0700);
+        g_mkdir_with_parents (info_dir, 0700);
+    }
+
+    group = g_slice_new0 (TrashGroup);
+    group->topdir = g_strdup (topdir);
+    group->files_fd = open (files_dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    group->info_fd = open (info_dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    group->next_suffix = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    g_free (files_dir);
+    g_free (info_dir);
+
+    if (group->files_fd < 0 || group->info_fd < 0) {
+        trash_group_free (group);
+        return NULL;
+    }
+
+    return group;
+}
+
+/* Returns the mount point of the filesystem holding @path, which is on device @dev */
+static char *
+find_topdir (const char *path,
+             dev_t dev)
+{
+    struct stat st;
+    char *dir, *parent;
+
+    dir = g_path_get_dirname (path);
+    while (strcmp (dir, "/") != 0) {
+        parent = g_path_get_dirname (dir);
+        if (g_lstat (parent, &st) != 0 || st.st_dev != dev) {
+            g_free (parent);
+            break;
+        }
+
+        g_free (dir);
+        dir = parent;
+    }
+
+    return dir;
+}
+
+/* Sets up the group for the filesystem of @path, or returns NULL when its files are left to GIO */
+static TrashGroup *
+trash_group_for_topdir (const char *path,
+                        dev_t dev)
+{
+    TrashGroup *group;
+    struct stat st;
+    char *topdir, *shared_trash, *trash_dir, *dirname;
+
+    group = NULL;
+    topdir = find_topdir (path, dev);
+
+    /* GIO prefers the shared trash when there is one */
+    shared_trash = g_build_filename (topdir, ".Trash", NULL);
+    dirname = g_strdup_printf (".Trash-%d", (int) getuid ());
+    trash_dir = g_build_filename (topdir, dirname, NULL);
+
+    if (g_lstat (shared_trash, &st) != 0 &&
+        g_lstat (trash_dir, &st) == 0 && S_ISDIR (st.st_mode) && st.st_uid == getuid ()) {
+        group = trash_group_new (trash_dir, topdir, TRUE);
+    }
+
+    g_free (dirname);
+    g_free (trash_dir);
+    g_free (shared_trash);
+    g_free (topdir);
+
+    return group;
+}
+
+static char *
+make_trash_info (TrashGroup *group,
+                 const char *path,
+                 const char *deletion_date)
+{
+    const char *relative_path;
+    char *escaped_path, *info;
+
+    relative_path = path;
+    if (group->topdir != NULL) {
+        relative_path = path + strlen (group->topdir);
+        while (*relative_path == '/') {
+            relative_path++;
+        }
+    }
+
+    escaped_path = g_uri_escape_string (relative_path, "/", FALSE);
+    info = g_strdup_printf ("[Trash Info]\nPath=%s\nDeletionDate=%s\n", escaped_path, deletion_date);
+    g_free (escaped_path);
+
+    return info;
+}
+
+/* Reserves a name in the trash by creating its .trashinfo file exclusively, as GIO does. Returns the
+ * name, or NULL on failure */
+static char *
+trash_group_reserve_name (TrashGroup *group,
+                          const char *basename,
+                          const char *info_contents)
+{
+    char *trash_name, *info_name;
+    gsize len, written;
+    gssize res;
+    guint suffix, tries;
+    int fd;
+
+    suffix = GPOINTER_TO_UINT (g_hash_table_lookup (group->next_suffix, basename));
+
+    for (tries = 0; tries < TRASH_MAX_NAME_TRIES; tries++, suffix++) {
+        if (suffix == 0) {
+            trash_name = g_strdup (basename);
+        } else {
+            trash_name = g_strdup_printf ("%s.%u", basename, suffix);
+        }
+
+        info_name = g_strconcat (trash_name, ".trashinfo", NULL);
+        fd = openat (group->info_fd, info_name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            g_free (info_name);
+            g_free (trash_name);
+            if (errno == EEXIST) {
+                continue;
+            }
+            return NULL;
+        }
+
+        len = strlen (info_contents);
+        written = 0;
+        while (written < len) {
+            res = write (fd, info_contents + written, len - written);
+            if (res < 0 && errno == EINTR) {
+                continue;
+            } else if (res <= 0) {
+                break;
+            }
+            written += res;
+        }
+        close (fd);
+
+        /* A leftover file in files/ without its .trashinfo also takes the name */
+        if (written < len || faccessat (group->files_fd, trash_name, F_OK, AT_SYMLINK_NOFOLLOW) == 0) {
+            unlinkat (group->info_fd, info_name, 0);
+            g_free (info_name);
+            g_free (trash_name);
+            if (written < len) {
+                return NULL;
+            }
+            continue;
+        }
+
+        g_free (info_name);
+        g_hash_table_replace (group->next_suffix, g_strdup (basename), GUINT_TO_POINTER (suffix + 1));
+        return trash_name;
+    }
+
+    return NULL;
+}
+
+static gboolean
+trash_group_trash_item (TrashGroup *group,
+                        TrashItem *item,
+                        const char *deletion_date)
+{
+    char *basename, *info_contents, *trash_name, *info_name;
+    gboolean trashed;
+
+    basename = g_path_get_basename (item->path);
+    info_contents = make_trash_info (group, item->path, deletion_date);
+    trashed = FALSE;
+
+    trash_name = trash_group_reserve_name (group, basename, info_contents);
+    if (trash_name != NULL) {
+        if (renameat (AT_FDCWD, item->path, group->files_fd, trash_name) == 0) {
+            trashed = TRUE;
+        } else {
+            info_name = g_strconcat (trash_name, ".trashinfo", NULL);
+            unlinkat (group->info_fd, info_name, 0);
+            g_free (info_name);
+        }
+
+        g_free (trash_name);
+    }
+
+    g_free (info_contents);
+    g_free (basename);
+
+    return trashed;
+}
+
+/**
+ * marlin_file_trash_local:
+ * @files: (element-type GFile): the files to trash
+ *
+ * Moves the local files among @files to the trash in one pass, calling @trashed_callback for each one.
+ *
+ * Returns: (transfer container) (element-type GFile): the files which were not trashed, in their
+ * original order, for the caller to trash one by one with g_file_trash ()
+ */
+GList *
+marlin_file_trash_local (GList                      *files,
+                         GCancellable               *cancellable,
+                         MarlinFileTrashedCallback   trashed_callback,
+                         gpointer                    user_data)
+{
+    GHashTable *groups, *trashed_files;
+    GList *group_order, *leftover, *l, *i;
+    TrashGroup *group, *home_group;
+    TrashItem *item;
+    struct stat home_st, st;
+    char *home_trash, *path, deletion_date[32];
+    struct tm now_tm;
+    time_t now;
+    gint64 dev, *dev_key;
+
+    groups = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, (GDestroyNotify) trash_group_free);
+    trashed_files = g_hash_table_new (g_direct_hash, g_direct_equal);
+    group_order = NULL;
+
+    home_trash = g_build_filename (g_get_user_data_dir (), "Trash", NULL);
+    home_group = trash_group_new (home_trash, NULL, TRUE);
+    if (home_group != NULL && fstat (home_group->files_fd, &home_st) == 0) {
+        dev_key = g_new (gint64, 1);
+        *dev_key = home_st.st_dev;
+        g_hash_table_insert (groups, dev_key, home_group);
+        group_order = g_list_prepend (group_order, home_group);
+    } else {
+        trash_group_free (home_group);
+    }
+
+    /* Group the files by the trash they go to */
+    for (l = files; l != NULL; l = l->next) {
+        path = g_file_get_path (l->data);
+        if (path == NULL || g_lstat (path, &st) != 0 ||
+            /* Trashing from within a trash is left to GIO */
+            g_str_has_prefix (path, home_trash) || strstr (path, "/.Trash") != NULL) {
+            g_free (path);
+            continue;
+        }
+
+        dev = st.st_dev;
+        if (!g_hash_table_lookup_extended (groups, &dev, NULL, (gpointer *) &group)) {
+            group = trash_group_for_topdir (path, st.st_dev);
+            dev_key = g_new (gint64, 1);
+            *dev_key = dev;
+            g_hash_table_insert (groups, dev_key, group);
+            if (group != NULL) {
+                group_order = g_list_prepend (group_order, group);
+            }
+        }
+
+        if (group == NULL) {
+            g_free (path);
+            continue;
+        }
+
+        item = g_slice_new (TrashItem);
+        item->file = l->data;
+        item->path = path;
+        item->mtime = st.st_mtime;
+        group->items = g_list_prepend (group->items, item);
+    }
+
+    now = time (NULL);
+    localtime_r (&now, &now_tm);
+    strftime (deletion_date, sizeof (deletion_date), "%Y-%m-%dT%H:%M:%S", &now_tm);
+
+    group_order = g_list_reverse (group_order);
+    for (l = group_order; l != NULL; l = l->next) {
+        group = l->data;
+        group->items = g_list_reverse (group->items);
+
+        for (i = group->items; i != NULL && !g_cancellable_is_cancelled (cancellable); i = i->next) {
+            item = i->data;
+            if (trash_group_trash_item (group, item, deletion_date)) {
+                g_hash_table_add (trashed_files, item->file);
+                if (trashed_callback != NULL) {
+                    trashed_callback (item->file, item->mtime, user_data);
+                }
+            }
+        }
+    }
+
+    leftover = NULL;
+    for (l = files; l != NULL; l = l->next) {
+        if (!g_hash_table_contains (trashed_files, l->data)) {
+            leftover = g_list_prepend (leftover, l->data);
+        }
+    }
+
+    g_list_free (group_order);
+    g_hash_table_destroy (trashed_files);
+    g_hash_table_destroy (groups);
+    g_free (home_trash);
+
+    return g_list_reverse (leftover);
+}
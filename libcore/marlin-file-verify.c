@@ -0,0 +1,526 @@
+/* marlin-file-verify.c - checking copies against their originals
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+/* A copy is verified by reading it back and comparing it with the original, block by block. Local
+ * copies are first flushed to the disk and dropped from the page cache, so that what is read back is
+ * what the disk holds rather than what was just written to memory. Comparing the data directly costs
+ * less than hashing both sides, and there is no digest to keep: both files are at hand.
+ *
+ * The original is read a second time as well. It often still comes from the page cache, having just
+ * been read for the copy, but files larger than the cache are read from their device twice, which
+ * slows down a copy from a USB drive noticeably.
+ *
+ * A MarlinFileVerifier does this on a thread of its own, so that a file is checked while the next ones
+ * are being copied. Files which are not regular files (folders, links, special files) are not checked,
+ * and neither are copies of files on network filesystems: reading those again would double the network
+ * traffic, and it is the destination that may have been damaged on its way to the disk.
+ */
+
+#define _GNU_SOURCE
+
+#include "marlin-file-verify.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define VERIFY_BLOCK_SIZE (1024 * 1024)
+/* Beyond this many copies waiting to be checked, the copying waits for the checking */
+#define VERIFY_MAX_QUEUED 64
+
+struct _MarlinFileVerifier {
+    GThreadPool *thread;
+    GCancellable *cancellable;
+    GMutex mutex;
+    GCond cond;
+    /* Protected by mutex */
+    guint pending;
+    guint64 n_pushed;
+    guint64 n_checked;
+    GQueue failures;
+    /* Only used by the thread: the folder of the last source, and whether it is on the network */
+    GFile *last_dir;
+    gboolean last_dir_remote;
+};
+
+typedef struct {
+    GFile *source;
+    GFile *destination;
+    /* What the copy was made with, for making it again */
+    GFileCopyFlags flags;
+    GError *error;
+} VerifyItem;
+
+static void
+set_error_from_errno (GError **error,
+                      int errsv,
+                      GFile *file)
+{
+    char *display_name;
+
+    display_name = g_file_get_parse_name (file);
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 "Error reading %s: %s", display_name, g_strerror (errsv));
+    g_free (display_name);
+}
+
+static void
+set_mismatch_error (GError **error,
+                    goffset offset)
+{
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "The copy differs from the original from byte %" G_GOFFSET_FORMAT " on", offset);
+}
+
+/* Reads up to @count bytes, fewer only at the end of the file */
+static gssize
+read_block (int fd,
+            guchar *buffer,
+            gsize count)
+{
+    gsize done;
+    gssize res;
+
+    done = 0;
+    while (done < count) {
+        res = read (fd, buffer + done, count - done);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        } else if (res < 0) {
+            return -1;
+        } else if (res == 0) {
+            break;
+        }
+
+        done += res;
+    }
+
+    return done;
+}
+
+/* Returns -1 when @source or @destination is not local, so GIO has to do it */
+static int
+verify_local (GFile *source,
+              GFile *destination,
+              GCancellable *cancellable,
+              GError **error)
+{
+    char *src_path, *dest_path;
+    guchar *src_buffer, *dest_buffer;
+    struct stat src_stat, dest_stat;
+    gssize src_read, dest_read;
+    goffset offset;
+    gsize i;
+    int src_fd, dest_fd;
+    int res;
+
+    src_path = g_file_get_path (source);
+    dest_path = g_file_get_path (destination);
+    if (src_path == NULL || dest_path == NULL) {
+        g_free (src_path);
+        g_free (dest_path);
+        return -1;
+    }
+
+    res = FALSE;
+    src_buffer = NULL;
+    dest_buffer = NULL;
+    dest_fd = -1;
+
+    src_fd = open (src_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (src_fd < 0 || fstat (src_fd, &src_stat) != 0) {
+        if (errno == ELOOP) {
+            res = TRUE;
+        } else {
+            set_error_from_errno (error, errno, source);
+        }
+        goto out;
+    }
+
+    if (!S_ISREG (src_stat.st_mode)) {
+        res = TRUE;
+        goto out;
+    }
+
+    dest_fd = open (dest_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (dest_fd < 0 || fstat (dest_fd, &dest_stat) != 0) {
+        set_error_from_errno (error, errno, destination);
+        goto out;
+    }
+
+    if (dest_stat.st_size != src_stat.st_size) {
+        set_mismatch_error (error, MIN (src_stat.st_size, dest_stat.st_size));
+        goto out;
+    }
+
+    /* Only pages written to the disk can be dropped. Filesystems which cannot do either still get
+     * their copy compared, only perhaps from memory */
+    fdatasync (dest_fd);
+    posix_fadvise (dest_fd, 0, 0, POSIX_FADV_DONTNEED);
+    posix_fadvise (dest_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise (src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    src_buffer = g_malloc (VERIFY_BLOCK_SIZE);
+    dest_buffer = g_malloc (VERIFY_BLOCK_SIZE);
+
+    offset = 0;
+    for (;;) {
+        if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+            goto out;
+        }
+
+        src_read = read_block (src_fd, src_buffer, VERIFY_BLOCK_SIZE);
+        if (src_read < 0) {
+            set_error_from_errno (error, errno, source);
+            goto out;
+        }
+
+        dest_read = read_block (dest_fd, dest_buffer, VERIFY_BLOCK_SIZE);
+        if (dest_read < 0) {
+            set_error_from_errno (error, errno, destination);
+            goto out;
+        }
+
+        if (src_read != dest_read || memcmp (src_buffer, dest_buffer, src_read) != 0) {
+            for (i = 0; i < (gsize) MIN (src_read, dest_read) && src_buffer[i] == dest_buffer[i]; i++) {
+                /* Find the first difference */
+            }
+            set_mismatch_error (error, offset + i);
+            goto out;
+        }
+
+        if (src_read == 0) {
+            break;
+        }
+
+        offset += src_read;
+    }
+
+    res = TRUE;
+
+out:
+    if (src_fd >= 0) {
+        close (src_fd);
+    }
+    if (dest_fd >= 0) {
+        /* The copy is not needed in memory any more either */
+        posix_fadvise (dest_fd, 0, 0, POSIX_FADV_DONTNEED);
+        close (dest_fd);
+    }
+
+    g_free (src_buffer);
+    g_free (dest_buffer);
+    g_free (src_path);
+    g_free (dest_path);
+
+    return res;
+}
+
+static gboolean
+verify_streams (GFile *source,
+                GFile *destination,
+                GCancellable *cancellable,
+                GError **error)
+{
+    GFileInputStream *src_stream, *dest_stream;
+    GFileInfo *info;
+    guchar *src_buffer, *dest_buffer;
+    gsize src_read, dest_read, i;
+    goffset offset;
+    gboolean res;
+
+    info = g_file_query_info (source, G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                              cancellable, error);
+    if (info == NULL) {
+        return FALSE;
+    }
+
+    res = g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR;
+    g_object_unref (info);
+    if (res) {
+        return TRUE;
+    }
+
+    src_stream = g_file_read (source, cancellable, error);
+    if (src_stream == NULL) {
+        return FALSE;
+    }
+
+    dest_stream = g_file_read (destination, cancellable, error);
+    if (dest_stream == NULL) {
+        g_object_unref (src_stream);
+        return FALSE;
+    }
+
+    src_buffer = g_malloc (VERIFY_BLOCK_SIZE);
+    dest_buffer = g_malloc (VERIFY_BLOCK_SIZE);
+
+    res = FALSE;
+    offset = 0;
+    for (;;) {
+        if (!g_input_stream_read_all (G_INPUT_STREAM (src_stream), src_buffer, VERIFY_BLOCK_SIZE,
+                                      &src_read, cancellable, error) ||
+            !g_input_stream_read_all (G_INPUT_STREAM (dest_stream), dest_buffer, VERIFY_BLOCK_SIZE,
+                                      &dest_read, cancellable, error)) {
+            break;
+        }
+
+        if (src_read != dest_read || memcmp (src_buffer, dest_buffer, src_read) != 0) {
+            for (i = 0; i < MIN (src_read, dest_read) && src_buffer[i] == dest_buffer[i]; i++) {
+                /* Find the first difference */
+            }
+            set_mismatch_error (error, offset + i);
+            break;
+        }
+
+        if (src_read == 0) {
+            res = TRUE;
+            break;
+        }
+
+        offset += src_read;
+    }
+
+    g_free (src_buffer);
+    g_free (dest_buffer);
+    g_input_stream_close (G_INPUT_STREAM (src_stream), NULL, NULL);
+    g_input_stream_close (G_INPUT_STREAM (dest_stream), NULL, NULL);
+    g_object_unref (src_stream);
+    g_object_unref (dest_stream);
+
+    return res;
+}
+
+/**
+ * marlin_file_verify:
+ *
+ * Checks that @destination holds the same data as @source. A copy that differs fails with
+ * G_IO_ERROR_FAILED. Sources which are not regular files always pass.
+ */
+gboolean
+marlin_file_verify (GFile         *source,
+                    GFile         *destination,
+                    GCancellable  *cancellable,
+                    GError       **error)
+{
+    int res;
+
+    res = verify_local (source, destination, cancellable, error);
+    if (res < 0) {
+        res = verify_streams (source, destination, cancellable, error);
+    }
+
+    return res;
+}
+
+static void
+verify_item_free (VerifyItem *item)
+{
+    g_object_unref (item->source);
+    g_object_unref (item->destination);
+    g_clear_error (&item->error);
+    g_slice_free (VerifyItem, item);
+}
+
+/* Whether @source is on a network filesystem. Copies come a folder at a time, so the answer for the
+ * folder of the last source is kept */
+static gboolean
+verifier_source_is_remote (MarlinFileVerifier *verifier,
+                           GFile *source)
+{
+    GFileInfo *info;
+    GFile *dir;
+
+    dir = g_file_get_parent (source);
+    if (dir != NULL && verifier->last_dir != NULL && g_file_equal (dir, verifier->last_dir)) {
+        g_object_unref (dir);
+        return verifier->last_dir_remote;
+    }
+
+    g_clear_object (&verifier->last_dir);
+    verifier->last_dir = dir;
+    verifier->last_dir_remote = FALSE;
+
+    info = g_file_query_filesystem_info (source, G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE,
+                                         verifier->cancellable, NULL);
+    if (info != NULL) {
+        verifier->last_dir_remote = g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE);
+        g_object_unref (info);
+    }
+
+    return verifier->last_dir_remote;
+}
+
+static void
+verifier_thread (gpointer data,
+                 gpointer user_data)
+{
+    VerifyItem *item = data;
+    MarlinFileVerifier *verifier = user_data;
+    gboolean verified;
+
+    verified = !g_cancellable_is_cancelled (verifier->cancellable) &&
+               (verifier_source_is_remote (verifier, item->source) ||
+                marlin_file_verify (item->source, item->destination,
+                                    verifier->cancellable, &item->error));
+
+    g_mutex_lock (&verifier->mutex);
+    if (verified) {
+        verify_item_free (item);
+    } else if (item->error != NULL && !g_error_matches (item->error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_queue_push_tail (&verifier->failures, item);
+    } else {
+        verify_item_free (item);
+    }
+
+    verifier->n_checked++;
+    verifier->pending--;
+    g_cond_broadcast (&verifier->cond);
+    g_mutex_unlock (&verifier->mutex);
+}
+
+/**
+ * marlin_file_verifier_new:
+ *
+ * Creates a verifier which checks the copies pushed to it one after the other, on a thread of its own.
+ */
+MarlinFileVerifier *
+marlin_file_verifier_new (GCancellable *cancellable)
+{
+    MarlinFileVerifier *verifier;
+
+    verifier = g_slice_new0 (MarlinFileVerifier);
+    verifier->cancellable = cancellable != NULL ? g_object_ref (cancellable) : NULL;
+    g_mutex_init (&verifier->mutex);
+    g_cond_init (&verifier->cond);
+    g_queue_init (&verifier->failures);
+    verifier->thread = g_thread_pool_new (verifier_thread, verifier, 1, FALSE, NULL);
+
+    return verifier;
+}
+
+/* Waits for the copies being checked, and drops the failures nobody asked for */
+void
+marlin_file_verifier_free (MarlinFileVerifier *verifier)
+{
+    g_thread_pool_free (verifier->thread, FALSE, TRUE);
+
+    g_queue_foreach (&verifier->failures, (GFunc) verify_item_free, NULL);
+    g_queue_clear (&verifier->failures);
+
+    g_clear_object (&verifier->last_dir);
+    g_clear_object (&verifier->cancellable);
+    g_mutex_clear (&verifier->mutex);
+    g_cond_clear (&verifier->cond);
+    g_slice_free (MarlinFileVerifier, verifier);
+}
+
+/* Queues @destination to be checked against @source. @flags are handed back with the failure if it
+ * does not match. Waits while too many copies are queued */
+void
+marlin_file_verifier_push (MarlinFileVerifier *verifier,
+                           GFile *source,
+                           GFile *destination,
+                           GFileCopyFlags flags)
+{
+    VerifyItem *item;
+
+    g_mutex_lock (&verifier->mutex);
+    while (verifier->pending >= VERIFY_MAX_QUEUED) {
+        g_cond_wait (&verifier->cond, &verifier->mutex);
+    }
+    verifier->pending++;
+    verifier->n_pushed++;
+    g_mutex_unlock (&verifier->mutex);
+
+    item = g_slice_new0 (VerifyItem);
+    item->source = g_object_ref (source);
+    item->destination = g_object_ref (destination);
+    item->flags = flags;
+
+    g_thread_pool_push (verifier->thread, item, NULL);
+}
+
+/* Waits at most @timeout_usec for the copies pushed so far to be checked, or for one to fail.
+ * Returns TRUE when none is left to check */
+gboolean
+marlin_file_verifier_wait (MarlinFileVerifier *verifier,
+                           gint64 timeout_usec)
+{
+    gint64 end_time;
+    gboolean done;
+
+    end_time = g_get_monotonic_time () + timeout_usec;
+
+    g_mutex_lock (&verifier->mutex);
+    while (verifier->pending > 0 && g_queue_is_empty (&verifier->failures) &&
+           g_cond_wait_until (&verifier->cond, &verifier->mutex, end_time)) {
+        /* Another copy was checked and did not fail */
+    }
+    done = verifier->pending == 0;
+    g_mutex_unlock (&verifier->mutex);
+
+    return done;
+}
+
+/* Takes the next copy found to differ from its original, or that could not be read back.
+ * Returns FALSE when there is none so far */
+gboolean
+marlin_file_verifier_pop_failure (MarlinFileVerifier  *verifier,
+                                  GFile              **source,
+                                  GFile              **destination,
+                                  GFileCopyFlags      *flags,
+                                  GError             **error)
+{
+    VerifyItem *item;
+
+    g_mutex_lock (&verifier->mutex);
+    item = g_queue_pop_head (&verifier->failures);
+    g_mutex_unlock (&verifier->mutex);
+
+    if (item == NULL) {
+        return FALSE;
+    }
+
+    *source = g_object_ref (item->source);
+    *destination = g_object_ref (item->destination);
+    *flags = item->flags;
+    g_propagate_error (error, item->error);
+    item->error = NULL;
+    verify_item_free (item);
+
+    return TRUE;
+}
+
+/* Gets how many of the copies pushed so far were checked */
+void
+marlin_file_verifier_get_counts (MarlinFileVerifier *verifier,
+                                 guint64 *n_checked,
+                                 guint64 *n_pushed)
+{
+    g_mutex_lock (&verifier->mutex);
+    *n_checked = verifier->n_checked;
+    *n_pushed = verifier->n_pushed;
+    g_mutex_unlock (&verifier->mutex);
+}
@@ -0,0 +1,50 @@
+/* marlin-file-verify.h - checking copies against their originals
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+#ifndef MARLIN_FILE_VERIFY_H
+#define MARLIN_FILE_VERIFY_H
+
+#include <gio/gio.h>
+
+typedef struct _MarlinFileVerifier MarlinFileVerifier;
+
+gboolean            marlin_file_verify                  (GFile                  *source,
+                                                         GFile                  *destination,
+                                                         GCancellable           *cancellable,
+                                                         GError                **error);
+
+MarlinFileVerifier *marlin_file_verifier_new            (GCancellable           *cancellable);
+void                marlin_file_verifier_free           (MarlinFileVerifier     *verifier);
+void                marlin_file_verifier_push           (MarlinFileVerifier     *verifier,
+                                                         GFile                  *source,
+                                                         GFile                  *destination,
+                                                         GFileCopyFlags          flags);
+gboolean            marlin_file_verifier_wait           (MarlinFileVerifier     *verifier,
+                                                         gint64                  timeout_usec);
+gboolean            marlin_file_verifier_pop_failure    (MarlinFileVerifier     *verifier,
+                                                         GFile                 **source,
+                                                         GFile                 **destination,
+                                                         GFileCopyFlags         *flags,
+                                                         GError                **error);
+void                marlin_file_verifier_get_counts     (MarlinFileVerifier     *verifier,
+                                                         guint64                *n_checked,
+                                                         guint64                *n_pushed);
+
+#endif /* MARLIN_FILE_VERIFY_H */
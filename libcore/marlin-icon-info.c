@@ -37,6 +37,13 @@ struct _MarlinIconInfo
       GdkPoint        *attach_points;*/
     char            *display_name;
     char            *icon_name;
+
+    /* cache bookkeeping, only valid while the icon is in one of the caches */
+    GHashTable      *cache;
+    gpointer        cache_key;
+    GList           *cache_link;
+    gint            cache_generation;
+    gsize           cache_bytes;
 };
 
 struct _MarlinIconInfoClass
@@ -46,6 +53,8 @@ struct _MarlinIconInfoClass
 
 static void schedule_reap_cache (void);
 
+G_LOCK_DEFINE_STATIC (icon_cache_mutex);
+
 G_DEFINE_TYPE (MarlinIconInfo, marlin_icon_info, G_TYPE_OBJECT);
 
 /** This is required for testing themed icon functions under ctest when there is no default screen and
@@ -95,8 +104,10 @@ pixbuf_toggle_notify (gpointer info, GObject *object, gboolean is_last_ref)
         /*g_object_remove_toggle_ref (object,
           pixbuf_toggle_notify,
           info);*/
+        G_LOCK (icon_cache_mutex);
         icon->last_use_time = g_get_monotonic_time ();
         schedule_reap_cache ();
+        G_UNLOCK (icon_cache_mutex);
     }
 }
 
@@ -200,69 +211,181 @@ typedef struct {
     int size;
 } ThemedIconKey;
 
+/* The icon caches are bounded by a byte budget. Cached icons are kept in two LRU
+ * generations shared by both tables: new icons enter the young generation and are
+ * promoted to the old one when they are looked up again. Under memory pressure the
+ * young generation is evicted first, so that thumbnails seen only once while
+ * scrolling do not push out the icons which are used all the time.
+ *
+ * Icons whose pixbuf is still referenced outside the cache are never evicted; they
+ * are given a second chance at the head of the old generation instead. Eviction
+ * and the reaping of unused icons only ever look at a bounded number of entries per
+ * step, so that neither causes a noticeable stall on the main thread.
+ */
+enum {
+    CACHE_GENERATION_YOUNG,
+    CACHE_GENERATION_OLD,
+    N_CACHE_GENERATIONS
+};
+
+#define ICON_CACHE_DEFAULT_BUDGET (64 * 1024 * 1024)
+#define ICON_CACHE_MAX_EVICT_STEPS 32
+#define ICON_CACHE_MAX_REAP_STEPS 64
+
 static GHashTable *loadable_icon_cache = NULL;
 static GHashTable *themed_icon_cache = NULL;
 static guint reap_cache_timeout = 0;
 
+static GQueue   cache_generations[N_CACHE_GENERATIONS] = { G_QUEUE_INIT, G_QUEUE_INIT };
+static guint64  cache_budget = ICON_CACHE_DEFAULT_BUDGET;
+static guint64  cache_bytes = 0;
+static guint64  cache_hits = 0;
+static guint64  cache_misses = 0;
+static guint64  cache_evictions = 0;
+
 #define MICROSEC_PER_SEC ((guint64)1000000L)
 
-static guint64 time_now;
+/* The value destroy function of both caches, called with icon_cache_mutex held */
+static void destroy_cache_entry (MarlinIconInfo *icon_info)
+{
+    g_return_if_fail (icon_info != NULL);
+
+    if (icon_info->cache_link != NULL) {
+        g_queue_delete_link (&cache_generations[icon_info->cache_generation], icon_info->cache_link);
+        icon_info->cache_link = NULL;
+        icon_info->cache = NULL;
+        icon_info->cache_key = NULL;
+        cache_bytes -= icon_info->cache_bytes;
+        icon_info->cache_bytes = 0;
+    }
+
+    g_clear_object (&icon_info);
+}
+
+/* Must be called with icon_cache_mutex held */
+static void
+cache_entry_link (MarlinIconInfo *icon, GHashTable *cache, gpointer key)
+{
+    icon->cache = cache;
+    icon->cache_key = key;
+    icon->cache_generation = CACHE_GENERATION_YOUNG;
+    icon->cache_bytes = icon->pixbuf != NULL ? gdk_pixbuf_get_byte_length (icon->pixbuf) : 0;
+    cache_bytes += icon->cache_bytes;
+    g_queue_push_head (&cache_generations[CACHE_GENERATION_YOUNG], icon);
+    icon->cache_link = g_queue_peek_head_link (&cache_generations[CACHE_GENERATION_YOUNG]);
+}
+
+/* Must be called with icon_cache_mutex held. Moves the icon to the head of @generation */
+static void
+cache_entry_promote (MarlinIconInfo *icon, gint generation)
+{
+    if (icon->cache_link == NULL)
+        return;
+
+    g_queue_unlink (&cache_generations[icon->cache_generation], icon->cache_link);
+    icon->cache_generation = generation;
+    g_queue_push_head_link (&cache_generations[generation], icon->cache_link);
+}
 
 static gboolean
-reap_old_icon (LoadableIconKey *key, gpointer value, gpointer user_info)
+cache_entry_in_use (MarlinIconInfo *icon)
 {
-    MarlinIconInfo *icon;
-    gboolean *reapable_icons_left = user_info;
+    /* The cache's toggle reference is the only one left */
+    return icon->pixbuf != NULL && G_OBJECT (icon->pixbuf)->ref_count > 1;
+}
 
-    g_return_val_if_fail (value != NULL && MARLIN_IS_ICON_INFO (value), TRUE);
+/* Must be called with icon_cache_mutex held. Drops the cache's reference to @icon */
+static void
+cache_entry_evict (MarlinIconInfo *icon)
+{
+    g_hash_table_remove (icon->cache, icon->cache_key);
+    cache_evictions++;
+}
 
-    icon = (MarlinIconInfo *) value;
-    //g_return_val_if_fail (icon->pixbuf != NULL && GDK_IS_PIXBUF (icon->pixbuf), TRUE);
+/* Must be called with icon_cache_mutex held. Returns the least recently used icon,
+ * taken from the young generation first.
+ */
+static MarlinIconInfo *
+cache_tail_entry (void)
+{
+    gint generation;
 
-    /*char *str_icon = g_icon_to_string (key->icon);
-    g_message ("%s %s %d %u\n", G_STRFUNC, str_icon, key->size, G_OBJECT (icon->pixbuf)->ref_count);
-    g_free (str_icon);*/
-    /* sole owner */
-    if (icon->pixbuf && G_IS_OBJECT (icon->pixbuf) && G_OBJECT (icon->pixbuf)->ref_count == 1) {
-        if (time_now - icon->last_use_time > 30 * MICROSEC_PER_SEC) {
-            /* This went unused 30 secs ago. reap */
-            return TRUE;
-        } else {
-            /* We can reap this soon */
-            *reapable_icons_left = TRUE;
-        }
+    for (generation = CACHE_GENERATION_YOUNG; generation < N_CACHE_GENERATIONS; generation++) {
+        if (!g_queue_is_empty (&cache_generations[generation]))
+            return g_queue_peek_tail (&cache_generations[generation]);
     }
 
-    return FALSE;
+    return NULL;
 }
 
-static gboolean
-reap_cache (gpointer data)
+/* Must be called with icon_cache_mutex held. @keep, the entry just added if any, is not evicted */
+static void
+evict_over_budget (MarlinIconInfo *keep)
 {
-    gboolean reapable_icons_left;
+    MarlinIconInfo *icon;
+    guint steps = 0;
 
-    reapable_icons_left = TRUE;
+    while (cache_bytes > cache_budget && steps++ < ICON_CACHE_MAX_EVICT_STEPS) {
+        icon = cache_tail_entry ();
+        if (icon == NULL)
+            break;
 
-    time_now = g_get_monotonic_time ();
+        if (icon == keep || cache_entry_in_use (icon))
+            cache_entry_promote (icon, CACHE_GENERATION_OLD); /* second chance */
+        else
+            cache_entry_evict (icon);
+    }
 
-    if (loadable_icon_cache) {
-        g_hash_table_foreach_remove (loadable_icon_cache,
-                                     (GHRFunc) reap_old_icon,
-                                     &reapable_icons_left);
+    /* Let the reaper finish the job if we had to stop early */
+    if (cache_bytes > cache_budget)
+        schedule_reap_cache ();
+}
+
+/* Looks at the least recently used entries of both generations and evicts those which
+ * went unused for 30 secs, or which exceed the budget. Called periodically while there
+ * are reapable icons left.
+ */
+static gboolean
+reap_cache (gpointer data)
+{
+    MarlinIconInfo *icon;
+    GQueue skipped = G_QUEUE_INIT;
+    gboolean reapable_icons_left = FALSE;
+    guint64 time_now = g_get_monotonic_time ();
+    guint steps = 0;
+
+    G_LOCK (icon_cache_mutex);
+
+    while (steps++ < ICON_CACHE_MAX_REAP_STEPS && (icon = cache_tail_entry ()) != NULL) {
+        if (cache_entry_in_use (icon)) {
+            cache_entry_promote (icon, CACHE_GENERATION_OLD);
+        } else if (cache_bytes > cache_budget ||
+                   time_now - icon->last_use_time > 30 * MICROSEC_PER_SEC) {
+            /* This went unused 30 secs ago or we need the space. reap */
+            cache_entry_evict (icon);
+        } else {
+            /* We can reap this soon. Keep it out of the way of the next entries for now */
+            g_queue_unlink (&cache_generations[icon->cache_generation], icon->cache_link);
+            g_queue_push_tail_link (&skipped, icon->cache_link);
+            reapable_icons_left = TRUE;
+        }
     }
 
-    if (themed_icon_cache) {
-        g_hash_table_foreach_remove (themed_icon_cache,
-                                     (GHRFunc) reap_old_icon,
-                                     &reapable_icons_left);
+    /* Put the skipped entries back where they were, at the tail of their generation */
+    while ((icon = g_queue_peek_tail (&skipped)) != NULL) {
+        GList *link = g_queue_pop_tail_link (&skipped);
+        g_queue_push_tail_link (&cache_generations[icon->cache_generation], link);
     }
 
-    if (reapable_icons_left) {
-        return TRUE;
-    } else {
+    if (steps > ICON_CACHE_MAX_REAP_STEPS || cache_bytes > cache_budget)
+        reapable_icons_left = TRUE;
+
+    if (!reapable_icons_left)
         reap_cache_timeout = 0;
-        return FALSE;
-    }
+
+    G_UNLOCK (icon_cache_mutex);
+
+    return reapable_icons_left;
 }
 
 static void
@@ -278,6 +401,8 @@ schedule_reap_cache (void)
 void
 marlin_icon_info_clear_caches (void)
 {
+    G_LOCK (icon_cache_mutex);
+
     if (loadable_icon_cache) {
         g_hash_table_remove_all (loadable_icon_cache);
     }
@@ -285,6 +410,51 @@ marlin_icon_info_clear_caches (void)
     if (themed_icon_cache) {
         g_hash_table_remove_all (themed_icon_cache);
     }
+
+    G_UNLOCK (icon_cache_mutex);
+}
+
+/**
+ * marlin_icon_info_set_cache_budget:
+ * @max_bytes : the number of bytes of pixbufs the icon caches may hold, 0 for unlimited.
+ **/
+void
+marlin_icon_info_set_cache_budget (guint64 max_bytes)
+{
+    G_LOCK (icon_cache_mutex);
+    cache_budget = max_bytes > 0 ? max_bytes : G_MAXUINT64;
+    evict_over_budget (NULL);
+    G_UNLOCK (icon_cache_mutex);
+}
+
+/**
+ * marlin_icon_info_get_cache_stats:
+ * @n_entries   : (out) (allow-none): number of cached icons.
+ * @n_bytes     : (out) (allow-none): number of bytes of pixbufs held by the caches.
+ * @n_hits      : (out) (allow-none): number of lookups served from the caches.
+ * @n_misses    : (out) (allow-none): number of lookups which had to load the icon.
+ * @n_evictions : (out) (allow-none): number of icons evicted or reaped from the caches.
+ **/
+void
+marlin_icon_info_get_cache_stats (guint   *n_entries,
+                                  guint64 *n_bytes,
+                                  guint64 *n_hits,
+                                  guint64 *n_misses,
+                                  guint64 *n_evictions)
+{
+    G_LOCK (icon_cache_mutex);
+    if (n_entries != NULL)
+        *n_entries = g_queue_get_length (&cache_generations[CACHE_GENERATION_YOUNG]) +
+                     g_queue_get_length (&cache_generations[CACHE_GENERATION_OLD]);
+    if (n_bytes != NULL)
+        *n_bytes = cache_bytes;
+    if (n_hits != NULL)
+        *n_hits = cache_hits;
+    if (n_misses != NULL)
+        *n_misses = cache_misses;
+    if (n_evictions != NULL)
+        *n_evictions = cache_evictions;
+    G_UNLOCK (icon_cache_mutex);
 }
 
 static guint
@@ -353,12 +523,6 @@ themed_icon_key_free (ThemedIconKey *key)
     g_slice_free (ThemedIconKey, key);
 }
 
-static void destroy_cache_entry (MarlinIconInfo *icon_info)
-{
-    g_return_if_fail (icon_info != NULL);
-    g_clear_object (&icon_info);
-}
-
 #if 0
 GdkPixbuf *
 test_get_pixbuf_at_size_from_raw_pixbuf (GdkPixbuf *pixbuf, gsize forced_size);
@@ -402,6 +566,7 @@ marlin_icon_info_lookup (GIcon *icon, int size)
         LoadableIconKey lookup_key;
         LoadableIconKey *key;
 
+        G_LOCK (icon_cache_mutex);
         if (loadable_icon_cache == NULL) {
             loadable_icon_cache =
                 g_hash_table_new_full ((GHashFunc)loadable_icon_key_hash,
@@ -416,8 +581,16 @@ marlin_icon_info_lookup (GIcon *icon, int size)
         icon_info = g_hash_table_lookup (loadable_icon_cache, &lookup_key);
         if (icon_info != NULL) {
             //g_message ("CACHED %s stream %s\n", G_STRFUNC, g_icon_to_string (icon));
-            return g_object_ref (icon_info);
+            cache_hits++;
+            cache_entry_promote (icon_info, CACHE_GENERATION_OLD);
+            icon_info->last_use_time = g_get_monotonic_time ();
+            g_object_ref (icon_info);
+            G_UNLOCK (icon_cache_mutex);
+            return icon_info;
         }
+
+        cache_misses++;
+        G_UNLOCK (icon_cache_mutex);
 #if 0
 
         /* get the raw pixbuf */
@@ -459,9 +632,13 @@ marlin_icon_info_lookup (GIcon *icon, int size)
         if (pixbuf != NULL) {
             icon_info = marlin_icon_info_new_for_pixbuf (pixbuf);
             key = loadable_icon_key_new (icon, size);
-            g_hash_table_insert (loadable_icon_cache, key, g_object_ref (icon_info));
-            g_free (str_icon);
+            G_LOCK (icon_cache_mutex);
+            g_hash_table_replace (loadable_icon_cache, key, g_object_ref (icon_info));
+            cache_entry_link (icon_info, loadable_icon_cache, key);
+            evict_over_budget (icon_info);
+            G_UNLOCK (icon_cache_mutex);
         }
+        g_free (str_icon);
 //#endif
 
         return icon_info;
@@ -473,13 +650,15 @@ marlin_icon_info_lookup (GIcon *icon, int size)
         GtkIconInfo *gtkicon_info;
         const char *filename;
 
+        G_LOCK (icon_cache_mutex);
         if (themed_icon_cache == NULL) {
             themed_icon_cache =
                 g_hash_table_new_full ((GHashFunc)themed_icon_key_hash,
                                        (GEqualFunc)themed_icon_key_equal,
                                        (GDestroyNotify) themed_icon_key_free,
-                                       (GDestroyNotify) g_object_unref);
+                                       (GDestroyNotify) destroy_cache_entry);
         }
+        G_UNLOCK (icon_cache_mutex);
 
         names = g_themed_icon_get_names (G_THEMED_ICON (icon));
 
@@ -499,22 +678,35 @@ marlin_icon_info_lookup (GIcon *icon, int size)
         lookup_key.filename = (char *)filename;
         lookup_key.size = size;
 
+        G_LOCK (icon_cache_mutex);
         icon_info = g_hash_table_lookup (themed_icon_cache, &lookup_key);
         if (icon_info) {
             //g_message ("CACHED %s themed icon %s\n", G_STRFUNC, filename);
+            cache_hits++;
+            cache_entry_promote (icon_info, CACHE_GENERATION_OLD);
+            icon_info->last_use_time = g_get_monotonic_time ();
+            g_object_ref (icon_info);
+            G_UNLOCK (icon_cache_mutex);
             gtk_icon_info_free (gtkicon_info);
-            return g_object_ref (icon_info);
+            return icon_info;
         }
 
+        cache_misses++;
+        G_UNLOCK (icon_cache_mutex);
+
         icon_info = marlin_icon_info_new_for_icon_info (gtkicon_info);
         //g_critical ("%s themed icon %s size %d\n", G_STRFUNC, gtk_icon_info_get_filename (gtkicon_info), size);
 
         key = themed_icon_key_new (filename, size);
-        g_hash_table_insert (themed_icon_cache, key, icon_info);
+        G_LOCK (icon_cache_mutex);
+        g_hash_table_replace (themed_icon_cache, key, g_object_ref (icon_info));
+        cache_entry_link (icon_info, themed_icon_cache, key);
+        evict_over_budget (icon_info);
+        G_UNLOCK (icon_cache_mutex);
 
         gtk_icon_info_free (gtkicon_info);
 
-        return g_object_ref (icon_info);
+        return icon_info;
     } else {
         GtkIconInfo *gtk_icon_info;
 
@@ -734,11 +926,16 @@ void marlin_icon_info_remove_cache (const char *path, int size)
     GIcon *icon;
     LoadableIconKey *lookup_key;
 
+    if (loadable_icon_cache == NULL)
+        return;
+
     icon_file = g_file_new_for_path (path);
     icon = g_file_icon_new (icon_file);
     lookup_key = loadable_icon_key_new (icon, size);
 
+    G_LOCK (icon_cache_mutex);
     g_hash_table_remove (loadable_icon_cache, lookup_key);
+    G_UNLOCK (icon_cache_mutex);
 
     g_object_unref (icon_file);
     g_object_unref (icon);
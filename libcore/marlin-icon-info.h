@@ -65,6 +65,12 @@ GdkPixbuf *         marlin_icon_info_get_pixbuf_at_size         (MarlinIconInfo
 
 void                marlin_icon_info_clear_caches               (void);
 void                marlin_icon_info_remove_cache               (const char *path, int size);
+void                marlin_icon_info_set_cache_budget           (guint64 max_bytes);
+void                marlin_icon_info_get_cache_stats            (guint          *n_entries,
+                                                                 guint64        *n_bytes,
+                                                                 guint64        *n_hits,
+                                                                 guint64        *n_misses,
+                                                                 guint64        *n_evictions);
 
 G_END_DECLS
 
@@ -0,0 +1,152 @@
+/* marlin-path-list.c - compact lists of paths
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+/* Keeps a list of paths in a single buffer rather than one allocation each. Paths that were copied or
+ * moved together mostly share their start with the path before them, so every path only stores how
+ * many bytes it has in common with the previous one, as a variable length number, followed by the
+ * rest of it and a NUL. Paths can only be appended, and read back in order through an iterator.
+ */
+
+#include "marlin-path-list.h"
+
+#include <string.h>
+
+struct _MarlinPathList {
+    GByteArray *data;
+    /* The last path appended, to find what the next one shares with it */
+    GString *last;
+    guint length;
+};
+
+MarlinPathList *
+marlin_path_list_new (void)
+{
+    MarlinPathList *list;
+
+    list = g_slice_new0 (MarlinPathList);
+    list->data = g_byte_array_new ();
+    list->last = g_string_new (NULL);
+
+    return list;
+}
+
+void
+marlin_path_list_free (MarlinPathList *list)
+{
+    if (list == NULL) {
+        return;
+    }
+
+    g_byte_array_free (list->data, TRUE);
+    g_string_free (list->last, TRUE);
+    g_slice_free (MarlinPathList, list);
+}
+
+void
+marlin_path_list_append (MarlinPathList *list,
+                         const char *path)
+{
+    gsize shared, len;
+    guint8 byte;
+
+    len = strlen (path);
+    for (shared = 0; shared < len && shared < list->last->len; shared++) {
+        if (path[shared] != list->last->str[shared]) {
+            break;
+        }
+    }
+
+    /* Seven bits at a time, the high bit set on all bytes but the last */
+    len = shared;
+    do {
+        byte = len & 0x7f;
+        len >>= 7;
+        if (len != 0) {
+            byte |= 0x80;
+        }
+        g_byte_array_append (list->data, &byte, 1);
+    } while (len != 0);
+
+    g_byte_array_append (list->data, (const guint8 *) path + shared, strlen (path + shared) + 1);
+
+    g_string_truncate (list->last, shared);
+    g_string_append (list->last, path + shared);
+    list->length++;
+}
+
+guint
+marlin_path_list_get_length (MarlinPathList *list)
+{
+    return list->length;
+}
+
+/* Returns the number of bytes @list takes */
+gsize
+marlin_path_list_get_size (MarlinPathList *list)
+{
+    return sizeof (MarlinPathList) + list->data->len + list->last->allocated_len;
+}
+
+void
+marlin_path_list_iter_init (MarlinPathListIter *iter,
+                            MarlinPathList *list)
+{
+    iter->list = list;
+    iter->offset = 0;
+    iter->path = g_string_new (NULL);
+}
+
+/* Returns the next path, which stays valid until the following call, or NULL after the last one */
+const char *
+marlin_path_list_iter_next (MarlinPathListIter *iter)
+{
+    const guint8 *data;
+    const char *rest;
+    gsize shared;
+    guint shift;
+
+    if (iter->list == NULL || iter->offset >= iter->list->data->len) {
+        return NULL;
+    }
+
+    data = iter->list->data->data;
+
+    shared = 0;
+    shift = 0;
+    do {
+        shared |= (gsize) (data[iter->offset] & 0x7f) << shift;
+        shift += 7;
+    } while (data[iter->offset++] & 0x80);
+
+    rest = (const char *) data + iter->offset;
+    iter->offset += strlen (rest) + 1;
+
+    g_string_truncate (iter->path, shared);
+    g_string_append (iter->path, rest);
+
+    return iter->path->str;
+}
+
+void
+marlin_path_list_iter_clear (MarlinPathListIter *iter)
+{
+    g_string_free (iter->path, TRUE);
+    iter->path = NULL;
+}
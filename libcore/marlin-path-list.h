@@ -0,0 +1,46 @@
+/* marlin-path-list.h - compact lists of paths
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+#ifndef MARLIN_PATH_LIST_H
+#define MARLIN_PATH_LIST_H
+
+#include <glib.h>
+
+typedef struct _MarlinPathList MarlinPathList;
+
+typedef struct {
+    MarlinPathList *list;
+    guint offset;
+    GString *path;
+} MarlinPathListIter;
+
+MarlinPathList *marlin_path_list_new            (void);
+void            marlin_path_list_free           (MarlinPathList         *list);
+void            marlin_path_list_append         (MarlinPathList         *list,
+                                                 const char             *path);
+guint           marlin_path_list_get_length     (MarlinPathList         *list);
+gsize           marlin_path_list_get_size       (MarlinPathList         *list);
+
+void            marlin_path_list_iter_init      (MarlinPathListIter     *iter,
+                                                 MarlinPathList         *list);
+const char     *marlin_path_list_iter_next      (MarlinPathListIter     *iter);
+void            marlin_path_list_iter_clear     (MarlinPathListIter     *iter);
+
+#endif /* MARLIN_PATH_LIST_H */
@@ -37,6 +37,11 @@ enum {
 };
 
 #define SIGNAL_DELAY_MSEC 100
+#define SAMPLE_INTERVAL_MSEC 100
+
+/* Job threads only store counts, with relaxed atomics as each count is read on its own */
+#define COUNT_SET(p, v) __atomic_store_n ((p), (v), __ATOMIC_RELAXED)
+#define COUNT_GET(p) __atomic_load_n ((p), __ATOMIC_RELAXED)
 
 static guint signals[LAST_SIGNAL] = { 0 };
 
@@ -56,6 +61,17 @@ struct _MarlinProgressInfo
     gboolean started;
     gboolean finished;
     gboolean paused;
+    gboolean queued;
+
+    /* Written by the job thread without taking the lock */
+    guint64 files_done;
+    guint64 bytes_done;
+    guint64 files_total;
+    guint64 bytes_total;
+
+    /* Main loop only */
+    MarlinProgressInfoSampleFunc sample_func;
+    gpointer sample_data;
 
     GSource *idle_source;
     gboolean source_is_now;
@@ -73,6 +89,10 @@ struct _MarlinProgressInfoClass
 
 G_LOCK_DEFINE_STATIC(progress_info);
 
+/* Infos with a sample function, and the timeout calling them. Main loop only */
+static GList *sampled_infos = NULL;
+static guint sample_source_id = 0;
+
 G_DEFINE_TYPE (MarlinProgressInfo, marlin_progress_info, G_TYPE_OBJECT)
 
 static void
@@ -87,6 +107,8 @@ marlin_progress_info_finalize (GObject *object)
     g_free (info->details);
     g_object_unref (info->cancellable);
 
+    g_assert (info->sample_func == NULL);
+
     if (G_OBJECT_CLASS (marlin_progress_info_parent_class)->finalize) {
         (*G_OBJECT_CLASS (marlin_progress_info_parent_class)->finalize) (object);
     }
@@ -354,6 +376,20 @@ marlin_progress_info_get_is_paused (MarlinProgressInfo *info)
     return res;
 }
 
+gboolean
+marlin_progress_info_get_is_queued (MarlinProgressInfo *info)
+{
+    gboolean res;
+
+    G_LOCK (progress_info);
+
+    res = info->queued;
+
+    G_UNLOCK (progress_info);
+
+    return res;
+}
+
 static gboolean
 idle_callback (gpointer data)
 {
@@ -479,6 +515,23 @@ marlin_progress_info_resume (MarlinProgressInfo *info)
     G_UNLOCK (progress_info);
 }
 
+/* A queued operation has started, but waits for others to finish before doing anything */
+void
+marlin_progress_info_set_queued (MarlinProgressInfo *info,
+                                 gboolean queued)
+{
+    G_LOCK (progress_info);
+
+    if (info->queued != queued) {
+        info->queued = queued;
+
+        info->changed_at_idle = TRUE;
+        queue_idle (info, FALSE);
+    }
+
+    G_UNLOCK (progress_info);
+}
+
 void
 marlin_progress_info_start (MarlinProgressInfo *info)
 {
@@ -631,3 +684,89 @@ marlin_progress_info_set_progress (MarlinProgressInfo *info,
 
     G_UNLOCK (progress_info);
 }
+
+/* Counts of work done and to do, which job threads may update as often as they like: these are
+ * only stored here, and turned into text and progress by the sample function on the main loop */
+void
+marlin_progress_info_set_counts (MarlinProgressInfo *info,
+                                 guint64 files_done,
+                                 guint64 bytes_done)
+{
+    COUNT_SET (&info->files_done, files_done);
+    COUNT_SET (&info->bytes_done, bytes_done);
+}
+
+void
+marlin_progress_info_set_totals (MarlinProgressInfo *info,
+                                 guint64 files_total,
+                                 guint64 bytes_total)
+{
+    COUNT_SET (&info->files_total, files_total);
+    COUNT_SET (&info->bytes_total, bytes_total);
+}
+
+void
+marlin_progress_info_get_counts (MarlinProgressInfo *info,
+                                 guint64 *files_done,
+                                 guint64 *bytes_done,
+                                 guint64 *files_total,
+                                 guint64 *bytes_total)
+{
+    *files_done = COUNT_GET (&info->files_done);
+    *bytes_done = COUNT_GET (&info->bytes_done);
+    *files_total = COUNT_GET (&info->files_total);
+    *bytes_total = COUNT_GET (&info->bytes_total);
+}
+
+static gboolean
+sample_infos (gpointer data)
+{
+    MarlinProgressInfo *info;
+    GList *l;
+
+    for (l = sampled_infos; l != NULL; l = l->next) {
+        info = l->data;
+        info->sample_func (info, info->sample_data);
+
+        /* Already on the main loop, so there is no point in delaying the signals further */
+        G_LOCK (progress_info);
+        if (info->idle_source != NULL && !info->source_is_now) {
+            queue_idle (info, TRUE);
+        }
+        G_UNLOCK (progress_info);
+    }
+
+    if (sampled_infos == NULL) {
+        sample_source_id = 0;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * marlin_progress_info_set_sample_func:
+ * @func: (allow-none): called on the main loop ten times a second, or %NULL to stop sampling
+ *
+ * All infos are sampled from a single timeout, where @func is expected to read the counts and update
+ * the status, details and progress. Must be called on the main loop.
+ */
+void
+marlin_progress_info_set_sample_func (MarlinProgressInfo *info,
+                                      MarlinProgressInfoSampleFunc func,
+                                      gpointer user_data)
+{
+    if (info->sample_func == NULL && func != NULL) {
+        sampled_infos = g_list_prepend (sampled_infos, g_object_ref (info));
+    } else if (info->sample_func != NULL && func == NULL) {
+        sampled_infos = g_list_remove (sampled_infos, info);
+        g_object_unref (info);
+    }
+
+    info->sample_func = func;
+    info->sample_data = user_data;
+
+    if (sampled_infos != NULL && sample_source_id == 0) {
+        sample_source_id = g_timeout_add (SAMPLE_INTERVAL_MSEC, sample_infos, NULL);
+    }
+}
@@ -38,6 +38,9 @@
 typedef struct _MarlinProgressInfo      MarlinProgressInfo;
 typedef struct _MarlinProgressInfoClass MarlinProgressInfoClass;
 
+typedef void (* MarlinProgressInfoSampleFunc) (MarlinProgressInfo *info,
+                                               gpointer            user_data);
+
 GType marlin_progress_info_get_type (void) G_GNUC_CONST;
 
 /* Signals:
@@ -63,6 +66,7 @@ void          marlin_progress_info_cancel          (MarlinProgressInfo *info);
 gboolean      marlin_progress_info_get_is_started  (MarlinProgressInfo *info);
 gboolean      marlin_progress_info_get_is_finished (MarlinProgressInfo *info);
 gboolean      marlin_progress_info_get_is_paused   (MarlinProgressInfo *info);
+gboolean      marlin_progress_info_get_is_queued   (MarlinProgressInfo *info);
 double        marlin_progress_info_get_current     (MarlinProgressInfo *info);
 double        marlin_progress_info_get_total       (MarlinProgressInfo *info);
 
@@ -70,6 +74,8 @@ void          marlin_progress_info_start           (MarlinProgressInfo *info);
 void          marlin_progress_info_finish          (MarlinProgressInfo *info);
 void          marlin_progress_info_pause           (MarlinProgressInfo *info);
 void          marlin_progress_info_resume          (MarlinProgressInfo *info);
+void          marlin_progress_info_set_queued      (MarlinProgressInfo *info,
+                                                    gboolean            queued);
 void          marlin_progress_info_set_status      (MarlinProgressInfo *info,
                                                     const char         *status);
 void          marlin_progress_info_take_status     (MarlinProgressInfo *info,
@@ -83,6 +89,21 @@ void          marlin_progress_info_set_progress    (MarlinProgressInfo *info,
                                                     double             total);
 void          marlin_progress_info_pulse_progress  (MarlinProgressInfo *info);
 
+void          marlin_progress_info_set_counts      (MarlinProgressInfo *info,
+                                                    guint64             files_done,
+                                                    guint64             bytes_done);
+void          marlin_progress_info_set_totals      (MarlinProgressInfo *info,
+                                                    guint64             files_total,
+                                                    guint64             bytes_total);
+void          marlin_progress_info_get_counts      (MarlinProgressInfo *info,
+                                                    guint64            *files_done,
+                                                    guint64            *bytes_done,
+                                                    guint64            *files_total,
+                                                    guint64            *bytes_total);
+void          marlin_progress_info_set_sample_func (MarlinProgressInfo           *info,
+                                                    MarlinProgressInfoSampleFunc  func,
+                                                    gpointer                      user_data);
+
 
 
 #endif /* MARLIN_PROGRESS_INFO_H */
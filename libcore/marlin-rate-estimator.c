@@ -0,0 +1,165 @@
+/* marlin-rate-estimator.c - smoothed transfer rates and time left
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+/* The rate of a transfer changes a lot over its course: many small files go at a few files per second
+ * whatever their size, large files at the speed of the device, which itself drops once its caches are
+ * full. The bytes and files done per second are therefore tracked separately, each as an exponentially
+ * weighted moving average of the rate between two samples, so that older samples count for less and
+ * less. Weights depend on the time between samples rather than on their number, so the estimates do
+ * not depend on how often they are sampled.
+ *
+ * Each rate alone gives a time left which is too short when the other one is what holds the transfer
+ * back, so the longer of the two is taken.
+ */
+
+#include "marlin-rate-estimator.h"
+
+#include <math.h>
+
+/* Samples older than this count for about a third of the ones just taken */
+#define RATE_TIME_CONSTANT 4.0
+/* No time left is given before the rates have been sampled over this long */
+#define RATE_SECONDS_NEEDED 2.0
+
+struct _MarlinRateEstimator {
+    gboolean started;
+    double start_time;
+    double last_time;
+    guint64 last_bytes;
+    guint64 last_files;
+
+    gboolean has_rate;
+    double bytes_per_sec;
+    double files_per_sec;
+};
+
+MarlinRateEstimator *
+marlin_rate_estimator_new (void)
+{
+    return g_slice_new0 (MarlinRateEstimator);
+}
+
+void
+marlin_rate_estimator_free (MarlinRateEstimator *estimator)
+{
+    g_slice_free (MarlinRateEstimator, estimator);
+}
+
+/* Adds the counts of work done after @elapsed seconds. Samples are expected in order; when the time or
+ * the counts go back (e.g. the timer was restarted) the estimator starts over from that sample. */
+void
+marlin_rate_estimator_add_sample (MarlinRateEstimator *estimator,
+                                  double elapsed,
+                                  guint64 bytes_done,
+                                  guint64 files_done)
+{
+    double dt, alpha, bytes_rate, files_rate;
+
+    if (!estimator->started ||
+        elapsed < estimator->last_time ||
+        bytes_done < estimator->last_bytes ||
+        files_done < estimator->last_files) {
+        estimator->started = TRUE;
+        estimator->start_time = elapsed;
+        estimator->last_time = elapsed;
+        estimator->last_bytes = bytes_done;
+        estimator->last_files = files_done;
+        estimator->has_rate = FALSE;
+        estimator->bytes_per_sec = 0;
+        estimator->files_per_sec = 0;
+        return;
+    }
+
+    dt = elapsed - estimator->last_time;
+    if (dt <= 0) {
+        /* Stopped timer, e.g. while a dialog is shown */
+        return;
+    }
+
+    bytes_rate = (bytes_done - estimator->last_bytes) / dt;
+    files_rate = (files_done - estimator->last_files) / dt;
+
+    if (!estimator->has_rate) {
+        estimator->bytes_per_sec = bytes_rate;
+        estimator->files_per_sec = files_rate;
+        estimator->has_rate = TRUE;
+    } else {
+        alpha = 1.0 - exp (-dt / RATE_TIME_CONSTANT);
+        estimator->bytes_per_sec += alpha * (bytes_rate - estimator->bytes_per_sec);
+        estimator->files_per_sec += alpha * (files_rate - estimator->files_per_sec);
+    }
+
+    estimator->last_time = elapsed;
+    estimator->last_bytes = bytes_done;
+    estimator->last_files = files_done;
+}
+
+double
+marlin_rate_estimator_get_bytes_per_sec (MarlinRateEstimator *estimator)
+{
+    return estimator->bytes_per_sec;
+}
+
+double
+marlin_rate_estimator_get_files_per_sec (MarlinRateEstimator *estimator)
+{
+    return estimator->files_per_sec;
+}
+
+/* Stores in @seconds_left how long it should take to transfer @bytes_left and @files_left at the
+ * current rates. Returns %FALSE while there are not enough samples for that, or when nothing left has
+ * ever been seen moving (e.g. only empty files were copied so far and some bytes are left). */
+gboolean
+marlin_rate_estimator_get_time_left (MarlinRateEstimator *estimator,
+                                     guint64 bytes_left,
+                                     guint64 files_left,
+                                     double *seconds_left)
+{
+    gboolean known;
+    double seconds;
+
+    if (!estimator->has_rate ||
+        estimator->last_time - estimator->start_time < RATE_SECONDS_NEEDED) {
+        return FALSE;
+    }
+
+    known = FALSE;
+    seconds = 0;
+
+    if (bytes_left > 0 && estimator->bytes_per_sec > 0) {
+        seconds = MAX (seconds, bytes_left / estimator->bytes_per_sec);
+        known = TRUE;
+    }
+
+    if (files_left > 0 && estimator->files_per_sec > 0) {
+        seconds = MAX (seconds, files_left / estimator->files_per_sec);
+        known = TRUE;
+    }
+
+    if (bytes_left == 0 && files_left == 0) {
+        known = TRUE;
+    }
+
+    if (known) {
+        *seconds_left = seconds;
+    }
+
+    return known;
+}
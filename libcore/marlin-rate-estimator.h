@@ -0,0 +1,42 @@
+/* marlin-rate-estimator.h - smoothed transfer rates and time left
+ *
+ * Copyright (c) 2017 elementary LLC (http://launchpad.net/elementary)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, Inc.,; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1335 USA.
+ */
+
+#ifndef MARLIN_RATE_ESTIMATOR_H
+#define MARLIN_RATE_ESTIMATOR_H
+
+#include <glib.h>
+
+typedef struct _MarlinRateEstimator MarlinRateEstimator;
+
+MarlinRateEstimator *marlin_rate_estimator_new                (void);
+void                 marlin_rate_estimator_free               (MarlinRateEstimator *estimator);
+
+void                 marlin_rate_estimator_add_sample         (MarlinRateEstimator *estimator,
+                                                               double               elapsed,
+                                                               guint64              bytes_done,
+                                                               guint64              files_done);
+double               marlin_rate_estimator_get_bytes_per_sec  (MarlinRateEstimator *estimator);
+double               marlin_rate_estimator_get_files_per_sec  (MarlinRateEstimator *estimator);
+gboolean             marlin_rate_estimator_get_time_left      (MarlinRateEstimator *estimator,
+                                                               guint64              bytes_left,
+                                                               guint64              files_left,
+                                                               double              *seconds_left);
+
+#endif /* MARLIN_RATE_ESTIMATOR_H */
@@ -31,6 +31,10 @@
 #include <gdk/gdk.h>
 #include "eel-glib-extensions.h"
 #include "marlin-file-changes-queue.h"
+#include "marlin-path-list.h"
+
+/* Beyond this, the oldest actions are dropped even when there are fewer than the undo levels */
+#define UNDO_MAX_MEMORY (32 * 1024 * 1024)
 
 struct _MarlinUndoActionData
 {
@@ -45,8 +49,8 @@ struct _MarlinUndoActionData
     /* Copy / Move stuff */
     GFile *src_dir;
     GFile *dest_dir;
-    GList *sources;               /* Relative to src_dir */
-    GList *destinations;          /* Relative to dest_dir */
+    MarlinPathList *sources;      /* Relative to src_dir */
+    MarlinPathList *destinations; /* Relative to dest_dir */
 
     /* Cached labels/descriptions */
     char *undo_label;
@@ -63,10 +67,11 @@ struct _MarlinUndoActionData
     char *new_uri;
 
     /* Trash stuff */
-    GHashTable *trashed;
+    MarlinPathList *trashed;      /* Original uris */
+    GArray *trashed_mtimes;       /* Modification time of each of them */
 
     /* Recursive change permissions stuff */
-    GHashTable *original_permissions;
+    MarlinPermissionsUndo *original_permissions;
     guint32 dir_mask;
     guint32 dir_permissions;
     guint32 file_mask;
@@ -140,6 +145,8 @@ G_DEFINE_TYPE (MarlinUndoManager, marlin_undo_manager, G_TYPE_OBJECT);
    Private methods prototypes
 ***************************************************************** */
 
+static void stack_free_action (MarlinUndoActionData *action);
+
 static void stack_clear_n_oldest (GQueue *stack, guint n);
 
 static void stack_fix_size (MarlinUndoManagerPrivate *priv);
@@ -194,11 +201,11 @@ static void clear_redo_actions (MarlinUndoManagerPrivate *priv);
 
 static gchar *get_first_target_short_name (MarlinUndoActionData *action);
 
-static GList *construct_gfile_list (const GList *urilist, GFile *parent);
+static GList *construct_gfile_list (MarlinPathList *paths, GFile *parent);
 
 static GList *construct_gfile_list_from_uri (char *uri);
 
-static GList *uri_list_to_gfile_list (GList *urilist);
+static GList *uri_list_to_gfile_list (MarlinPathList *uris);
 
 static char *get_uri_basename (char *uri);
 
@@ -208,7 +215,7 @@ static char *get_uri_parent_path (char *uri);
 
 static GFile *get_file_parent_from_uri (char *uri);
 
-static GHashTable *retrieve_files_to_restore (GHashTable *trashed);
+static GHashTable *retrieve_files_to_restore (MarlinUndoActionData *action);
 
 /* *****************************************************************
    Base functions
@@ -484,13 +491,11 @@ marlin_undo_manager_redo (MarlinUndoManager *manager,
             g_object_unref (fparent);
             break;
         case MARLIN_UNDO_MOVETOTRASH:
-            if (g_hash_table_size (action->trashed) > 0) {
-                GList *uri_to_trash = g_hash_table_get_keys (action->trashed);
-                uris = uri_list_to_gfile_list (uri_to_trash);
+            if (marlin_path_list_get_length (action->trashed) > 0) {
+                uris = uri_list_to_gfile_list (action->trashed);
                 priv->undo_redo_flag = TRUE;
                 marlin_file_operations_trash_or_delete
                     (uris, NULL, undo_redo_done_delete_callback, action);
-                g_list_free (uri_to_trash);
                 g_list_free_full (uris, g_object_unref);
             }
             break;
@@ -500,13 +505,6 @@ marlin_undo_manager_redo (MarlinUndoManager *manager,
                                          action->dest_dir, NULL, undo_redo_done_transfer_callback, action);
             g_list_free_full (uris, g_object_unref);
             break;
-#if 0
-        case MARLIN_UNDO_SETPERMISSIONS:
-            file = gof_file_get_by_uri (action->target_uri);
-            marlin_file_set_permissions (file,
-                                         action->new_permissions, undo_redo_done_rename_callback, action);
-            g_object_unref (file);
-            break;
         case MARLIN_UNDO_RECURSIVESETPERMISSIONS:
             puri = g_file_get_uri (action->dest_dir);
             marlin_file_set_permissions_recursive (puri,
@@ -516,6 +514,13 @@ marlin_undo_manager_redo (MarlinUndoManager *manager,
                                                    action->dir_mask, undo_redo_op_callback, action);
             g_free (puri);
             break;
+#if 0
+        case MARLIN_UNDO_SETPERMISSIONS:
+            file = gof_file_get_by_uri (action->target_uri);
+            marlin_file_set_permissions (file,
+                                         action->new_permissions, undo_redo_done_rename_callback, action);
+            g_object_unref (file);
+            break;
         case MARLIN_UNDO_CHANGEGROUP:
             file = gof_file_get_by_uri (action->target_uri);
             marlin_file_set_group (file,
@@ -585,25 +590,12 @@ marlin_undo_manager_undo (MarlinUndoManager *manager,
             if (priv->confirm_delete) {
                 marlin_file_operations_delete (uris, NULL,
                                                undo_redo_done_delete_callback, action);
-                g_list_free_full (uris, g_object_unref);
             } else {
-                /* We skip the confirmation message
-                */
-                GList *f;
-                for (f = uris; f != NULL; f = f->next) {
-                    char *name;
-                    name = g_file_get_uri (f->data);
-                    g_free (name);
-                    g_file_delete (f->data, NULL, NULL);
-                    marlin_file_changes_queue_file_removed (f->data);
-                    g_object_unref (f->data);
-                }
-                g_list_free (uris);
-                marlin_file_changes_consume_changes (TRUE);
-
-                /* Here we must do what's necessary for the callback */
-                undo_redo_done_transfer_callback (NULL, action);
+                /* We skip the confirmation message */
+                marlin_file_operations_delete_without_confirm (uris,
+                                                               undo_redo_done_delete_callback, action);
             }
+            g_list_free_full (uris, g_object_unref);
             break;
         case MARLIN_UNDO_RESTOREFROMTRASH:
             uris = construct_gfile_list (action->destinations, action->dest_dir);
@@ -612,7 +604,7 @@ marlin_undo_manager_undo (MarlinUndoManager *manager,
             g_list_free_full (uris, g_object_unref);
             break;
         case MARLIN_UNDO_MOVETOTRASH:
-            files_to_restore = retrieve_files_to_restore (action->trashed);
+            files_to_restore = retrieve_files_to_restore (action);
             if (g_hash_table_size (files_to_restore) > 0) {
                 GList *l;
                 GList *gfiles_in_trash = g_hash_table_get_keys (files_to_restore);
@@ -655,6 +647,16 @@ marlin_undo_manager_undo (MarlinUndoManager *manager,
                                                  action);
             break;
 
+        case MARLIN_UNDO_RECURSIVESETPERMISSIONS:
+            if (action->original_permissions != NULL &&
+                marlin_permissions_undo_get_n_entries (action->original_permissions) > 0) {
+                marlin_file_restore_permissions (action->dest_dir, action->original_permissions,
+                                                 undo_redo_op_callback, action);
+            } else {
+                /* Here we must do what's necessary for the callback */
+                undo_redo_done_transfer_callback (NULL, action);
+            }
+            break;
 #if 0
         case MARLIN_UNDO_SETPERMISSIONS:
             file = gof_file_get_by_uri (action->target_uri);
@@ -663,30 +665,6 @@ marlin_undo_manager_undo (MarlinUndoManager *manager,
                                          undo_redo_done_rename_callback, action);
             g_object_unref (file);
             break;
-        case MARLIN_UNDO_RECURSIVESETPERMISSIONS:
-            if (g_hash_table_size (action->original_permissions) > 0) {
-                GList *gfiles_list =
-                    g_hash_table_get_keys (action->original_permissions);
-                guint32 *perm;
-                GList *l;
-                GFile *dest;
-                char *item;
-
-                for (l = gfiles_list; l != NULL; l = l->next) {
-                    item = l->data;
-                    perm = g_hash_table_lookup (action->original_permissions, item);
-                    dest = g_file_new_for_uri (item);
-                    g_file_set_attribute_uint32 (dest,
-                                                 G_FILE_ATTRIBUTE_UNIX_MODE,
-                                                 *perm, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, NULL);
-                    g_object_unref (dest);
-                }
-
-                g_list_free (gfiles_list);
-                /* Here we must do what's necessary for the callback */
-                undo_redo_done_transfer_callback (NULL, action);
-            }
-            break;
         case MARLIN_UNDO_CHANGEGROUP:
             file = gof_file_get_by_uri (action->target_uri);
             marlin_file_set_group (file,
@@ -757,87 +735,102 @@ marlin_undo_manager_add_rename_action (MarlinUndoManager* manager,
     marlin_undo_manager_add_action (manager, data);
 }
 
-static GList *
-get_all_trashed_items (GQueue *stack)
+/* Whether anything @action left in its destination was moved to the trash since, going by the
+ * original uris of the files trashed in @trashed */
+static gboolean
+destinations_were_trashed (MarlinUndoActionData *action,
+                           GHashTable *trashed)
 {
-    MarlinUndoActionData *action = NULL;
-    GList *trash = NULL;
-    GList *keys;
-    GList *l;
-    GQueue *tmp_stack = g_queue_copy(stack);
-
-    while ((action = (MarlinUndoActionData *) g_queue_pop_tail (tmp_stack)) != NULL) {
-        if (action->trashed) {
-            keys = g_hash_table_get_keys (action->trashed);
-            for (l = keys; l != NULL; l=l->next) {
-                trash = g_list_prepend(trash, l->data);
-            }
-            g_list_free (keys);
-        }
+    MarlinPathListIter iter;
+    GHashTableIter trashed_iter;
+    GHashTable *destinations;
+    const char *path;
+    gpointer uri;
+    char *dest_uri, *prefix, *relative;
+    gboolean found;
+
+    dest_uri = g_file_get_uri (action->dest_dir);
+    if (g_str_has_suffix (dest_uri, "/")) {
+        prefix = dest_uri;
+    } else {
+        prefix = g_strconcat (dest_uri, "/", NULL);
+        g_free (dest_uri);
     }
 
-    g_queue_free (tmp_stack);
-    return (trash);
-}
+    /* The destinations are only gone through when something was trashed from that folder */
+    destinations = NULL;
+    found = FALSE;
+    g_hash_table_iter_init (&trashed_iter, trashed);
+    while (!found && g_hash_table_iter_next (&trashed_iter, &uri, NULL)) {
+        if (!g_str_has_prefix (uri, prefix)) {
+            continue;
+        }
 
-static gboolean
-is_destination_uri_action_partof_trashed(GList *trash, GList *g)
-{
-    GList *l;
-    char *uri;
-
-    for (l = trash; l != NULL; l=l->next) {
-        for (; g != NULL; g=g->next) {
-            //printf ("destinations: %s\n", g_file_get_uri(l->data));
-            uri = g_file_get_uri(g->data);
-            if (!strcmp (uri, l->data)) {
-                //printf ("GG %s\nZZ %s\n", uri, l->data);
-                g_free (uri);
-                return TRUE;
+        if (destinations == NULL) {
+            destinations = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+            marlin_path_list_iter_init (&iter, action->destinations);
+            while ((path = marlin_path_list_iter_next (&iter)) != NULL) {
+                g_hash_table_add (destinations, g_strdup (path));
             }
-            g_free (uri);
+            marlin_path_list_iter_clear (&iter);
         }
+
+        relative = g_uri_unescape_string ((char *) uri + strlen (prefix), NULL);
+        found = relative != NULL && g_hash_table_contains (destinations, relative);
+        g_free (relative);
     }
 
-    return FALSE;
+    if (destinations != NULL) {
+        g_hash_table_destroy (destinations);
+    }
+    g_free (prefix);
+
+    return found;
 }
+
 /** ****************************************************************
  * Callback after emptying the trash
 ** ****************************************************************/
 void
 marlin_undo_manager_trash_has_emptied (MarlinUndoManager *manager)
 {
-    //amtest
-    //printf("%s\n", G_STRFUNC);
     MarlinUndoManagerPrivate *priv = manager->priv;
+    MarlinUndoActionData *action;
+    MarlinPathListIter iter;
+    GHashTable *trashed;
+    GList *actions, *l;
+    const char *uri;
 
-    /* Clear actions from the oldest to the newest move to trash */
     g_mutex_lock (&priv->mutex);
     clear_redo_actions (priv);
-    MarlinUndoActionData *action = NULL;
-
-    GList *g;
-    GQueue *tmp_stack = g_queue_copy(priv->stack);
-    GList *trash = get_all_trashed_items (tmp_stack);
-    while ((action = (MarlinUndoActionData *) g_queue_pop_tail (tmp_stack)) != NULL)
-    {
-        if (action->destinations && action->dest_dir) {
-            /* what a pain rebuild again and again an uri
-            ** TODO change the struct add uri elements */
-            g = construct_gfile_list (action->destinations, action->dest_dir);
-            /* remove action for trashed item uris == destination action */
-            if (is_destination_uri_action_partof_trashed(trash, g)) {
-                g_queue_remove (priv->stack, action);
-                continue;
+
+    /* Everything moved to the trash is gone now */
+    trashed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    for (l = priv->stack->head; l != NULL; l = l->next) {
+        action = l->data;
+        if (action->trashed != NULL) {
+            marlin_path_list_iter_init (&iter, action->trashed);
+            while ((uri = marlin_path_list_iter_next (&iter)) != NULL) {
+                g_hash_table_add (trashed, g_strdup (uri));
             }
+            marlin_path_list_iter_clear (&iter);
         }
-        if (action->type == MARLIN_UNDO_MOVETOTRASH) {
-            //printf ("detected MARLIN_UNDO_MOVETOTRASH\n");
+    }
+
+    /* So are the actions that trashed it, and those that made what was trashed */
+    actions = g_list_copy (priv->stack->head);
+    for (l = actions; l != NULL; l = l->next) {
+        action = l->data;
+        if (action->type == MARLIN_UNDO_MOVETOTRASH ||
+            (g_hash_table_size (trashed) > 0 && action->destinations != NULL && action->dest_dir != NULL &&
+             destinations_were_trashed (action, trashed))) {
             g_queue_remove (priv->stack, action);
+            stack_free_action (action);
         }
     }
 
-    g_queue_free (tmp_stack);
+    g_list_free (actions);
+    g_hash_table_destroy (trashed);
     g_mutex_unlock (&priv->mutex);
     do_menu_update (manager);
 }
@@ -879,7 +872,8 @@ marlin_undo_manager_data_new (MarlinUndoActionType type, gint items_count)
     data->count = items_count;
 
     if (type == MARLIN_UNDO_MOVETOTRASH) {
-        data->trashed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+        data->trashed = marlin_path_list_new ();
+        data->trashed_mtimes = g_array_new (FALSE, FALSE, sizeof (guint64));
     }
     //undotest
     /*else if (type == MARLIN_UNDO_RECURSIVESETPERMISSIONS) {
@@ -927,11 +921,23 @@ marlin_undo_manager_data_add_origin_target_pair (MarlinUndoActionData *data,
         return;
 
     char *src_relative = g_file_get_relative_path (data->src_dir, origin);
-    data->sources = g_list_prepend (data->sources, src_relative);
     char *dest_relative = g_file_get_relative_path (data->dest_dir, target);
-    data->destinations = g_list_prepend (data->destinations, dest_relative);
 
-    data->is_valid = TRUE;
+    /* Files outside of the folders of the action cannot be recorded relative to them */
+    if (src_relative != NULL && dest_relative != NULL) {
+        if (data->sources == NULL) {
+            data->sources = marlin_path_list_new ();
+            data->destinations = marlin_path_list_new ();
+        }
+
+        marlin_path_list_append (data->sources, src_relative);
+        marlin_path_list_append (data->destinations, dest_relative);
+
+        data->is_valid = TRUE;
+    }
+
+    g_free (src_relative);
+    g_free (dest_relative);
 }
 
 /** ****************************************************************
@@ -945,36 +951,30 @@ marlin_undo_manager_data_add_trashed_file (MarlinUndoActionData *data,
     if (!data)
         return;
 
-    guint64 *modification_time = g_new (guint64, 1);
-    *modification_time = mtime;
-
     char *original_uri = g_file_get_uri (file);
-    //amtest
-    //printf ("[trash] orig uri %s\n", originalURI);
 
-    g_hash_table_insert (data->trashed, original_uri, modification_time);
+    marlin_path_list_append (data->trashed, original_uri);
+    g_array_append_val (data->trashed_mtimes, mtime);
+
+    g_free (original_uri);
 
     data->is_valid = TRUE;
 }
 
 /** ****************************************************************
- * Pushes a recursive permission change data in an existing undo data container
+ * Hands the modes a recursive permission change replaced to an existing
+ * undo data container, which frees them with the action
 ** ****************************************************************/
 void
-marlin_undo_manager_data_add_file_permissions (MarlinUndoActionData *data,
-                                               GFile *file,
-                                               guint32 permission)
+marlin_undo_manager_data_take_original_permissions (MarlinUndoActionData *data,
+                                                    MarlinPermissionsUndo *original_permissions)
 {
-    if (!data)
+    if (!data) {
+        marlin_permissions_undo_free (original_permissions);
         return;
+    }
 
-    guint32 *currentPermission = g_new (guint32, 1);
-    *currentPermission = permission;
-
-    char *originalURI = g_file_get_uri (file);
-
-    g_hash_table_insert (data->original_permissions, originalURI,
-                         currentPermission);
+    data->original_permissions = original_permissions;
 
     data->is_valid = TRUE;
 }
@@ -1129,6 +1129,18 @@ stack_scroll_left (MarlinUndoManagerPrivate *priv)
     return data;
 }
 
+/** ---------------------------------------------------------------- */
+static void
+stack_free_action (MarlinUndoActionData *action)
+{
+    /* An action being undone or redone is freed once that is done */
+    if (action->locked) {
+        action->freed = TRUE;
+    } else {
+        free_undo_action (action, NULL);
+    }
+}
+
 /** ---------------------------------------------------------------- */
 static void
 stack_clear_n_oldest (GQueue *stack, guint n)
@@ -1139,11 +1151,43 @@ stack_clear_n_oldest (GQueue *stack, guint n)
     for (i = 0; i < n; i++) {
         if ((action = (MarlinUndoActionData *) g_queue_pop_tail (stack)) == NULL)
             break;
-        if (action->locked) {
-            action->freed = TRUE;
-        } else {
-            free_undo_action (action, NULL);
-        }
+        stack_free_action (action);
+    }
+}
+
+/** ---------------------------------------------------------------- */
+static gsize
+get_action_size (MarlinUndoActionData *action)
+{
+    gsize size = sizeof (MarlinUndoActionData);
+
+    if (action->sources)
+        size += marlin_path_list_get_size (action->sources);
+    if (action->destinations)
+        size += marlin_path_list_get_size (action->destinations);
+    if (action->trashed)
+        size += marlin_path_list_get_size (action->trashed) +
+                action->trashed_mtimes->len * sizeof (guint64);
+
+    return size;
+}
+
+/** ---------------------------------------------------------------- */
+static void
+stack_fix_memory (MarlinUndoManagerPrivate *priv)
+{
+    GList *l;
+    gsize total;
+
+    total = 0;
+    for (l = priv->stack->head; l != NULL; l = l->next) {
+        total += get_action_size (l->data);
+    }
+
+    /* The newest action is kept whatever its size */
+    while (total > UNDO_MAX_MEMORY && g_queue_get_length (priv->stack) > 1) {
+        total -= get_action_size (g_queue_peek_tail (priv->stack));
+        stack_clear_n_oldest (priv->stack, 1);
     }
 }
 
@@ -1190,17 +1234,20 @@ stack_push_action (MarlinUndoManagerPrivate *priv,
     if (length > priv->undo_levels) {
         stack_fix_size (priv);
     }
+
+    stack_fix_memory (priv);
 }
 
 /** ---------------------------------------------------------------- */
 static gchar *
 get_first_target_short_name (MarlinUndoActionData *action)
 {
-    GList *targets_first;
+    MarlinPathListIter iter;
     gchar *file_name;
 
-    targets_first = g_list_first (action->destinations);
-    file_name = (gchar *) g_strdup (targets_first->data);
+    marlin_path_list_iter_init (&iter, action->destinations);
+    file_name = g_strdup (marlin_path_list_iter_next (&iter));
+    marlin_path_list_iter_clear (&iter);
 
     return file_name;
 }
@@ -1272,21 +1319,21 @@ get_undo_description (MarlinUndoActionData *action)
                 break;
             case MARLIN_UNDO_MOVETOTRASH:
                 {
-                    count = g_hash_table_size (action->trashed);
+                    count = marlin_path_list_get_length (action->trashed);
                     if (count != 1) {
                         description =
                             g_strdup_printf (_("Restore %d items from trash"), count);
                     } else {
-                        GList *keys = g_hash_table_get_keys (action->trashed);
-                        GList *first = g_list_first (keys);
-                        char *item = (char *) first->data;
+                        MarlinPathListIter iter;
+                        marlin_path_list_iter_init (&iter, action->trashed);
+                        char *item = (char *) marlin_path_list_iter_next (&iter);
                         char *name = get_uri_basename (item);
                         char *orig_path = get_uri_parent_path (item);
                         description =
                             g_strdup_printf (_("Restore '%s' to '%s'"), name, orig_path);
                         g_free (name);
                         g_free (orig_path);
-                        g_list_free (keys);
+                        marlin_path_list_iter_clear (&iter);
                     }
                 }
                 break;
@@ -1452,17 +1499,17 @@ get_redo_description (MarlinUndoActionData * action)
                 break;
             case MARLIN_UNDO_MOVETOTRASH:
                 {
-                    count = g_hash_table_size (action->trashed);
+                    count = marlin_path_list_get_length (action->trashed);
                     if (count != 1) {
                         description = g_strdup_printf (_("Move %d items to trash"), count);
                     } else {
-                        GList *keys = g_hash_table_get_keys (action->trashed);
-                        GList *first = g_list_first (keys);
-                        char *item = (char *) first->data;
+                        MarlinPathListIter iter;
+                        marlin_path_list_iter_init (&iter, action->trashed);
+                        char *item = (char *) marlin_path_list_iter_next (&iter);
                         char *name = get_uri_basename (item);
                         description = g_strdup_printf (_("Move '%s' to trash"), name);
                         g_free (name);
-                        g_list_free (keys);
+                        marlin_path_list_iter_clear (&iter);
                     }
                 }
                 break;
@@ -1805,21 +1852,16 @@ free_undo_action (gpointer data, gpointer user_data)
     g_free (action->new_group_name_or_id);
     g_free (action->new_user_name_or_id);
 
-    if (action->sources) {
-        g_list_foreach (action->sources, (GFunc) g_free, NULL);
-        g_list_free (action->sources);
-    }
-    if (action->destinations) {
-        g_list_foreach (action->destinations, (GFunc) g_free, NULL);
-        g_list_free (action->destinations);
-    }
+    marlin_path_list_free (action->sources);
+    marlin_path_list_free (action->destinations);
 
-    if (action->trashed) {
-        g_hash_table_destroy (action->trashed);
+    marlin_path_list_free (action->trashed);
+    if (action->trashed_mtimes) {
+        g_array_free (action->trashed_mtimes, TRUE);
     }
 
     if (action->original_permissions) {
-        g_hash_table_destroy (action->original_permissions);
+        marlin_permissions_undo_free (action->original_permissions);
     }
 
     if (action->src_dir)
@@ -1935,18 +1977,24 @@ do_menu_update (MarlinUndoManager *manager)
 
 /** ---------------------------------------------------------------- */
 static GList *
-construct_gfile_list (const GList * urilist, GFile * parent)
+construct_gfile_list (MarlinPathList * paths, GFile * parent)
 {
-    const GList *l;
+    MarlinPathListIter iter;
+    const char *path;
     GList *file_list = NULL;
     GFile *file;
 
-    for (l = urilist; l != NULL; l = l->next) {
-        file = g_file_get_child (parent, l->data);
+    if (paths == NULL)
+        return NULL;
+
+    marlin_path_list_iter_init (&iter, paths);
+    while ((path = marlin_path_list_iter_next (&iter)) != NULL) {
+        file = g_file_get_child (parent, path);
         file_list = g_list_prepend (file_list, file);
     }
+    marlin_path_list_iter_clear (&iter);
 
-    return file_list;
+    return g_list_reverse (file_list);
 }
 
 /** ---------------------------------------------------------------- */
@@ -1964,16 +2012,19 @@ construct_gfile_list_from_uri (char *uri)
 
 /** ---------------------------------------------------------------- */
 static GList *
-uri_list_to_gfile_list (GList * urilist)
+uri_list_to_gfile_list (MarlinPathList * uris)
 {
-    const GList *l;
+    MarlinPathListIter iter;
+    const char *uri;
     GList *file_list = NULL;
     GFile *file;
 
-    for (l = urilist; l != NULL; l = l->next) {
-        file = g_file_new_for_uri (l->data);
+    marlin_path_list_iter_init (&iter, uris);
+    while ((uri = marlin_path_list_iter_next (&iter)) != NULL) {
+        file = g_file_new_for_uri (uri);
         file_list = g_list_prepend (file_list, file);
     }
+    marlin_path_list_iter_clear (&iter);
 
     return file_list;
 }
@@ -2024,8 +2075,12 @@ get_file_parent_from_uri (char *uri)
 
 /** ---------------------------------------------------------------- */
 static GHashTable *
-retrieve_files_to_restore (GHashTable * trashed)
+retrieve_files_to_restore (MarlinUndoActionData * action)
 {
+    MarlinPathListIter iter;
+    GHashTable *trashed;
+    const char *uri;
+    guint i;
     GFileEnumerator *enumerator;
     GFileInfo *info;
     GFile *trash;
@@ -2042,6 +2097,18 @@ retrieve_files_to_restore (GHashTable * trashed)
         g_hash_table_new_full (g_direct_hash,
                                g_direct_equal, g_object_unref, g_free);
 
+    if (marlin_path_list_get_length (action->trashed) == 0)
+        return to_restore;
+
+    /* Original uris to their modification times, only for as long as the trash is gone through */
+    trashed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    marlin_path_list_iter_init (&iter, action->trashed);
+    for (i = 0; (uri = marlin_path_list_iter_next (&iter)) != NULL; i++) {
+        g_hash_table_insert (trashed, g_strdup (uri),
+                             &g_array_index (action->trashed_mtimes, guint64, i));
+    }
+    marlin_path_list_iter_clear (&iter);
+
     trash = g_file_new_for_uri ("trash:");
 
     enumerator = g_file_enumerate_children (trash,
@@ -2050,15 +2117,6 @@ retrieve_files_to_restore (GHashTable * trashed)
                                             G_FILE_ATTRIBUTE_TIME_MODIFIED
                                             ",trash::orig-path", G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, FALSE, NULL);
 
-    mtime = 0;
-
-
-    //amtest
-    /*guint nb;
-      GList *l;*/
-    if (!(g_hash_table_size (trashed)) > 0)
-        return NULL;
-
     if (enumerator) {
         while ((info =
                 g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL) {
@@ -2081,16 +2139,20 @@ retrieve_files_to_restore (GHashTable * trashed)
                     if (*mtime == mtime_item) {
                         item = g_file_get_child (trash, g_file_info_get_name (info)); /* File in the trash */
                         g_hash_table_insert (to_restore, item, origuri);
+                    } else {
+                        g_free (origuri);
                     }
                 } else {
                     g_free (origuri);
                 }
             }
+            g_object_unref (info);
         }
         g_file_enumerator_close (enumerator, FALSE, NULL);
         g_object_unref (enumerator);
     }
     g_object_unref (trash);
+    g_hash_table_destroy (trashed);
 
     return to_restore;
 }
@@ -27,6 +27,7 @@
 #include <glib-object.h>
 #include <gtk/gtk.h>
 #include <gio/gio.h>
+#include "marlin-file-permissions.h"
 
 
 typedef enum
@@ -160,7 +161,7 @@ marlin_undo_manager_data_add_trashed_file (MarlinUndoActionData* data, GFile* fi
 marlin_undo_manager_request_menu_update (MarlinUndoManager* manager);*/
 
 void
-marlin_undo_manager_data_add_file_permissions (MarlinUndoActionData* data, GFile* file, guint32 permission);
+marlin_undo_manager_data_take_original_permissions (MarlinUndoActionData* data, MarlinPermissionsUndo* original_permissions);
 
 void
 marlin_undo_manager_data_set_recursive_permissions (MarlinUndoActionData* data, guint32 file_permissions, guint32 file_mask, guint32 dir_permissions, guint32 dir_mask);
@@ -0,0 +1,103 @@
+/*
+* Copyright (c) 2017 elementary LLC
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 3 of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+* Boston, MA 02111-1307, USA.
+*/
+
+string test_dir;
+
+string get_contents (string path) {
+    string contents;
+    try {
+        FileUtils.get_contents (path, out contents);
+    } catch (FileError e) {
+        error (e.message);
+    }
+
+    return contents;
+}
+
+Marlin.FileCopyMethod copy_file (string source_path, string destination_path) {
+    Marlin.FileCopyMethod method;
+    try {
+        assert (MarlinFile.copy (File.new_for_path (source_path), File.new_for_path (destination_path),
+                                 FileCopyFlags.NONE, null, null, out method));
+    } catch (Error e) {
+        error (e.message);
+    }
+
+    return method;
+}
+
+void add_file_copy_tests () {
+    Test.add_func ("/FileCopy/regular", () => {
+        var builder = new StringBuilder ();
+        while (builder.len < 3 * 1024 * 1024) {
+            builder.append ("line %u\n".printf ((uint) builder.len));
+        }
+
+        var source = Path.build_filename (test_dir, "regular");
+        var copy = source + ".copy";
+        try {
+            FileUtils.set_contents (source, builder.str);
+        } catch (FileError e) {
+            error (e.message);
+        }
+
+        copy_file (source, copy);
+        assert (get_contents (copy) == builder.str);
+    });
+
+    Test.add_func ("/FileCopy/pseudo_files", () => {
+        /* Their size is made up: /sys reports 4096 bytes and reads a few, /proc reports none. The kernel
+         * copy would leave the copy padded with zeros or empty */
+        foreach (unowned string source in new string[] { "/sys/devices/system/cpu/online", "/proc/version" }) {
+            if (!FileUtils.test (source, FileTest.IS_REGULAR)) {
+                continue;
+            }
+
+            var copy = Path.build_filename (test_dir, Path.get_basename (source));
+            assert (copy_file (source, copy) == Marlin.FileCopyMethod.GIO);
+            assert (get_contents (copy) == get_contents (source));
+        }
+    });
+}
+
+int main (string[] args) {
+    Test.init (ref args);
+
+    try {
+        test_dir = DirUtils.make_tmp ("marlin-file-copy-tests-XXXXXX");
+    } catch (FileError e) {
+        error (e.message);
+    }
+
+    add_file_copy_tests ();
+    var result = Test.run ();
+
+    try {
+        var dir = Dir.open (test_dir);
+        string? name;
+        while ((name = dir.read_name ()) != null) {
+            FileUtils.unlink (Path.build_filename (test_dir, name));
+        }
+    } catch (FileError e) {
+        warning (e.message);
+    }
+    DirUtils.remove (test_dir);
+
+    return result;
+}
@@ -0,0 +1,502 @@
+/*
+* Copyright (c) 2017 elementary LLC
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 3 of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+* Boston, MA 02111-1307, USA.
+*/
+
+/* Runs file operations on synthetic trees in a temporary folder and reports their throughput.
+ *
+ * The following environment variables tune the run:
+ *   MARLIN_BENCH_N_DIRS            number of folders in the small file tree (default 20)
+ *   MARLIN_BENCH_FILES_PER_DIR     number of files in each folder (default 250)
+ *   MARLIN_BENCH_FILE_SIZE         size of each small file in bytes (default 4096)
+ *   MARLIN_BENCH_N_DUPLICATED      number of files duplicated at once (default 2000)
+ *   MARLIN_BENCH_N_MOVED           number of files moved between two folders at once (default 20000)
+ *   MARLIN_BENCH_N_LARGE_FILES     number of files copied with and without verification (default 8)
+ *   MARLIN_BENCH_LARGE_FILE_SIZE   size of each of them in bytes (default 32 MiB)
+ *   MARLIN_BENCH_DEST_DIR          folder to copy them to, e.g. on an external disk (default a folder
+ *                                  in /tmp, where the copies may never leave memory)
+ *   MARLIN_BENCH_REMOTE_URI        network folder to copy the small file tree to, e.g. a local WebDAV
+ *                                  or SFTP server at dav://localhost:8080/; the benchmark mounts it with
+ *                                  GIO when it is not mounted yet and unmounts it afterwards
+ *
+ * The network benchmark does not start a server of its own: GLib and gvfs only ship the clients, and
+ * starting a WebDAV or SFTP server would add a dependency to the tests. It is skipped unless
+ * MARLIN_BENCH_REMOTE_URI names one, so an unset variable means the network path was not measured.
+ *
+ * Jobs need a registered Gtk.Application and a display; without them the benchmarks are skipped.
+ */
+
+Gtk.Application? app = null;
+
+uint get_env_uint (string name, uint default_value) {
+    var val = GLib.Environment.get_variable (name);
+    return val != null ? (uint)uint64.parse (val) : default_value;
+}
+
+string make_test_dir (string name) {
+    string path = "/tmp/marlin-file-operations-bench-%s-%s".printf (name, get_real_time ().to_string ());
+    DirUtils.create_with_parents (path, 0755);
+    return path;
+}
+
+void create_small_file_tree (string root, uint n_dirs, uint files_per_dir, uint file_size) {
+    var contents = new uint8[file_size];
+    for (uint i = 0; i < file_size; i++) {
+        contents[i] = (uint8)(i % 251);
+    }
+
+    for (uint d = 0; d < n_dirs; d++) {
+        string dir = Path.build_filename (root, "dir-%u".printf (d));
+        DirUtils.create_with_parents (dir, 0755);
+        for (uint f = 0; f < files_per_dir; f++) {
+            try {
+                FileUtils.set_data (Path.build_filename (dir, "file-%u".printf (f)), contents);
+            } catch (FileError e) {
+                error ("Could not create the test tree: %s", e.message);
+            }
+        }
+    }
+}
+
+/* Returns the number of files and folders below @path and adds up the sizes of the files */
+uint count_tree (string path, out uint64 n_bytes) {
+    uint n_files = 0;
+    n_bytes = 0;
+
+    try {
+        var dir = Dir.open (path);
+        string? name;
+        while ((name = dir.read_name ()) != null) {
+            string child = Path.build_filename (path, name);
+            n_files++;
+            if (FileUtils.test (child, FileTest.IS_DIR)) {
+                uint64 child_bytes;
+                n_files += count_tree (child, out child_bytes);
+                n_bytes += child_bytes;
+            } else {
+                Posix.Stat st;
+                Posix.lstat (child, out st);
+                n_bytes += st.st_size;
+            }
+        }
+    } catch (FileError e) {
+        error ("Could not count %s: %s", path, e.message);
+    }
+
+    return n_files;
+}
+
+void on_copy_done (HashTable<File, void*>? debuting_files, void* data) {
+    ((MainLoop)data).quit ();
+}
+
+/* Like count_tree (), through GIO for folders which are not local */
+uint count_remote_tree (File dir, out uint64 n_bytes) {
+    uint n_files = 0;
+    n_bytes = 0;
+
+    try {
+        var enumerator = dir.enumerate_children (FileAttribute.STANDARD_NAME + "," +
+                                                 FileAttribute.STANDARD_TYPE + "," +
+                                                 FileAttribute.STANDARD_SIZE,
+                                                 FileQueryInfoFlags.NOFOLLOW_SYMLINKS);
+        FileInfo? info;
+        while ((info = enumerator.next_file ()) != null) {
+            n_files++;
+            if (info.get_file_type () == FileType.DIRECTORY) {
+                uint64 child_bytes;
+                n_files += count_remote_tree (dir.get_child (info.get_name ()), out child_bytes);
+                n_bytes += child_bytes;
+            } else {
+                n_bytes += info.get_size ();
+            }
+        }
+    } catch (Error e) {
+        error ("Could not count %s: %s", dir.get_uri (), e.message);
+    }
+
+    return n_files;
+}
+
+void delete_remote_tree (File file) {
+    try {
+        var enumerator = file.enumerate_children (FileAttribute.STANDARD_NAME,
+                                                  FileQueryInfoFlags.NOFOLLOW_SYMLINKS);
+        FileInfo? info;
+        while ((info = enumerator.next_file ()) != null) {
+            delete_remote_tree (file.get_child (info.get_name ()));
+        }
+    } catch (Error e) {
+        /* Not a folder */
+    }
+
+    try {
+        file.delete ();
+    } catch (Error e) {
+        warning ("Could not delete %s: %s", file.get_uri (), e.message);
+    }
+}
+
+/* Copies @src into @dest_dir and returns the time taken in seconds */
+double run_copy (string src, string dest_dir) {
+    return run_copy_to (src, File.new_for_path (dest_dir));
+}
+
+double run_copy_to (string src, File dest_dir) {
+    var loop = new MainLoop ();
+    var sources = new List<File> ();
+    sources.append (File.new_for_path (src));
+
+    int64 start_time = get_monotonic_time ();
+    Marlin.FileOperations.copy (sources, null, dest_dir, null, on_copy_done, loop);
+    loop.run ();
+
+    return (get_monotonic_time () - start_time) / 1000000.0;
+}
+
+void small_file_copy_benchmark () {
+    if (app == null) {
+        Test.skip ("No display");
+        return;
+    }
+
+    uint n_dirs = get_env_uint ("MARLIN_BENCH_N_DIRS", 20);
+    uint files_per_dir = get_env_uint ("MARLIN_BENCH_FILES_PER_DIR", 250);
+    uint file_size = get_env_uint ("MARLIN_BENCH_FILE_SIZE", 4096);
+
+    string test_dir = make_test_dir ("small-files");
+    string src = Path.build_filename (test_dir, "source");
+    create_small_file_tree (src, n_dirs, files_per_dir, file_size);
+
+    uint64 src_bytes;
+    uint src_files = count_tree (src, out src_bytes);
+
+    print ("\n%u files of %u bytes in %u folders\n", n_dirs * files_per_dir, file_size, n_dirs);
+
+    uint[] thread_counts = { 1, 0 };
+    foreach (uint n_threads in thread_counts) {
+        string dest = Path.build_filename (test_dir, "dest-%u".printf (n_threads));
+        DirUtils.create_with_parents (dest, 0755);
+
+        Marlin.FileOperations.set_copy_threads (n_threads);
+        double seconds = run_copy (src, dest);
+
+        uint64 dest_bytes;
+        uint dest_files = count_tree (Path.build_filename (dest, "source"), out dest_bytes);
+
+        print ("%-10s %8.2f s %10.0f files/s\n", n_threads == 1 ? "serial" : "parallel",
+               seconds, dest_files / seconds);
+
+        assert (dest_files == src_files);
+        assert (dest_bytes == src_bytes);
+    }
+
+    Marlin.FileOperations.set_copy_threads (0);
+    Posix.system ("rm -rf " + test_dir);
+}
+
+/* Copies large files once as they are and once checking the copies, and reports what checking costs */
+void verified_copy_benchmark () {
+    if (app == null) {
+        Test.skip ("No display");
+        return;
+    }
+
+    uint n_files = get_env_uint ("MARLIN_BENCH_N_LARGE_FILES", 8);
+    uint file_size = get_env_uint ("MARLIN_BENCH_LARGE_FILE_SIZE", 32 * 1024 * 1024);
+
+    string test_dir = make_test_dir ("verify");
+    string src = Path.build_filename (test_dir, "source");
+    create_small_file_tree (src, 1, n_files, file_size);
+
+    uint64 src_bytes;
+    uint src_files = count_tree (src, out src_bytes);
+
+    var dest_root = GLib.Environment.get_variable ("MARLIN_BENCH_DEST_DIR");
+    if (dest_root == null) {
+        dest_root = test_dir;
+    } else {
+        dest_root = Path.build_filename (dest_root, Path.get_basename (test_dir));
+        DirUtils.create_with_parents (dest_root, 0755);
+    }
+
+    print ("\n%u files of %u bytes copied to %s\n", n_files, file_size, dest_root);
+
+    var preferences = GOF.Preferences.get_default ();
+    bool verify_copies = preferences.verify_copies;
+
+    double unverified_seconds = 0.0;
+    bool[] modes = { false, true };
+    foreach (bool verify in modes) {
+        string dest = Path.build_filename (dest_root, verify ? "dest-verified" : "dest");
+        DirUtils.create_with_parents (dest, 0755);
+
+        preferences.verify_copies = verify;
+        double seconds = run_copy (src, dest);
+
+        uint64 dest_bytes;
+        uint dest_files = count_tree (Path.build_filename (dest, "source"), out dest_bytes);
+
+        if (verify) {
+            print ("%-10s %8.2f s %10.1f MB/s %+8.1f %%\n", "verified", seconds, dest_bytes / seconds / 1000000.0,
+                   (seconds / unverified_seconds - 1.0) * 100.0);
+        } else {
+            unverified_seconds = seconds;
+            print ("%-10s %8.2f s %10.1f MB/s\n", "plain", seconds, dest_bytes / seconds / 1000000.0);
+        }
+
+        assert (dest_files == src_files);
+        assert (dest_bytes == src_bytes);
+    }
+
+    preferences.verify_copies = verify_copies;
+    if (dest_root != test_dir) {
+        Posix.system ("rm -rf " + dest_root);
+    }
+    Posix.system ("rm -rf " + test_dir);
+}
+
+/* Mounts the folder at @location unless it is mounted already, and returns the mount made */
+Mount? mount_remote (File location) {
+    try {
+        location.find_enclosing_mount ();
+        return null;
+    } catch (Error e) {
+        if (!(e is IOError.NOT_MOUNTED)) {
+            error ("Could not find the mount of %s: %s", location.get_uri (), e.message);
+        }
+    }
+
+    var loop = new MainLoop ();
+    Error? mount_error = null;
+    location.mount_enclosing_volume.begin (MountMountFlags.NONE, new MountOperation (), null, (obj, res) => {
+        try {
+            location.mount_enclosing_volume.end (res);
+        } catch (Error e) {
+            mount_error = e;
+        }
+
+        loop.quit ();
+    });
+    loop.run ();
+
+    try {
+        if (mount_error != null) {
+            throw mount_error;
+        }
+
+        return location.find_enclosing_mount ();
+    } catch (Error e) {
+        error ("Could not mount %s: %s", location.get_uri (), e.message);
+    }
+}
+
+void unmount_remote (Mount mount) {
+    var loop = new MainLoop ();
+    mount.unmount_with_operation.begin (MountUnmountFlags.NONE, null, null, (obj, res) => {
+        try {
+            mount.unmount_with_operation.end (res);
+        } catch (Error e) {
+            warning ("Could not unmount %s: %s", mount.get_name (), e.message);
+        }
+
+        loop.quit ();
+    });
+    loop.run ();
+}
+
+/* Copies the small file tree to a network mount, one file at a time and then several at once */
+void network_copy_benchmark () {
+    if (app == null) {
+        Test.skip ("No display");
+        return;
+    }
+
+    var remote_uri = GLib.Environment.get_variable ("MARLIN_BENCH_REMOTE_URI");
+    if (remote_uri == null) {
+        Test.skip ("MARLIN_BENCH_REMOTE_URI is not set, no network folder to copy to");
+        return;
+    }
+
+    /* Every file costs round trips to the server, so the default tree is smaller */
+    uint n_dirs = get_env_uint ("MARLIN_BENCH_N_DIRS", 4);
+    uint files_per_dir = get_env_uint ("MARLIN_BENCH_FILES_PER_DIR", 100);
+    uint file_size = get_env_uint ("MARLIN_BENCH_FILE_SIZE", 4096);
+
+    string test_dir = make_test_dir ("network");
+    string src = Path.build_filename (test_dir, "source");
+    create_small_file_tree (src, n_dirs, files_per_dir, file_size);
+
+    uint64 src_bytes;
+    uint src_files = count_tree (src, out src_bytes);
+
+    print ("\n%u files of %u bytes in %u folders to %s\n", n_dirs * files_per_dir, file_size, n_dirs, remote_uri);
+
+    var remote = File.new_for_uri (remote_uri);
+    var mount = mount_remote (remote);
+    var remote_root = remote.get_child (Path.get_basename (test_dir));
+    try {
+        remote_root.make_directory ();
+    } catch (Error e) {
+        error ("Could not create %s: %s", remote_root.get_uri (), e.message);
+    }
+
+    uint[] thread_counts = { 1, 0 };
+    foreach (uint n_threads in thread_counts) {
+        var dest = remote_root.get_child ("dest-%u".printf (n_threads));
+        try {
+            dest.make_directory ();
+        } catch (Error e) {
+            error ("Could not create %s: %s", dest.get_uri (), e.message);
+        }
+
+        Marlin.FileOperations.set_copy_threads (n_threads);
+        double seconds = run_copy_to (src, dest);
+
+        uint64 dest_bytes;
+        uint dest_files = count_remote_tree (dest.get_child ("source"), out dest_bytes);
+
+        print ("%-10s %8.2f s %10.0f files/s\n", n_threads == 1 ? "serial" : "pipelined",
+               seconds, dest_files / seconds);
+
+        assert (dest_files == src_files);
+        assert (dest_bytes == src_bytes);
+    }
+
+    Marlin.FileOperations.set_copy_threads (0);
+    delete_remote_tree (remote_root);
+    if (mount != null) {
+        unmount_remote (mount);
+    }
+    Posix.system ("rm -rf " + test_dir);
+}
+
+/* Duplicates @files next to themselves and returns the time taken in seconds */
+double run_duplicate (List<File> files) {
+    var loop = new MainLoop ();
+
+    int64 start_time = get_monotonic_time ();
+    Marlin.FileOperations.duplicate (files, null, null, on_copy_done, loop);
+    loop.run ();
+
+    return (get_monotonic_time () - start_time) / 1000000.0;
+}
+
+void duplicate_benchmark () {
+    if (app == null) {
+        Test.skip ("No display");
+        return;
+    }
+
+    uint n_files = get_env_uint ("MARLIN_BENCH_N_DUPLICATED", 2000);
+
+    string test_dir = make_test_dir ("duplicate");
+    create_small_file_tree (test_dir, 1, n_files, 0);
+    string dir = Path.build_filename (test_dir, "dir-0");
+
+    var files = new List<File> ();
+    for (uint f = 0; f < n_files; f++) {
+        files.append (File.new_for_path (Path.build_filename (dir, "file-%u".printf (f))));
+    }
+
+    print ("\n%u files duplicated into a folder with earlier copies\n", n_files);
+
+    /* Each pass has to find names past the copies made by the previous ones */
+    for (uint pass = 1; pass <= 3; pass++) {
+        double seconds = run_duplicate (files);
+
+        uint64 n_bytes;
+        uint n_copies = count_tree (dir, out n_bytes);
+
+        print ("pass %u %8.2f s %10.0f files/s\n", pass, seconds, n_files / seconds);
+
+        assert (n_copies == n_files * (pass + 1));
+    }
+
+    Posix.system ("rm -rf " + test_dir);
+}
+
+/* Moves @files into @dest_dir and returns the time taken in seconds */
+double run_move (List<File> files, string dest_dir) {
+    var loop = new MainLoop ();
+
+    int64 start_time = get_monotonic_time ();
+    Marlin.FileOperations.move (files, null, File.new_for_path (dest_dir), null, on_copy_done, loop);
+    loop.run ();
+
+    return (get_monotonic_time () - start_time) / 1000000.0;
+}
+
+void bulk_move_benchmark () {
+    if (app == null) {
+        Test.skip ("No display");
+        return;
+    }
+
+    uint n_files = get_env_uint ("MARLIN_BENCH_N_MOVED", 20000);
+
+    string test_dir = make_test_dir ("move");
+    create_small_file_tree (test_dir, 1, n_files, 0);
+    string[] dirs = { Path.build_filename (test_dir, "dir-0"), Path.build_filename (test_dir, "dir-1") };
+    DirUtils.create (dirs[1], 0755);
+
+    print ("\n%u files moved between two folders on the same file system\n", n_files);
+
+    for (uint pass = 0; pass < 2; pass++) {
+        string src = dirs[pass % 2];
+        string dest = dirs[(pass + 1) % 2];
+
+        var files = new List<File> ();
+        for (uint f = 0; f < n_files; f++) {
+            files.append (File.new_for_path (Path.build_filename (src, "file-%u".printf (f))));
+        }
+
+        double seconds = run_move (files, dest);
+
+        uint64 n_bytes;
+        assert (count_tree (src, out n_bytes) == 0);
+        assert (count_tree (dest, out n_bytes) == n_files);
+
+        print ("pass %u %8.2f s %10.0f files/s\n", pass + 1, seconds, n_files / seconds);
+    }
+
+    Posix.system ("rm -rf " + test_dir);
+}
+
+int main (string[] args) {
+    Test.init (ref args);
+
+    if (Gtk.init_check (ref args)) {
+        app = new Gtk.Application ("io.elementary.files.file-operations-benchmark", ApplicationFlags.NON_UNIQUE);
+        try {
+            /* Jobs inhibit suspend through the default application */
+            app.register (null);
+            app.set_default ();
+        } catch (Error e) {
+            warning ("Could not register the application: %s", e.message);
+            app = null;
+        }
+    }
+
+    Test.add_func ("/FileOperations/small_file_copy_benchmark", small_file_copy_benchmark);
+    Test.add_func ("/FileOperations/duplicate_benchmark", duplicate_benchmark);
+    Test.add_func ("/FileOperations/network_copy_benchmark", network_copy_benchmark);
+    Test.add_func ("/FileOperations/verified_copy_benchmark", verified_copy_benchmark);
+    Test.add_func ("/FileOperations/bulk_move_benchmark", bulk_move_benchmark);
+
+    return Test.run ();
+}
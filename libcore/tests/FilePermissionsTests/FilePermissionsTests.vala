@@ -0,0 +1,264 @@
+/*
+* Copyright (c) 2017 elementary LLC
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 3 of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+* Boston, MA 02111-1307, USA.
+*/
+
+/* The undo records are moved to a temporary file past this many bytes of paths */
+const uint UNDO_MAX_MEMORY = 8 * 1024 * 1024;
+
+string test_dir;
+
+/* Paths relative to the top folder of a tree made by make_tree (), with the modes they get */
+const string[] TREE_DIRS = { "a", "a/b", "a/b/c", "d" };
+const string[] TREE_FILES = { "file", "a/file", "a/b/file", "a/b/c/file", "d/file" };
+const string TREE_SCRIPT = "a/b/script";
+
+uint32 get_mode (string path) {
+    Posix.Stat st;
+    assert (Posix.lstat (path, out st) == 0);
+    return st.st_mode & 07777;
+}
+
+void make_file (string path, uint32 mode) {
+    try {
+        FileUtils.set_contents (path, path);
+    } catch (FileError e) {
+        error (e.message);
+    }
+
+    FileUtils.chmod (path, (int) mode);
+}
+
+/* A folder with folders 0755, files 0644, a script 0755 and a link to a file outside it */
+string make_tree (string name) {
+    var top = Path.build_filename (test_dir, name);
+    DirUtils.create (top, 0700);
+    foreach (unowned string dir in TREE_DIRS) {
+        DirUtils.create (Path.build_filename (top, dir), 0700);
+    }
+    foreach (unowned string dir in TREE_DIRS) {
+        FileUtils.chmod (Path.build_filename (top, dir), 0755);
+    }
+    FileUtils.chmod (top, 0755);
+
+    foreach (unowned string file in TREE_FILES) {
+        make_file (Path.build_filename (top, file), 0644);
+    }
+    make_file (Path.build_filename (top, TREE_SCRIPT), 0755);
+
+    var outside = top + "-outside";
+    make_file (outside, 0644);
+    FileUtils.symlink (outside, Path.build_filename (top, "a/link"));
+
+    return top;
+}
+
+void assert_tree_modes (string top, uint32 dir_mode, uint32 file_mode, uint32 script_mode) {
+    assert (get_mode (top) == dir_mode);
+    foreach (unowned string dir in TREE_DIRS) {
+        assert (get_mode (Path.build_filename (top, dir)) == dir_mode);
+    }
+    foreach (unowned string file in TREE_FILES) {
+        assert (get_mode (Path.build_filename (top, file)) == file_mode);
+    }
+    assert (get_mode (Path.build_filename (top, TREE_SCRIPT)) == script_mode);
+
+    /* Links have no permissions of their own, and what they point to is left alone */
+    assert (get_mode (top + "-outside") == 0644);
+}
+
+uint64 set_tree (string top, uint32 file_permissions, uint32 file_mask,
+                 uint32 dir_permissions, uint32 dir_mask, Marlin.PermissionsUndo undo) {
+    uint64 n_changed;
+    uint64 n_progress = 0;
+
+    try {
+        assert (MarlinFile.set_permissions_tree (File.new_for_path (top),
+                                                 file_permissions, file_mask,
+                                                 dir_permissions, dir_mask,
+                                                 undo, null,
+                                                 (n) => { n_progress = n; },
+                                                 out n_changed));
+    } catch (Error e) {
+        error (e.message);
+    }
+
+    /* Progress is reported once more when the walk is done */
+    assert (n_progress == n_changed);
+    return n_changed;
+}
+
+void restore_tree (string top, Marlin.PermissionsUndo undo) {
+    try {
+        assert (undo.restore (File.new_for_path (top)));
+    } catch (Error e) {
+        error (e.message);
+    }
+}
+
+void add_file_permissions_tests () {
+    Test.add_func ("/FilePermissions/tree", () => {
+        var top = make_tree ("tree");
+        var undo = new Marlin.PermissionsUndo ();
+
+        /* Takes permissions away from group and others, leaving the execute permissions of files */
+        var n_changed = set_tree (top, 0600, 0666, 0700, 0777, undo);
+        assert_tree_modes (top, 0700, 0600, 0711);
+
+        var n_entries = 1 + TREE_DIRS.length + TREE_FILES.length + 1;
+        assert (n_changed == n_entries);
+        assert (undo.get_n_entries () == n_entries);
+
+        /* Nothing changes the second time, so there is nothing more to undo */
+        var again = new Marlin.PermissionsUndo ();
+        assert (set_tree (top, 0600, 0666, 0700, 0777, again) == 0);
+        assert (again.get_n_entries () == 0);
+
+        restore_tree (top, undo);
+        assert_tree_modes (top, 0755, 0644, 0755);
+    });
+
+    Test.add_func ("/FilePermissions/unsearchable", () => {
+        var top = make_tree ("unsearchable");
+        var undo = new Marlin.PermissionsUndo ();
+
+        /* The folders lose search permission only once everything in them is done */
+        var n_changed = set_tree (top, 0400, 0777, 0600, 0777, undo);
+        assert (n_changed == 1 + TREE_DIRS.length + TREE_FILES.length + 1);
+        assert (get_mode (top) == 0600);
+
+        /* Putting the files back needs the folders to be searched again first */
+        restore_tree (top, undo);
+        assert_tree_modes (top, 0755, 0644, 0755);
+    });
+
+    Test.add_func ("/FilePermissions/was_unsearchable", () => {
+        var top = make_tree ("was-unsearchable");
+        for (int i = TREE_DIRS.length - 1; i >= 0; i--) {
+            FileUtils.chmod (Path.build_filename (top, TREE_DIRS[i]), 0600);
+        }
+        FileUtils.chmod (top, 0600);
+
+        /* Permissions the folders gain are added before they are read */
+        var undo = new Marlin.PermissionsUndo ();
+        assert (set_tree (top, 0, 0, 0755, 0777, undo) == 1 + TREE_DIRS.length);
+        assert_tree_modes (top, 0755, 0644, 0755);
+
+        /* Only what was changed is put back, the folders last so that they can still be searched */
+        FileUtils.chmod (Path.build_filename (top, "a/b/file"), 0600);
+        restore_tree (top, undo);
+
+        assert (get_mode (top) == 0600);
+        FileUtils.chmod (top, 0700);
+        foreach (unowned string dir in TREE_DIRS) {
+            var path = Path.build_filename (top, dir);
+            assert (get_mode (path) == 0600);
+            FileUtils.chmod (path, 0700);
+        }
+        assert (get_mode (Path.build_filename (top, "a/file")) == 0644);
+        assert (get_mode (Path.build_filename (top, "a/b/file")) == 0600);
+    });
+
+    Test.add_func ("/FilePermissions/spill", () => {
+        var top = make_tree ("spill");
+        var undo = new Marlin.PermissionsUndo ();
+
+        set_tree (top, 0600, 0666, 0700, 0777, undo);
+        var n_entries = undo.get_n_entries ();
+
+        /* Pushes the records of the tree out of memory with files which are gone by now */
+        var filler = new StringBuilder ("missing/");
+        while (filler.len < 1000) {
+            filler.append ("folder/");
+        }
+
+        uint n_missing = UNDO_MAX_MEMORY / 1000 + 1;
+        for (uint i = 0; i < n_missing; i++) {
+            undo.add ("%s%u".printf (filler.str, i), 0644, i % 2 == 0);
+        }
+
+        /* Kept in memory again */
+        make_file (Path.build_filename (top, "late"), 0600);
+        undo.add ("late", 0640, false);
+
+        assert (undo.get_n_entries () == n_entries + n_missing + 1);
+
+        restore_tree (top, undo);
+        assert_tree_modes (top, 0755, 0644, 0755);
+        assert (get_mode (Path.build_filename (top, "late")) == 0640);
+
+        /* The records are still there after being read */
+        FileUtils.chmod (Path.build_filename (top, "a/file"), 0600);
+        FileUtils.chmod (Path.build_filename (top, "late"), 0600);
+        restore_tree (top, undo);
+        assert (get_mode (Path.build_filename (top, "a/file")) == 0644);
+        assert (get_mode (Path.build_filename (top, "late")) == 0640);
+    });
+
+    Test.add_func ("/FilePermissions/not_a_folder", () => {
+        var path = Path.build_filename (test_dir, "not-a-folder");
+        make_file (path, 0644);
+
+        uint64 n_changed = 1;
+        try {
+            MarlinFile.set_permissions_tree (File.new_for_path (path), 0600, 0777, 0700, 0777,
+                                             null, null, null, out n_changed);
+            assert_not_reached ();
+        } catch (Error e) {
+            assert (e is IOError.NOT_SUPPORTED);
+        }
+
+        assert (n_changed == 0);
+        assert (get_mode (path) == 0644);
+    });
+}
+
+/* Removes @path and everything in it, whatever permissions the tests left them with */
+void remove_tree (string path) {
+    if (FileUtils.test (path, FileTest.IS_DIR) && !FileUtils.test (path, FileTest.IS_SYMLINK)) {
+        FileUtils.chmod (path, 0700);
+        try {
+            var dir = Dir.open (path);
+            string? name;
+            while ((name = dir.read_name ()) != null) {
+                remove_tree (Path.build_filename (path, name));
+            }
+        } catch (FileError e) {
+            warning (e.message);
+        }
+        DirUtils.remove (path);
+    } else {
+        FileUtils.unlink (path);
+    }
+}
+
+int main (string[] args) {
+    Test.init (ref args);
+
+    try {
+        test_dir = DirUtils.make_tmp ("marlin-file-permissions-tests-XXXXXX");
+    } catch (FileError e) {
+        error (e.message);
+    }
+
+    add_file_permissions_tests ();
+    var result = Test.run ();
+
+    remove_tree (test_dir);
+
+    return result;
+}
@@ -0,0 +1,135 @@
+/*
+* Copyright (c) 2017 elementary LLC
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 3 of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+* Boston, MA 02111-1307, USA.
+*/
+
+/* Larger than the 1 MiB blocks the files are compared in, so that a difference can be in a later one */
+const uint FILE_SIZE = 3 * 1024 * 1024 + 1000;
+
+string test_dir;
+
+delegate void DamageFunc (uint8[] contents);
+
+uint8[] make_contents () {
+    var contents = new uint8[FILE_SIZE];
+    for (uint i = 0; i < FILE_SIZE; i++) {
+        contents[i] = (uint8)(i % 251);
+    }
+
+    return contents;
+}
+
+/* Writes the original and the first @copy_size bytes of a copy of it, which @damage may change before
+ * it is written */
+void write_files (string name, out File source, out File copy,
+                  DamageFunc? damage = null, uint copy_size = FILE_SIZE) {
+    var contents = make_contents ();
+    var source_path = Path.build_filename (test_dir, name);
+    var copy_path = Path.build_filename (test_dir, name + ".copy");
+
+    try {
+        FileUtils.set_data (source_path, contents);
+        if (damage != null) {
+            damage (contents);
+        }
+        FileUtils.set_data (copy_path, contents[0:copy_size]);
+    } catch (FileError e) {
+        error (e.message);
+    }
+
+    source = File.new_for_path (source_path);
+    copy = File.new_for_path (copy_path);
+}
+
+Error? get_verify_error (File source, File copy) {
+    try {
+        assert (MarlinFile.verify (source, copy));
+        return null;
+    } catch (Error e) {
+        return e;
+    }
+}
+
+void add_file_verify_tests () {
+    Test.add_func ("/FileVerify/same", () => {
+        File source, copy;
+        write_files ("same", out source, out copy);
+        assert (get_verify_error (source, copy) == null);
+    });
+
+    Test.add_func ("/FileVerify/changed_byte", () => {
+        File source, copy;
+        write_files ("changed-byte", out source, out copy, (contents) => {
+            contents[2 * 1024 * 1024 + 17] ^= 0x01;
+        });
+        assert (get_verify_error (source, copy) is IOError.FAILED);
+    });
+
+    Test.add_func ("/FileVerify/changed_last_byte", () => {
+        File source, copy;
+        write_files ("changed-last-byte", out source, out copy, (contents) => {
+            contents[FILE_SIZE - 1] ^= 0x80;
+        });
+        assert (get_verify_error (source, copy) is IOError.FAILED);
+    });
+
+    Test.add_func ("/FileVerify/truncated", () => {
+        File source, copy;
+        write_files ("truncated", out source, out copy, null, FILE_SIZE - 1);
+        assert (get_verify_error (source, copy) is IOError.FAILED);
+    });
+
+    Test.add_func ("/FileVerify/missing_copy", () => {
+        File source, copy;
+        write_files ("missing-copy", out source, out copy);
+        FileUtils.unlink (copy.get_path ());
+        assert (get_verify_error (source, copy) is IOError.NOT_FOUND);
+    });
+
+    Test.add_func ("/FileVerify/folder", () => {
+        /* Only the data of regular files is compared */
+        var source = File.new_for_path (test_dir);
+        var copy = File.new_for_path (Path.build_filename (test_dir, "not-a-copy"));
+        assert (get_verify_error (source, copy) == null);
+    });
+}
+
+int main (string[] args) {
+    Test.init (ref args);
+
+    try {
+        test_dir = DirUtils.make_tmp ("marlin-file-verify-tests-XXXXXX");
+    } catch (FileError e) {
+        error (e.message);
+    }
+
+    add_file_verify_tests ();
+    var result = Test.run ();
+
+    try {
+        var dir = Dir.open (test_dir);
+        string? name;
+        while ((name = dir.read_name ()) != null) {
+            FileUtils.unlink (Path.build_filename (test_dir, name));
+        }
+    } catch (FileError e) {
+        warning (e.message);
+    }
+    DirUtils.remove (test_dir);
+
+    return result;
+}
@@ -21,6 +21,8 @@
 
 void add_icon_info_tests () {
     Test.add_func ("/MarlinIconInfo/goffile_icon_update", goffile_icon_update_test);
+    Test.add_func ("/MarlinIconInfo/goffile_pix_eviction", goffile_pix_eviction_test);
+    Test.add_func ("/MarlinIconInfo/icon_cache_budget", icon_cache_budget_test);
 }
 
 void goffile_icon_update_test () {
@@ -37,6 +39,66 @@ void goffile_icon_update_test () {
     assert (file.pix_size == 32);
 }
 
+void goffile_pix_eviction_test () {
+    string png_path = Path.build_filename (Config.TESTDATA_DIR, "images", "testimage.png");
+    string jpg_path = Path.build_filename (Config.TESTDATA_DIR, "images", "testimage.jpg");
+    GOF.File png_file = GOF.File.get_by_uri (png_path);
+    GOF.File jpg_file = GOF.File.get_by_uri (jpg_path);
+    png_file.query_update ();
+    jpg_file.query_update ();
+
+    uint n_files;
+    uint64 n_bytes, n_evictions_before, n_evictions;
+    /* Budget of one byte and no grace period: only the latest pix may stay resident */
+    GOF.File.set_pixbuf_budget (1, 0);
+    GOF.File.get_pixbuf_residency (out n_files, out n_bytes, out n_evictions_before);
+
+    png_file.update_icon (64);
+    jpg_file.update_icon (64);
+    assert (png_file.pix == null);
+    assert (png_file.pix_size == 64);
+    assert (jpg_file.pix != null);
+
+    GOF.File.get_pixbuf_residency (out n_files, out n_bytes, out n_evictions);
+    assert (n_evictions > n_evictions_before);
+
+    /* Evicted pix is rematerialized on next use */
+    GOF.File.set_pixbuf_budget (0, 0);
+    png_file.update_icon (64);
+    assert (png_file.pix != null);
+    GOF.File.get_pixbuf_residency (out n_files, out n_bytes, out n_evictions);
+    assert (n_files >= 2);
+    assert (n_bytes > 0);
+}
+
+void icon_cache_budget_test () {
+    string test_file_path = Path.build_filename (Config.TESTDATA_DIR, "images", "testimage.jpg");
+    var icon = new GLib.FileIcon (GLib.File.new_for_path (test_file_path));
+
+    uint n_entries;
+    uint64 n_bytes, n_hits, n_misses, n_evictions;
+    uint64 hits_before, misses_before, evictions_before;
+    Marlin.IconInfo.get_cache_stats (out n_entries, out n_bytes, out hits_before, out misses_before, out evictions_before);
+
+    var info = Marlin.IconInfo.lookup (icon, 48);
+    assert (info.get_pixbuf_nodefault () != null);
+    info = Marlin.IconInfo.lookup (icon, 48);
+
+    Marlin.IconInfo.get_cache_stats (out n_entries, out n_bytes, out n_hits, out n_misses, out n_evictions);
+    assert (n_misses == misses_before + 1);
+    assert (n_hits == hits_before + 1);
+    assert (n_entries > 0);
+    assert (n_bytes > 0);
+
+    /* The pixbuf is no longer used outside the cache so it can be evicted */
+    info = null;
+    Marlin.IconInfo.set_cache_budget (1);
+    Marlin.IconInfo.get_cache_stats (out n_entries, out n_bytes, out n_hits, out n_misses, out n_evictions);
+    assert (n_evictions > evictions_before);
+
+    Marlin.IconInfo.set_cache_budget (0);
+}
+
 int main (string[] args) {
     Test.init (ref args);
 
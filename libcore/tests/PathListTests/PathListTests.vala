@@ -0,0 +1,113 @@
+/*
+* Copyright (c) 2017 elementary LLC
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 3 of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+* Boston, MA 02111-1307, USA.
+*/
+
+void assert_round_trip (string[] paths) {
+    var list = new Marlin.PathList ();
+    foreach (unowned string path in paths) {
+        list.append (path);
+    }
+
+    assert (list.get_length () == paths.length);
+
+    var iter = Marlin.PathListIter (list);
+    foreach (unowned string path in paths) {
+        assert (iter.next () == path);
+    }
+    assert (iter.next () == null);
+}
+
+/* A folder name of @length bytes, so that the paths in it share that much with each other */
+string long_folder (uint length) {
+    var builder = new StringBuilder ();
+    while (builder.len < length) {
+        builder.append ("folder-%u/".printf ((uint) builder.len));
+    }
+
+    builder.truncate (length - 1);
+    builder.append_c ('/');
+    return builder.str;
+}
+
+void add_path_list_tests () {
+    Test.add_func ("/PathList/empty", () => {
+        var list = new Marlin.PathList ();
+        assert (list.get_length () == 0);
+
+        var iter = Marlin.PathListIter (list);
+        assert (iter.next () == null);
+        assert (iter.next () == null);
+    });
+
+    Test.add_func ("/PathList/shared_prefixes", () => {
+        assert_round_trip ({
+            "Photos/2017/IMG_0001.jpg",
+            "Photos/2017/IMG_0002.jpg",
+            "Photos/2017/IMG_0002.jpg",  /* the same path twice */
+            "Photos/2017",               /* a prefix of the path before */
+            "Photos/2017/Été/plage.jpg",
+            "Photos/2017/Été",
+            "Documents/report.odt",      /* nothing in common */
+            "",
+            "a"
+        });
+    });
+
+    Test.add_func ("/PathList/long_prefixes", () => {
+        /* Up to 127 shared bytes fit in one byte, these need two and three */
+        foreach (uint length in new uint[] { 127, 128, 200, 16383, 16384, 40000 }) {
+            var folder = long_folder (length);
+            assert_round_trip ({
+                folder + "first",
+                folder + "second",
+                folder + "second/child",
+                folder,
+                "short",
+                folder + "third"
+            });
+        }
+    });
+
+    Test.add_func ("/PathList/many", () => {
+        var list = new Marlin.PathList ();
+        size_t total = 0;
+        for (uint i = 0; i < 10000; i++) {
+            var path = "Music/Artist %u/Album/%05u.ogg".printf (i / 100, i);
+            list.append (path);
+            total += path.length + 1;
+        }
+
+        assert (list.get_length () == 10000);
+        /* Consecutive paths share most of their bytes */
+        assert (list.get_size () < total / 2);
+
+        var iter = Marlin.PathListIter (list);
+        for (uint i = 0; i < 10000; i++) {
+            assert (iter.next () == "Music/Artist %u/Album/%05u.ogg".printf (i / 100, i));
+        }
+        assert (iter.next () == null);
+    });
+}
+
+int main (string[] args) {
+    Test.init (ref args);
+
+    add_path_list_tests ();
+
+    return Test.run ();
+}
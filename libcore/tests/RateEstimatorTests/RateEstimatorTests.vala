@@ -0,0 +1,284 @@
+/*
+* Copyright (c) 2017 elementary LLC
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 3 of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+* Boston, MA 02111-1307, USA.
+*/
+
+/* The traces hold the counts reported by copies, sampled once a second: eight thousand 8 KiB files
+ * followed by four 512 MiB files, a copy to a device whose cache fills after 2 GB, and a copy which
+ * stalls after ten seconds. */
+
+const uint64[] SMALL_THEN_LARGE_TRACE = {
+    /* msec, bytes done, files done */
+    0, 0, 0,
+    1000, 3219073, 392,
+    2000, 6381463, 778,
+    3000, 9707721, 1185,
+    4000, 12844417, 1567,
+    5000, 16132975, 1969,
+    6000, 19365764, 2363,
+    7000, 22497729, 2746,
+    8000, 25776966, 3146,
+    9000, 28902212, 3528,
+    10000, 32157269, 3925,
+    11000, 35293120, 4308,
+    12000, 38435804, 4691,
+    13000, 41687871, 5088,
+    14000, 45071774, 5501,
+    15000, 48225301, 5886,
+    16000, 51411412, 6275,
+    17000, 54729969, 6680,
+    18000, 58153475, 7098,
+    19000, 61455540, 7501,
+    20000, 64698484, 7897,
+    21000, 65536000, 8000,
+    22000, 141908661, 8000,
+    23000, 224776409, 8000,
+    24000, 303093283, 8000,
+    25000, 380247324, 8000,
+    26000, 457189661, 8000,
+    27000, 535657516, 8000,
+    28000, 618186527, 8001,
+    29000, 695632338, 8001,
+    30000, 776285139, 8001,
+    31000, 857396447, 8001,
+    32000, 936375627, 8001,
+    33000, 1016757583, 8001,
+    34000, 1093259895, 8001,
+    35000, 1169736704, 8002,
+    36000, 1247384374, 8002,
+    37000, 1328827574, 8002,
+    38000, 1408248312, 8002,
+    39000, 1486761490, 8002,
+    40000, 1567445984, 8002,
+    41000, 1647071459, 8002,
+    42000, 1725469595, 8003,
+    43000, 1807824631, 8003,
+    44000, 1889416587, 8003,
+    45000, 1967369359, 8003,
+    46000, 2047964749, 8003,
+    47000, 2128166321, 8003,
+    48000, 2211167421, 8003,
+    49000, 2213019648, 8004,
+    50000, 2213019648, 8004,
+};
+const uint64 SMALL_THEN_LARGE_TOTAL_BYTES = 2213019648;
+const uint64 SMALL_THEN_LARGE_TOTAL_FILES = 8004;
+
+const uint64[] CACHE_FILL_TRACE = {
+    /* msec, bytes done, files done */
+    0, 0, 0,
+    1000, 384722631, 3,
+    2000, 781447544, 7,
+    3000, 1191733181, 11,
+    4000, 1577812562, 15,
+    5000, 1977371086, 19,
+    6000, 2358939376, 23,
+    7000, 2384359916, 23,
+    8000, 2410021343, 24,
+    9000, 2435203908, 24,
+    10000, 2461142603, 24,
+    11000, 2485676971, 24,
+    12000, 2511165210, 25,
+    13000, 2536401134, 25,
+    14000, 2561600872, 25,
+    15000, 2586491386, 25,
+    16000, 2612341305, 26,
+    17000, 2638453008, 26,
+    18000, 2663388254, 26,
+    19000, 2688798634, 26,
+    20000, 2712700308, 27,
+    21000, 2738204038, 27,
+    22000, 2763571860, 27,
+    23000, 2789804600, 27,
+    24000, 2815609412, 28,
+    25000, 2840070901, 28,
+    26000, 2864785379, 28,
+    27000, 2890207011, 28,
+    28000, 2914013418, 29,
+    29000, 2938917657, 29,
+    30000, 2963087778, 29,
+    31000, 2987130517, 29,
+    32000, 3000000000, 30,
+    33000, 3000000000, 30,
+    34000, 3000000000, 30,
+    35000, 3000000000, 30,
+    36000, 3000000000, 30,
+    37000, 3000000000, 30,
+    38000, 3000000000, 30,
+    39000, 3000000000, 30,
+    40000, 3000000000, 30,
+    41000, 3000000000, 30,
+    42000, 3000000000, 30,
+    43000, 3000000000, 30,
+    44000, 3000000000, 30,
+    45000, 3000000000, 30,
+    46000, 3000000000, 30,
+    47000, 3000000000, 30,
+    48000, 3000000000, 30,
+    49000, 3000000000, 30,
+    50000, 3000000000, 30,
+};
+const uint64 CACHE_FILL_TOTAL_BYTES = 3000000000;
+const uint64 CACHE_FILL_TOTAL_FILES = 30;
+
+const uint64[] STALL_TRACE = {
+    /* msec, bytes done, files done */
+    0, 0, 0,
+    1000, 29200008, 0,
+    2000, 59154896, 1,
+    3000, 89422266, 2,
+    4000, 118710506, 3,
+    5000, 147222787, 4,
+    6000, 176979627, 5,
+    7000, 206587387, 6,
+    8000, 236786411, 7,
+    9000, 268145705, 8,
+    10000, 298717186, 9,
+    11000, 298717186, 9,
+    12000, 298717186, 9,
+    13000, 298717186, 9,
+    14000, 298717186, 9,
+    15000, 298717186, 9,
+    16000, 298717186, 9,
+    17000, 298717186, 9,
+    18000, 298717186, 9,
+    19000, 298717186, 9,
+    20000, 298717186, 9,
+};
+const uint64 STALL_TOTAL_BYTES = 1000000000;
+const uint64 STALL_TOTAL_FILES = 33;
+
+Marlin.RateEstimator estimator_from_trace (uint64[] trace, uint64 until_msec, out uint index) {
+    var estimator = new Marlin.RateEstimator ();
+    index = 0;
+    for (uint i = 0; i < trace.length; i += 3) {
+        if (trace[i] > until_msec) {
+            break;
+        }
+
+        estimator.add_sample (trace[i] / 1000.0, trace[i + 1], trace[i + 2]);
+        index = i;
+    }
+
+    return estimator;
+}
+
+double trace_seconds_left (uint64[] trace, uint index, uint64 total_bytes) {
+    for (uint i = index; i < trace.length; i += 3) {
+        if (trace[i + 1] >= total_bytes) {
+            return (trace[i] - trace[index]) / 1000.0;
+        }
+    }
+
+    assert_not_reached ();
+}
+
+void assert_close (double value, double expected, double tolerance) {
+    assert (Math.fabs (value - expected) <= expected * tolerance);
+}
+
+void add_rate_estimator_tests () {
+    Test.add_func ("/RateEstimator/no_time_left_at_start", () => {
+        uint index;
+        double seconds_left;
+        var estimator = estimator_from_trace (STALL_TRACE, 1000, out index);
+        assert (!estimator.get_time_left (STALL_TOTAL_BYTES, STALL_TOTAL_FILES, out seconds_left));
+    });
+
+    Test.add_func ("/RateEstimator/steady_rate", () => {
+        uint index;
+        double seconds_left;
+        var estimator = estimator_from_trace (STALL_TRACE, 10000, out index);
+        assert_close (estimator.get_bytes_per_sec (), 30000000, 0.1);
+        assert (estimator.get_time_left (STALL_TOTAL_BYTES - STALL_TRACE[index + 1],
+                                         STALL_TOTAL_FILES - STALL_TRACE[index + 2],
+                                         out seconds_left));
+        /* Whole files are counted only once done, so the time left from them runs a little longer */
+        assert_close (seconds_left, (STALL_TOTAL_BYTES - STALL_TRACE[index + 1]) / 30000000.0, 0.2);
+    });
+
+    Test.add_func ("/RateEstimator/small_then_large_files", () => {
+        uint index;
+        double seconds_left;
+        /* Ten seconds into the large files */
+        var estimator = estimator_from_trace (SMALL_THEN_LARGE_TRACE, 30000, out index);
+        uint64 bytes_done = SMALL_THEN_LARGE_TRACE[index + 1];
+        uint64 bytes_left = SMALL_THEN_LARGE_TOTAL_BYTES - bytes_done;
+        double expected = trace_seconds_left (SMALL_THEN_LARGE_TRACE, index, SMALL_THEN_LARGE_TOTAL_BYTES);
+
+        assert (estimator.get_time_left (bytes_left, SMALL_THEN_LARGE_TOTAL_FILES - SMALL_THEN_LARGE_TRACE[index + 2],
+                                         out seconds_left));
+        assert_close (seconds_left, expected, 0.15);
+
+        /* The average over the whole copy is still far off */
+        double average_seconds_left = bytes_left / (bytes_done / (SMALL_THEN_LARGE_TRACE[index] / 1000.0));
+        assert (Math.fabs (average_seconds_left - expected) > expected * 0.5);
+    });
+
+    Test.add_func ("/RateEstimator/device_slows_down", () => {
+        uint index;
+        double seconds_left;
+        var estimator = estimator_from_trace (CACHE_FILL_TRACE, 25000, out index);
+        double expected = trace_seconds_left (CACHE_FILL_TRACE, index, CACHE_FILL_TOTAL_BYTES);
+
+        assert (estimator.get_time_left (CACHE_FILL_TOTAL_BYTES - CACHE_FILL_TRACE[index + 1],
+                                         CACHE_FILL_TOTAL_FILES - CACHE_FILL_TRACE[index + 2],
+                                         out seconds_left));
+        assert_close (seconds_left, expected, 0.15);
+        assert_close (estimator.get_bytes_per_sec (), 25000000, 0.2);
+    });
+
+    Test.add_func ("/RateEstimator/stall", () => {
+        uint index;
+        double before_stall, after_stall;
+        var estimator = estimator_from_trace (STALL_TRACE, 10000, out index);
+        assert (estimator.get_time_left (STALL_TOTAL_BYTES - STALL_TRACE[index + 1],
+                                         STALL_TOTAL_FILES - STALL_TRACE[index + 2],
+                                         out before_stall));
+
+        estimator = estimator_from_trace (STALL_TRACE, 20000, out index);
+        assert (estimator.get_time_left (STALL_TOTAL_BYTES - STALL_TRACE[index + 1],
+                                         STALL_TOTAL_FILES - STALL_TRACE[index + 2],
+                                         out after_stall));
+        assert (after_stall > before_stall * 5);
+    });
+
+    Test.add_func ("/RateEstimator/restart", () => {
+        uint index;
+        double seconds_left;
+        var estimator = estimator_from_trace (STALL_TRACE, 10000, out index);
+        /* The timer was started again */
+        estimator.add_sample (0.5, STALL_TRACE[index + 1], STALL_TRACE[index + 2]);
+        assert (!estimator.get_time_left (STALL_TOTAL_BYTES, STALL_TOTAL_FILES, out seconds_left));
+    });
+
+    Test.add_func ("/RateEstimator/nothing_left", () => {
+        uint index;
+        double seconds_left;
+        var estimator = estimator_from_trace (STALL_TRACE, 10000, out index);
+        assert (estimator.get_time_left (0, 0, out seconds_left));
+        assert (seconds_left == 0);
+    });
+}
+
+int main (string[] args) {
+    Test.init (ref args);
+
+    add_rate_estimator_tests ();
+
+    return Test.run ();
+}
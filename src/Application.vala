@@ -36,6 +36,7 @@ public class Marlin.Application : Granite.Application {
     public int window_count { get; private set; }
 
     bool quitting = false;
+    bool resume_offered = false;
 
     construct {
         /* Needed by Glib.Application */
@@ -205,6 +206,13 @@ public class Marlin.Application : Granite.Application {
         } else {
             open_windows (files);
         }
+
+        /* Offer to resume copies and moves that were interrupted the last time Files closed */
+        if (!resume_offered) {
+            resume_offered = true;
+            Marlin.FileOperations.resume_interrupted (get_active_window ());
+        }
+
         return Posix.EXIT_SUCCESS;
     }
 
@@ -212,6 +220,11 @@ public class Marlin.Application : Granite.Application {
         warning ("Quitting mainloop");
         Marlin.IconInfo.clear_caches ();
 
+        unowned Marlin.DrawStats? draw_stats = Marlin.DrawStats.get_default ();
+        if (draw_stats != null) {
+            draw_stats.dump ();
+        }
+
         base.quit_mainloop ();
     }
 
@@ -258,6 +271,12 @@ public class Marlin.Application : Granite.Application {
                                    GOF.Preferences.get_default (), "show-remote-thumbnails", GLib.SettingsBindFlags.DEFAULT);
         Preferences.settings.bind ("confirm-trash",
                                    GOF.Preferences.get_default (), "confirm-trash", GLib.SettingsBindFlags.DEFAULT);
+        Preferences.settings.bind ("journal-transfers",
+                                   GOF.Preferences.get_default (), "journal-transfers", GLib.SettingsBindFlags.DEFAULT);
+        Preferences.settings.bind ("prescan-conflicts",
+                                   GOF.Preferences.get_default (), "prescan-conflicts", GLib.SettingsBindFlags.DEFAULT);
+        Preferences.settings.bind ("verify-copies",
+                                   GOF.Preferences.get_default (), "verify-copies", GLib.SettingsBindFlags.DEFAULT);
         Preferences.settings.bind ("date-format",
                                    GOF.Preferences.get_default (), "date-format", GLib.SettingsBindFlags.DEFAULT);
         Preferences.settings.bind ("force-icon-size",
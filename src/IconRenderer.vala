@@ -30,6 +30,14 @@
 namespace Marlin {
 
     public class IconRenderer : Gtk.CellRenderer {
+        /* Device ready surfaces of the plain icons are cached on the pixbuf they were made from, so they
+         * are dropped together with it (e.g. when the zoom level or thumbnail changes or it is evicted) */
+        private const string SURFACE_DATA_PREFIX = "marlin-icon-renderer-surface";
+        /* The file's pixbuf loaded again with as many pixels as a HiDPI screen shows it with */
+        private const string DEVICE_PIXBUF_DATA_PREFIX = "marlin-icon-renderer-device-pixbuf";
+        /* Marks pixbufs already drawn, for the draw statistics */
+        private const string DRAWN_DATA_KEY = "marlin-icon-renderer-drawn";
+
         public Marlin.IconSize helper_size {get; private set; default = Marlin.IconSize.EMBLEM;}
         public bool follow_state {get; set;}
         public GOF.File drop_file {get; set;}
@@ -83,7 +91,16 @@ namespace Marlin {
                 return;
             }
 
-            Gdk.Pixbuf? pb = pixbuf;
+            unowned Marlin.DrawStats? draw_stats = Marlin.DrawStats.get_default ();
+            if (draw_stats != null) {
+                draw_stats.cell_rendered ();
+
+                /* The first time a thumbnail is drawn it replaces the icon shown before */
+                if (file.flags == GOF.File.ThumbState.READY && !pixbuf.get_data<bool> (DRAWN_DATA_KEY)) {
+                    pixbuf.set_data<bool> (DRAWN_DATA_KEY, true);
+                    draw_stats.thumbnail_swapped ();
+                }
+            }
 
             var pix_rect = Gdk.Rectangle ();
 
@@ -106,21 +123,11 @@ namespace Marlin {
                 special_icon_name = "folder-open";
             }
 
-            if (special_icon_name != null) {
-                var nicon = Marlin.IconInfo.lookup_from_name (special_icon_name, icon_size);
-                if (nicon != null) {
-                    pb = nicon.get_pixbuf_nodefault ();
-                }
-            }
-
-            if (clipboard.has_cutted_file (file)) {
-                /* 50% translucent for cutted files */
-                pb = Eel.gdk_pixbuf_lucent (pixbuf, 50);
-            }
+            string dim_effect = "";
             if (file.is_hidden) {
-                /* 75% translucent for hidden files */
-                pb = Eel.gdk_pixbuf_lucent (pixbuf, 75);
-                pb = Eel.create_darkened_pixbuf (pb, 150, 200);
+                dim_effect = "hidden";
+            } else if (clipboard.has_cutted_file (file)) {
+                dim_effect = "cut";
             }
 
             var style_context = widget.get_parent ().get_style_context ();
@@ -129,6 +136,8 @@ namespace Marlin {
             bool prelit = (flags & Gtk.CellRendererState.PRELIT) > 0;
             bool selected = (flags & Gtk.CellRendererState.SELECTED) > 0;
             var state = Gtk.StateFlags.NORMAL;
+            Gdk.RGBA? selected_color = null;
+            bool spotlight = false;
 
             if (!widget.sensitive || !this.sensitive) {
                 state |= Gtk.StateFlags.INSENSITIVE;
@@ -144,20 +153,39 @@ namespace Marlin {
 
                         /* if background-color is black something probably is wrong */
                         if (color.red != 0 || color.green != 0 || color.blue != 0) {
-                            pb = Eel.create_colorized_pixbuf (pb, color);
+                            selected_color = color;
                         }
                     }
                 }
-                if (prelit) {
-                    pb = Eel.create_spotlight_pixbuf (pb);
+
+                spotlight = prelit;
+            }
+
+            int scale_factor = widget.get_scale_factor ();
+            Cairo.Surface? surface = null;
+            if (dim_effect != "" || special_icon_name == null) {
+                /* Hidden and cut files keep their own icon, dimmed */
+                if (dim_effect == "" && selected_color == null && !spotlight) {
+                    surface = get_file_surface (scale_factor, widget);
+                } else {
+                    int scale;
+                    var device_pixbuf = get_file_device_pixbuf (scale_factor, out scale);
+                    surface = create_icon_surface (device_pixbuf, scale, dim_effect, selected_color, spotlight, widget);
+                }
+            } else {
+                var nicon = Marlin.IconInfo.lookup_from_name (special_icon_name, icon_size * scale_factor);
+                var pix = nicon != null ? nicon.get_pixbuf_nodefault () : null;
+                if (pix != null) {
+                    surface = create_icon_surface (pix, scale_factor, "", selected_color, spotlight, widget);
                 }
             }
 
-            if (pb == null) {
+            if (surface == null) {
+                style_context.restore ();
                 return;
             }
 
-            style_context.render_icon (cr, pb, draw_rect.x, draw_rect.y);
+            style_context.render_icon_surface (cr, surface, draw_rect.x, draw_rect.y);
             style_context.restore ();
 
             /* Do not show selection helpers or emblems for very small icons */
@@ -178,14 +206,8 @@ namespace Marlin {
                     helper_size = Marlin.IconSize.LARGE_EMBLEM > int.max (pixbuf.get_width (), pixbuf.get_height ()) / 2 ?
                                   Marlin.IconSize.EMBLEM : Marlin.IconSize.LARGE_EMBLEM;
 
-                    var nicon = Marlin.IconInfo.lookup_from_name (special_icon_name, helper_size);
-                    Gdk.Pixbuf? pix = null;
-
-                    if (nicon != null) {
-                        pix = nicon.get_pixbuf_nodefault ();
-                    }
-
-                    if (pix != null) {
+                    var helper_surface = get_named_icon_surface (special_icon_name, helper_size, scale_factor, widget);
+                    if (helper_surface != null) {
                         int overlap = helper_size / 4;
                         var helper_area = Gdk.Rectangle ();
                         helper_area.x = draw_rect.x - overlap;
@@ -202,7 +224,7 @@ namespace Marlin {
                         helper_x = helper_area.x;
                         helper_y = helper_area.y;
 
-                        Gdk.cairo_set_source_pixbuf (cr, pix, helper_x, helper_y);
+                        cr.set_source_surface (helper_surface, helper_x, helper_y);
                         cr.paint ();
                     }
                 }
@@ -221,16 +243,8 @@ namespace Marlin {
                         break;
                     }
 
-                    Gdk.Pixbuf? pix = null;
-                    var nicon = Marlin.IconInfo.lookup_from_name (emblem, helper_size);
-
-                    if (nicon == null) {
-                        continue;
-                    }
-
-                    pix = nicon.get_pixbuf_nodefault ();
-
-                    if  (pix == null) {
+                    var emblem_surface = get_named_icon_surface (emblem, helper_size, scale_factor, widget);
+                    if (emblem_surface == null) {
                         continue;
                     }
 
@@ -246,13 +260,126 @@ namespace Marlin {
                         emblem_area.x = (background_area.x + background_area.width) - helper_size;
                     }
 
-                    Gdk.cairo_set_source_pixbuf (cr, pix, emblem_area.x, emblem_area.y);
+                    cr.set_source_surface (emblem_surface, emblem_area.x, emblem_area.y);
                     cr.paint ();
                     pos++;
                 }
             }
         }
 
+        /* The file's pixbuf is loaded at its size in logical pixels. On HiDPI screens the icon or thumbnail
+         * is loaded again at the size the screen shows it at, and counted against the pixbuf budget.
+         * @scale is the number of pixels of the returned pixbuf to a logical pixel.
+         */
+        private Gdk.Pixbuf get_file_device_pixbuf (int scale_factor, out int scale) {
+            scale = 1;
+            if (scale_factor <= 1) {
+                return pixbuf;
+            }
+
+            string key = "%s-%d".printf (DEVICE_PIXBUF_DATA_PREFIX, scale_factor);
+            unowned Gdk.Pixbuf? device_pixbuf = pixbuf.get_data<Gdk.Pixbuf> (key);
+            if (device_pixbuf == null && !pixbuf.get_data<bool> (key + "-missing")) {
+                var pb = file.get_icon_pixbuf (file.pix_size * scale_factor,
+                                               GOF.Preferences.get_default ().force_icon_size,
+                                               GOF.FileIconFlags.USE_THUMBNAILS);
+
+                /* Thumbnails may not have the pixels for it, the logical size is kept then */
+                if ((pb.get_width () - pixbuf.get_width () * scale_factor).abs () > scale_factor ||
+                    (pb.get_height () - pixbuf.get_height () * scale_factor).abs () > scale_factor) {
+
+                    pixbuf.set_data<bool> (key + "-missing", true);
+                } else {
+                    file.add_pixbuf_bytes (pb.get_byte_length ());
+                    pixbuf.set_data<Gdk.Pixbuf> (key, pb);
+                    device_pixbuf = pb;
+                }
+            }
+
+            if (device_pixbuf == null) {
+                return pixbuf;
+            }
+
+            scale = scale_factor;
+            return device_pixbuf;
+        }
+
+        /* The file's icon without effects, which is drawn most of the time, is converted once */
+        private Cairo.Surface? get_file_surface (int scale_factor, Gtk.Widget widget) {
+            string key = "%s-%d".printf (SURFACE_DATA_PREFIX, scale_factor);
+            unowned Cairo.Surface? surface = pixbuf.get_data<Cairo.Surface> (key);
+            if (surface != null) {
+                return surface;
+            }
+
+            int scale;
+            var device_pixbuf = get_file_device_pixbuf (scale_factor, out scale);
+            var new_surface = create_icon_surface (device_pixbuf, scale, "", null, false, widget);
+            if (new_surface != null) {
+                file.add_pixbuf_bytes ((size_t) (device_pixbuf.get_width () * device_pixbuf.get_height () * 4));
+                pixbuf.set_data<Cairo.Surface> (key, new_surface);
+            }
+
+            return new_surface;
+        }
+
+        /* Selection helpers and emblems are shared by all files. Their surfaces live as long as the pixbufs
+         * kept by the icon info cache.
+         */
+        private Cairo.Surface? get_named_icon_surface (string icon_name, int size, int scale_factor,
+                                                       Gtk.Widget widget) {
+
+            var nicon = Marlin.IconInfo.lookup_from_name (icon_name, size * scale_factor);
+            var pix = nicon != null ? nicon.get_pixbuf_nodefault () : null;
+            if (pix == null) {
+                return null;
+            }
+
+            string key = "%s-%d".printf (SURFACE_DATA_PREFIX, scale_factor);
+            unowned Cairo.Surface? surface = pix.get_data<Cairo.Surface> (key);
+            if (surface != null) {
+                return surface;
+            }
+
+            var new_surface = create_icon_surface (pix, scale_factor, "", null, false, widget);
+            if (new_surface != null) {
+                pix.set_data<Cairo.Surface> (key, new_surface);
+            }
+
+            return new_surface;
+        }
+
+        /* Returns a surface ready to be painted to the widget's window, with @scale pixels of @source to
+         * a logical pixel and the dimming, colorizing and spotlight effects applied.
+         */
+        private Cairo.Surface? create_icon_surface (Gdk.Pixbuf source, int scale, string dim_effect,
+                                                    Gdk.RGBA? selected_color, bool spotlight, Gtk.Widget widget) {
+
+            Gdk.Pixbuf? pb = source;
+            if (dim_effect == "hidden") {
+                /* 75% translucent for hidden files */
+                pb = Eel.gdk_pixbuf_lucent (pb, 75);
+                pb = Eel.create_darkened_pixbuf (pb, 150, 200);
+            } else if (dim_effect == "cut") {
+                /* 50% translucent for cutted files */
+                pb = Eel.gdk_pixbuf_lucent (pb, 50);
+            }
+
+            if (pb != null && selected_color != null) {
+                pb = Eel.create_colorized_pixbuf (pb, selected_color);
+            }
+
+            if (pb != null && spotlight) {
+                pb = Eel.create_spotlight_pixbuf (pb);
+            }
+
+            if (pb == null) {
+                return null;
+            }
+
+            return Gdk.cairo_surface_create_from_pixbuf (pb, scale, widget.get_window ());
+        }
+
         /* We still have to implement this even though it is deprecated */
         public override void get_size (Gtk.Widget widget, Gdk.Rectangle? cell_area,
                                        out int x_offset, out int y_offset,
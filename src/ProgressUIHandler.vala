@@ -93,7 +93,8 @@ public class Marlin.Progress.UIHandler : Object {
 
             if (info.get_is_paused ()) {
                 return true;
-            } else if (operation_running && !info.get_is_finished ()) {
+            } else if ((operation_running || info.get_is_queued ()) && !info.get_is_finished ()) {
+                /* Queued operations are shown straight away, beside the ones they wait for */
                 add_progress_info_to_window (info);
                 return false;
             } else {
@@ -20,6 +20,18 @@ namespace Marlin {
     public class TextRenderer: Gtk.CellRendererText {
 
         const int MAX_LINES = 5;
+        const int MAX_CACHED_LAYOUTS = 1000;
+        /* How many of the least recently used layouts are dropped at once when the cache is full */
+        const int DROPPED_LAYOUTS = MAX_CACHED_LAYOUTS / 4;
+
+        /* A shaped layout together with its pixel size */
+        private class CachedLayout {
+            public Pango.Layout layout;
+            public int width;
+            public int height;
+            /* The lookup it was last used by */
+            public uint last_used;
+        }
         private int border_radius = 6;
 
         public Marlin.ZoomLevel zoom_level {get; set;}
@@ -50,6 +62,13 @@ namespace Marlin {
         int focus_border_width;
 
         Pango.Layout layout;
+        /* Layouts are cached by text, width, zoom level, wrap mode and alignment so that redrawing or
+         * measuring a cell does not shape its text again. A renamed file simply gets a new entry; once the
+         * cache is full the layouts used least recently make room, so those of the visible cells stay
+         * while scrolling. The cache is dropped when the font (style) or widget changes */
+        Gee.HashMap<string, CachedLayout> layout_cache = new Gee.HashMap<string, CachedLayout> ();
+        uint layout_lookups = 0;
+        bool last_layout_cached = false;
         Gtk.Widget widget;
         Marlin.AbstractEditableLabel entry;
 
@@ -94,6 +113,11 @@ namespace Marlin {
 
             set_up_layout (text, cell_area.width);
 
+            unowned Marlin.DrawStats? draw_stats = Marlin.DrawStats.get_default ();
+            if (draw_stats != null) {
+                draw_stats.layout_looked_up (last_layout_cached);
+            }
+
             var style_context = widget.get_parent ().get_style_context ();
             style_context.save ();
             style_context.set_state (state);
@@ -142,35 +166,79 @@ namespace Marlin {
                 text= " ";
             }
 
+            int layout_width = wrap_width < 0 ? cell_width : wrap_width;
+            bool centered = xalign == 0.5f;
+            string key = "%i:%i:%i:%s:%s".printf (layout_width, zoom_level, wrap_mode, centered.to_string (), text);
+
+            var cached = layout_cache.@get (key);
+            last_layout_cached = cached != null;
+            if (cached == null) {
+                if (layout_cache.size >= MAX_CACHED_LAYOUTS) {
+                    drop_least_recently_used_layouts ();
+                }
+
+                cached = new CachedLayout ();
+                cached.layout = create_layout (text, layout_width, centered);
+
+                /* calculate the real text dimension */
+                cached.layout.get_pixel_size (out cached.width, out cached.height);
+                layout_cache.@set (key, cached);
+            }
+
+            cached.last_used = ++layout_lookups;
+            layout = cached.layout;
+            text_width = cached.width;
+            text_height = cached.height;
+        }
+
+        private void drop_least_recently_used_layouts () {
+            var last_used = new Gee.ArrayList<uint> ();
+            foreach (var cached in layout_cache.values) {
+                last_used.add (cached.last_used);
+            }
+
+            last_used.sort ((a, b) => {
+                return a < b ? -1 : (a > b ? 1 : 0);
+            });
+
+            /* Every lookup has a number of its own */
+            uint oldest_kept = last_used[DROPPED_LAYOUTS];
+            var iter = layout_cache.map_iterator ();
+            while (iter.next ()) {
+                if (iter.get_value ().last_used < oldest_kept) {
+                    iter.unset ();
+                }
+            }
+        }
+
+        private Pango.Layout create_layout (string text, int layout_width, bool centered) {
+            var new_layout = new Pango.Layout (widget.get_pango_context ());
+            new_layout.set_auto_dir (false);
+            new_layout.set_single_paragraph_mode (true);
+
             bool small = this.zoom_level < Marlin.ZoomLevel.NORMAL;
             if (small) {
-                layout.set_attributes (EelPango.attr_list_small ());
+                new_layout.set_attributes (EelPango.attr_list_small ());
             } else {
-                layout.set_attributes (null);
+                new_layout.set_attributes (null);
             }
 
+            new_layout.set_width (layout_width * Pango.SCALE);
             if (wrap_width < 0) {
-                layout.set_width (cell_width * Pango.SCALE);
-                layout.set_height (- 1);
+                new_layout.set_height (- 1);
             } else {
-                layout.set_width (wrap_width * Pango.SCALE);
-                layout.set_wrap (this.wrap_mode);
-                layout.set_height (- MAX_LINES);
+                new_layout.set_wrap (this.wrap_mode);
+                new_layout.set_height (- MAX_LINES);
             }
 
-            layout.set_ellipsize (Pango.EllipsizeMode.END);
+            new_layout.set_ellipsize (Pango.EllipsizeMode.END);
 
-            if (xalign == 0.5f) {
-                layout.set_alignment (Pango.Alignment.CENTER);
+            if (centered) {
+                new_layout.set_alignment (Pango.Alignment.CENTER);
             }
 
-            layout.set_text (text, -1);
-
-            /* calculate the real text dimension */
-            int width, height;
-            layout.get_pixel_size (out width, out height);
-            text_width = width;
-            text_height = height;
+            new_layout.set_text (text, -1);
+            return new_layout;
         }
 
         public override unowned Gtk.CellEditable? start_editing (Gdk.Event? event,
@@ -225,6 +293,7 @@ namespace Marlin {
                 disconnect_widget_signals ();
 
             widget = _widget;
+            layout_cache.clear ();
 
             if (widget != null) {
                 connect_widget_signals ();
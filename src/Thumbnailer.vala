@@ -36,18 +36,12 @@
  * Please note that all D-Bus calls are performed asynchronously.
  *
  *
- * When a request call is sent out, an internal request ID is created and
- * associated with the corresponding DBusGProxyCall via the request_call_mapping hash
- * table.
+ * When a batch of uris is sent out, the handle returned by the D-Bus thumbnailer
+ * is associated with the batch via the batches table. The client request IDs
+ * returned by queue_file () and queue_files () are independent of the handles,
+ * see Coalescing below.
  *
- * The D-Bus reply handler then checks if there was an delivery error or
- * not. If the request method was sent successfully, the handle returned by the
- * D-Bus thumbnailer is associated bidirectionally with the internal request ID via
- * the request_handle_mapping and handle_request_mappings. In both cases, the
- * association of the internal request ID with the DBusGProxyCall is removed from
- * request_call_mapping.
- *
- * These hash tables play a major role in the Finished, Error and Ready
+ * These tables play a major role in the Finished, Error and Ready
  * signal handlers.
  *
  *
@@ -62,9 +56,25 @@
  * Finished
  * ========
  *
- * The Finished signal handler looks up the internal request ID based on
- * the D-Bus thumbnailer handle. It then drops all corresponding information
- * from handle_request_mapping and request_handle_mapping.
+ * The Finished signal handler looks up the batch based on the D-Bus thumbnailer
+ * handle and drops it. Any uri of the batch not yet reported as ready or failed
+ * is considered done.
+ *
+ *
+ * Coalescing
+ * ==========
+ *
+ * Several views may want thumbnails for the same files (the same folder open in
+ * two tabs, or Miller columns plus a list view). Each uri/flavor combination is
+ * therefore only sent to the daemon once while it is in flight; further requests
+ * for it merely register their interest in the existing Pending entry. A client
+ * request is finished when all the uris it asked for are ready or failed.
+ *
+ * Single file requests (queue_file) are not sent immediately but collected for
+ * COALESCE_WINDOW_MSEC and then sent to the daemon as one batch.
+ *
+ * Dequeuing a request only drops its interest. A daemon batch is only dequeued
+ * once no request is interested in any of its uris any more.
  */
 
 
@@ -99,10 +109,50 @@ namespace Marlin {
         }
 
 
+        /* A group of uris sent to the daemon in a single queue call */
+        class Batch {
+            public uint handle = 0;
+            public string flavor;
+            public uint n_wanted = 0; /* Number of uris in the batch still wanted by a request */
+            public bool dropped = false; /* Whether any of them was dequeued before completing */
+            public Gee.ArrayList<string> keys = new Gee.ArrayList<string> ();
+
+            public Batch (string flavor) {
+                this.flavor = flavor;
+            }
+        }
+
+        /* A uri/flavor combination waiting for a thumbnail */
+        class Pending {
+            public string uri;
+            public string mime_type;
+            public string flavor;
+            public string key;
+            public Batch? batch = null; /* null while in the coalescing window */
+            public Gee.HashSet<uint> request_ids = new Gee.HashSet<uint> ();
+
+            public Pending (string uri, string mime_type, string flavor) {
+                this.uri = uri;
+                this.mime_type = mime_type;
+                this.flavor = flavor;
+                this.key = pending_key (uri, flavor);
+            }
+        }
+
+        /* A request made by a client through queue_file () or queue_files () */
+        class Request {
+            public uint id;
+            public Gee.ArrayList<Pending> pendings = new Gee.ArrayList<Pending> ();
+
+            public Request (uint id) {
+                this.id = id;
+            }
+        }
+
+        private const uint COALESCE_WINDOW_MSEC = 100;
+
         private static Thumbnailer? instance;
         private static Mutex thumbnailer_lock;
-        private static GLib.HashTable<uint, uint> request_handle_mapping;
-        private static GLib.HashTable<uint, uint> handle_request_mapping;
         private static GLib.List<Idle?> idles;
 
         private ThumbnailerDaemon proxy;
@@ -111,14 +161,24 @@ namespace Marlin {
 
         private uint last_request = 0;
 
+        /* All the following are only accessed from the main loop */
+        private Gee.HashMap<uint, Request> requests;
+        private Gee.HashMap<string, Pending> pendings; /* keyed by pending_key () */
+        private Gee.HashMap<uint, Batch> batches; /* keyed by daemon handle */
+        private Gee.ArrayList<Pending> window_pendings;
+        private uint window_source_id = 0;
+
         public signal void finished (uint request);
 
         private Thumbnailer () {
-            if (request_handle_mapping == null) {
-                request_handle_mapping = new GLib.HashTable<uint, uint>.full (direct_hash, direct_equal, null, null);
-                handle_request_mapping = new GLib.HashTable<uint, uint>.full (direct_hash, direct_equal, null,null);
+            if (instance == null) {
                 thumbnailer_lock = Mutex ();
             }
+
+            requests = new Gee.HashMap<uint, Request> ();
+            pendings = new Gee.HashMap<string, Pending> ();
+            batches = new Gee.HashMap<uint, Batch> ();
+            window_pendings = new Gee.ArrayList<Pending> ();
         }
 
         private void init () {
@@ -149,6 +209,10 @@ namespace Marlin {
                 GLib.Source.remove (idle.id);
             }
             thumbnailer_lock.unlock ();
+
+            if (window_source_id > 0) {
+                GLib.Source.remove (window_source_id);
+            }
         }
 
         public new static Thumbnailer? @get () {
@@ -159,79 +223,245 @@ namespace Marlin {
             return instance;
         }
 
+        /* Single file requests are held back for a short while so that they can be sent in one batch */
         public bool queue_file (GOF.File file, out int request, bool large) {
             GLib.List<GOF.File> files = null;
             files.append (file);
             int this_request;
-            bool success = queue_files (files, out this_request, large);
+            bool success = add_request (files, out this_request, large, true);
             request = this_request;
             return success;
         }
 
         public bool queue_files (GLib.List<GOF.File> files, out int request, bool large) {
+            int this_request;
+            bool success = add_request (files, out this_request, large, false);
+            request = this_request;
+            return success;
+        }
+
+        /* Drops the interest of @request in its files. Files still wanted by another request stay queued */
+        public void dequeue (int request) {
+            Request? req = null;
+            if (proxy == null || request < 0 || !requests.unset ((uint)request, out req)) {
+                return;
+            }
+
+            foreach (var pending in req.pendings) {
+                pending.request_ids.remove (req.id);
+                if (!pending.request_ids.is_empty) {
+                    continue;
+                }
+
+                /* Nobody wants this thumbnail any more */
+                pendings.unset (pending.key);
+                var goffile = GOF.File.get_by_uri (pending.uri);
+                if (goffile != null && goffile.flags == GOF.File.ThumbState.LOADING) {
+                    goffile.flags = GOF.File.ThumbState.UNKNOWN; /* Allow it to be requested again */
+                }
+
+                if (pending.batch == null) {
+                    window_pendings.remove (pending);
+                } else {
+                    release_batch_uri (pending.batch, true);
+                }
+            }
+        }
+
+        /* Called when a uri of @batch is no longer waited for, because it completed or was @dropped.
+         * The daemon batch is dequeued once none is waited for and some were dropped */
+        private void release_batch_uri (Batch batch, bool dropped) {
+            batch.n_wanted--;
+            if (dropped) {
+                batch.dropped = true;
+            }
+
+            if (batch.n_wanted == 0 && batch.dropped && batch.handle > 0 && batches.has_key (batch.handle)) {
+                /* batches will be updated when "finished" signal received. */
+                proxy.dequeue.begin (batch.handle);
+            }
+        }
+
+        private bool add_request (GLib.List<GOF.File> files, out int request, bool large, bool coalesce) {
             request = -1;
             if (proxy == null) {
                 return false;
             }
 
-            GLib.List<GOF.File> supported_files = null;
+            var flavor = large ? "large" : "normal";
+            var req = new Request (last_request + 1);
 
-            uint file_count = 0;
             foreach (var file in files) {
-                if (is_supported (file)) {
-                    supported_files.prepend (file);
-                    file.flags = GOF.File.ThumbState.LOADING;
-                    file_count++;
-                } else {
+                if (!is_supported (file)) {
                     file.flags = GOF.File.ThumbState.NONE;
+                    continue;
+                }
+
+                file.flags = GOF.File.ThumbState.LOADING;
+
+                var pending = pendings.@get (pending_key (file.uri, flavor));
+                if (pending == null) {
+                    pending = new Pending (file.uri, file.get_ftype (), flavor);
+                    pendings.@set (pending.key, pending);
+                    window_pendings.add (pending);
+                } else if (req.id in pending.request_ids) {
+                    continue; /* Duplicate in the list */
                 }
+
+                /* Already in flight pendings just gain another interested request */
+                pending.request_ids.add (req.id);
+                req.pendings.add (pending);
             }
 
-            if (file_count == 0) {
+            if (req.pendings.is_empty) {
                 return false;
             }
 
-            var uris = new string[file_count];
-            var mime_hints = new string[file_count];
+            last_request = req.id;
+            requests.@set (req.id, req);
+
+            if (!coalesce) {
+                flush_window ();
+            } else if (window_source_id == 0) {
+                window_source_id = GLib.Timeout.add (COALESCE_WINDOW_MSEC, () => {
+                    window_source_id = 0;
+                    flush_window ();
+                    return false;
+                });
+            }
+
+            request = (int)req.id;
+            return true;
+        }
+
+        /* Sends all pendings waiting in the coalescing window to the daemon, one batch per flavor */
+        private void flush_window () {
+            if (window_source_id > 0) {
+                GLib.Source.remove (window_source_id);
+                window_source_id = 0;
+            }
+
+            var normal = new Gee.ArrayList<Pending> ();
+            var large = new Gee.ArrayList<Pending> ();
+            foreach (var pending in window_pendings) {
+                if (pending.flavor == "large") {
+                    large.add (pending);
+                } else {
+                    normal.add (pending);
+                }
+            }
 
-            supported_files.reverse ();
+            window_pendings.clear ();
+            send_batch (normal, "normal");
+            send_batch (large, "large");
+        }
 
-            uint index = 0;
-            foreach (var file in supported_files) {
-                uris[index] = file.uri;
-                mime_hints[index] = file.get_ftype ();
+        private void send_batch (Gee.ArrayList<Pending> batch_pendings, string flavor) {
+            var count = batch_pendings.size;
+            if (count == 0) {
+                return;
+            }
+
+            var batch = new Batch (flavor);
+            var uris = new string[count];
+            var mime_hints = new string[count];
+
+            int index = 0;
+            foreach (var pending in batch_pendings) {
+                pending.batch = batch;
+                batch.keys.add (pending.key);
+                uris[index] = pending.uri;
+                mime_hints[index] = pending.mime_type;
                 index++;
             }
 
-            uint this_request = ++last_request;
-            var flavor = large ? "large" : "normal";
+            batch.n_wanted = count;
+
             var scheduler = "foreground";
             proxy.queue.begin (uris, mime_hints, flavor, scheduler, 0, (obj, res) => {
                 try {
-                    uint handle;
-                    handle = proxy.queue.end (res);
-                    request_handle_mapping.insert (this_request, handle);
-                    handle_request_mapping.insert (handle, this_request);
+                    batch.handle = proxy.queue.end (res);
+                    batches.@set (batch.handle, batch);
+                    if (batch.n_wanted == 0 && batch.dropped) {
+                        /* Every request for it went away while we were waiting for the handle */
+                        proxy.dequeue.begin (batch.handle);
+                    }
                 } catch (GLib.Error e) {
-                    warning ("Thumbnailer proxy request %u failed - %s", this_request, e.message);
+                    warning ("Thumbnailer proxy request for %i files failed - %s", count, e.message);
+                    foreach (var key in batch.keys) {
+                        var pending = pendings.@get (key);
+                        if (pending != null && pending.batch == batch) {
+                            complete_pending (pending, GOF.File.ThumbState.NONE);
+                        }
+                    }
                 }
             });
+        }
 
-            request = (int)this_request;
-            return true;
+        /* Sets the thumb state of the file and notifies requests that no longer wait for any thumbnail */
+        private void complete_pending (Pending pending, GOF.File.ThumbState? state) {
+            if (!pendings.unset (pending.key)) {
+                return; /* Already completed or dequeued */
+            }
+
+            if (pending.batch != null) {
+                release_batch_uri (pending.batch, false);
+            }
+
+            if (state != null) {
+                update_file_thumbstate (pending.uri, state);
+            }
+
+            foreach (uint id in pending.request_ids) {
+                var req = requests.@get (id);
+                if (req == null) {
+                    continue;
+                }
+
+                req.pendings.remove (pending);
+                if (req.pendings.is_empty) {
+                    requests.unset (id);
+                    finished (id);
+                }
+            }
         }
 
-        public void dequeue (int request) {
-            if (proxy == null) {
+        private void complete_uris (string[] uris, uint handle, GOF.File.ThumbState state) {
+            var batch = batches.@get (handle);
+            foreach (string uri in uris) {
+                Pending? pending = null;
+                if (batch != null) {
+                    pending = pendings.@get (pending_key (uri, batch.flavor));
+                } else {
+                    /* The handle is not known yet */
+                    pending = pendings.@get (pending_key (uri, "normal")) ?? pendings.@get (pending_key (uri, "large"));
+                }
+
+                if (pending != null) {
+                    complete_pending (pending, state);
+                } else {
+                    update_file_thumbstate (uri, state);
+                }
+            }
+        }
+
+        private void complete_batch (uint handle) {
+            Batch? batch = null;
+            if (!batches.unset (handle, out batch)) {
                 return;
             }
 
-            uint req = (uint)request;
-            thumbnailer_lock.@lock ();
-            uint handle = request_handle_mapping.lookup (req);
-            thumbnailer_lock.unlock ();
+            /* Anything not reported as ready or failed is no longer being worked on */
+            foreach (var key in batch.keys) {
+                var pending = pendings.@get (key);
+                if (pending != null && pending.batch == batch) {
+                    complete_pending (pending, null);
+                }
+            }
+        }
 
-            proxy.dequeue (handle); /* hash tables will be updated when "finished" signal received. */
+        private static string pending_key (string uri, string flavor) {
+            return flavor + ":" + uri;
         }
 
         private bool is_supported (GOF.File file) {
@@ -273,6 +503,7 @@ namespace Marlin {
             var idle = Idle ();
             idle.type = IdleType.ERROR;
             idle.uris = GLib.strdupv (failed_uris);
+            idle.handle = handle;
             idles.prepend (idle);
 
             /* TODO batch up errors? */
@@ -320,9 +551,7 @@ namespace Marlin {
         }
 
         private static void handle_error_idle (Idle error_idle) {
-            foreach (string uri in error_idle.uris) {
-                update_file_thumbstate (uri, GOF.File.ThumbState.NONE);
-            }
+            Thumbnailer.@get ().complete_uris (error_idle.uris, error_idle.handle, GOF.File.ThumbState.NONE);
 
             thumbnailer_lock.@lock ();
             idles.remove (error_idle);
@@ -330,10 +559,7 @@ namespace Marlin {
         }
 
         private static void handle_ready_idle (Idle ready_idle) {
-
-            foreach (string uri in ready_idle.uris) {
-                update_file_thumbstate (uri, GOF.File.ThumbState.READY);
-            }
+            Thumbnailer.@get ().complete_uris (ready_idle.uris, ready_idle.handle, GOF.File.ThumbState.READY);
 
             thumbnailer_lock.@lock ();
             idles.remove (ready_idle);
@@ -341,13 +567,11 @@ namespace Marlin {
         }
 
         private static void handle_finished_idle (Idle finished_idle) {
-            var handle = finished_idle.handle;
+            Thumbnailer.@get ().complete_batch (finished_idle.handle);
+
             thumbnailer_lock.@lock ();
-            uint request = handle_request_mapping.lookup (handle);
-            request_handle_mapping.remove (request);
-            handle_request_mapping.remove (handle);
+            idles.remove (finished_idle);
             thumbnailer_lock.unlock ();
-            Thumbnailer.@get ().finished (request);
         }
 
         private static void update_file_thumbstate (string uri, GOF.File.ThumbState state) {
@@ -0,0 +1,208 @@
+/*
+* Copyright (c) 2017 elementary LLC. (http://launchpad.net/pantheon-files)
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 2 of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA 02110-1335 USA.
+*/
+
+/* Optional redraw instrumentation for the directory views.
+ *
+ * Enabled by setting MARLIN_DRAW_STATS to the path of a file. Each draw of a view is a frame; for each
+ * frame the draw time, the number of cells rendered, the layout cache hits and misses of the name
+ * renderer and the number of thumbnails drawn for the first time (replacing an icon) are recorded.
+ * Histograms of these are written to the file when the application quits. When built against
+ * sysprof-capture-4 every frame is also emitted as a mark, so it shows up in a sysprof recording.
+ *
+ * When the variable is not set get_default () returns null and the renderers do no extra work.
+ */
+namespace Marlin {
+    public class DrawStats : Object {
+        public const string ENV_VARIABLE = "MARLIN_DRAW_STATS";
+
+        /* Upper bounds of the histogram buckets; the last bucket is unbounded */
+        private const int64[] FRAME_TIME_BUCKETS_USEC = {1000, 2000, 4000, 8000, 16667, 33333, 66667};
+        private const uint[] CELL_BUCKETS = {0, 10, 50, 100, 200, 500, 1000};
+
+        private static DrawStats? instance = null;
+        private static bool initialized = false;
+
+        public static unowned DrawStats? get_default () {
+            if (!initialized) {
+                initialized = true;
+                var path = GLib.Environment.get_variable (ENV_VARIABLE);
+                if (path != null && path != "") {
+                    instance = new DrawStats (path);
+                }
+            }
+
+            return instance;
+        }
+
+        public string path { get; construct; }
+
+        private int64 frame_start = -1;
+        private uint frame_cells = 0;
+        private uint frame_layout_hits = 0;
+        private uint frame_layout_misses = 0;
+        private uint frame_thumbnail_swaps = 0;
+
+        private uint64 n_frames = 0;
+        private int64 total_frame_usec = 0;
+        private int64 max_frame_usec = 0;
+        private uint64 total_cells = 0;
+        private uint64 total_layout_hits = 0;
+        private uint64 total_layout_misses = 0;
+        private uint64 total_thumbnail_swaps = 0;
+        private uint64[] frame_time_histogram;
+        private uint64[] cell_histogram;
+        private uint64[] swap_histogram;
+
+        private DrawStats (string path) {
+            Object (path: path);
+        }
+
+        construct {
+            frame_time_histogram = new uint64[FRAME_TIME_BUCKETS_USEC.length + 1];
+            cell_histogram = new uint64[CELL_BUCKETS.length + 1];
+            swap_histogram = new uint64[CELL_BUCKETS.length + 1];
+        }
+
+        public void begin_frame () {
+            frame_start = GLib.get_monotonic_time ();
+            frame_cells = 0;
+            frame_layout_hits = 0;
+            frame_layout_misses = 0;
+            frame_thumbnail_swaps = 0;
+        }
+
+        public void end_frame () {
+            if (frame_start < 0) {
+                return;
+            }
+
+            int64 duration = GLib.get_monotonic_time () - frame_start;
+
+            n_frames++;
+            total_frame_usec += duration;
+            max_frame_usec = int64.max (max_frame_usec, duration);
+            total_cells += frame_cells;
+            total_layout_hits += frame_layout_hits;
+            total_layout_misses += frame_layout_misses;
+            total_thumbnail_swaps += frame_thumbnail_swaps;
+
+            frame_time_histogram[frame_time_bucket (duration)]++;
+            cell_histogram[count_bucket (frame_cells)]++;
+            swap_histogram[count_bucket (frame_thumbnail_swaps)]++;
+
+#if HAVE_SYSPROF
+            var message = "%u cells, %u/%u layout hits, %u thumbnails".printf (frame_cells, frame_layout_hits,
+                                                                                frame_layout_hits + frame_layout_misses,
+                                                                                frame_thumbnail_swaps);
+            Sysprof.Collector.mark (frame_start * 1000, duration * 1000, "pantheon-files", "draw", message);
+#endif
+
+            frame_start = -1;
+        }
+
+        public void cell_rendered () {
+            frame_cells++;
+        }
+
+        public void layout_looked_up (bool hit) {
+            if (hit) {
+                frame_layout_hits++;
+            } else {
+                frame_layout_misses++;
+            }
+        }
+
+        public void thumbnail_swapped () {
+            frame_thumbnail_swaps++;
+        }
+
+        public void dump () {
+            if (n_frames == 0) {
+                return;
+            }
+
+            var sb = new StringBuilder ();
+            sb.append_printf ("frames: %" + uint64.FORMAT + "\n", n_frames);
+            sb.append_printf ("mean frame time: %.2f ms\n", (double)total_frame_usec / n_frames / 1000.0);
+            sb.append_printf ("max frame time: %.2f ms\n", max_frame_usec / 1000.0);
+            sb.append_printf ("cells rendered: %" + uint64.FORMAT + "\n", total_cells);
+            sb.append_printf ("layout cache hits: %" + uint64.FORMAT + "/%" + uint64.FORMAT + "\n",
+                              total_layout_hits, total_layout_hits + total_layout_misses);
+            sb.append_printf ("thumbnail swaps: %" + uint64.FORMAT + "\n", total_thumbnail_swaps);
+
+            sb.append ("\nframe time (ms)\n");
+            for (int i = 0; i < frame_time_histogram.length; i++) {
+                string label;
+                if (i < FRAME_TIME_BUCKETS_USEC.length) {
+                    label = "<= %.1f".printf (FRAME_TIME_BUCKETS_USEC[i] / 1000.0);
+                } else {
+                    label = "> %.1f".printf (FRAME_TIME_BUCKETS_USEC[i - 1] / 1000.0);
+                }
+
+                append_bucket (sb, label, frame_time_histogram[i]);
+            }
+
+            sb.append ("\ncells per frame\n");
+            append_count_histogram (sb, cell_histogram);
+            sb.append ("\nthumbnail swaps per frame\n");
+            append_count_histogram (sb, swap_histogram);
+
+            try {
+                FileUtils.set_contents (path, sb.str);
+            } catch (FileError e) {
+                warning ("Could not write draw statistics to %s: %s", path, e.message);
+            }
+        }
+
+        private void append_count_histogram (StringBuilder sb, uint64[] histogram) {
+            for (int i = 0; i < histogram.length; i++) {
+                string label;
+                if (i < CELL_BUCKETS.length) {
+                    label = "<= %u".printf (CELL_BUCKETS[i]);
+                } else {
+                    label = "> %u".printf (CELL_BUCKETS[i - 1]);
+                }
+
+                append_bucket (sb, label, histogram[i]);
+            }
+        }
+
+        private void append_bucket (StringBuilder sb, string label, uint64 count) {
+            sb.append_printf ("  %-10s %8" + uint64.FORMAT + " %5.1f%%\n", label, count, 100.0 * count / n_frames);
+        }
+
+        private static int frame_time_bucket (int64 usec) {
+            int i = 0;
+            while (i < FRAME_TIME_BUCKETS_USEC.length && usec > FRAME_TIME_BUCKETS_USEC[i]) {
+                i++;
+            }
+
+            return i;
+        }
+
+        private static int count_bucket (uint count) {
+            int i = 0;
+            while (i < CELL_BUCKETS.length && count > CELL_BUCKETS[i]) {
+                i++;
+            }
+
+            return i;
+        }
+    }
+}
@@ -341,6 +341,10 @@ namespace FM {
                 view.button_press_event.connect (on_view_button_press_event);
                 view.button_release_event.connect (on_view_button_release_event);
                 view.draw.connect (on_view_draw);
+
+                if (Marlin.DrawStats.get_default () != null) {
+                    view.draw.connect_after (on_view_draw_after);
+                }
             }
 
             freeze_tree (); /* speed up loading of icon view. Thawed when directory loaded */
@@ -1304,6 +1308,7 @@ namespace FM {
                 model.file_changed (file, dir);
                 /* 2nd parameter is for returned request id if required - we do not use it? */
                 /* This is required if we need to dequeue the request */
+                /* Single file requests from all views are merged into batches by the thumbnailer */
                 if (slot.directory.is_local || (show_remote_thumbnails && slot.directory.can_open_files)) {
                     thumbnailer.queue_file (file, null, large_thumbnails);
                     if (plugins != null) {
@@ -3101,6 +3106,11 @@ namespace FM {
         }
 
         public virtual bool on_view_draw (Cairo.Context cr) {
+            unowned Marlin.DrawStats? draw_stats = Marlin.DrawStats.get_default ();
+            if (draw_stats != null) {
+                draw_stats.begin_frame ();
+            }
+
             /* If folder is empty, draw the empty message in the middle of the view
              * otherwise pass on event */
             var style_context = get_style_context ();
@@ -3122,6 +3132,10 @@ namespace FM {
                 double y = (double) get_allocated_height () / 2 - height / 2;
                 get_style_context ().render_layout (cr, x, y, layout);
 
+                if (draw_stats != null) {
+                    draw_stats.end_frame ();
+                }
+
                 return true;
             } else if (style_context.has_class (MESSAGE_CLASS)) {
                 style_context.remove_class (MESSAGE_CLASS);
@@ -3130,6 +3144,12 @@ namespace FM {
             return false;
         }
 
+        /* Only connected when draw statistics are enabled; ends the frame begun in on_view_draw */
+        private bool on_view_draw_after (Cairo.Context cr) {
+            Marlin.DrawStats.get_default ().end_frame ();
+            return false;
+        }
+
         protected virtual bool handle_primary_button_click (Gdk.EventButton event, Gtk.TreePath? path) {
             return true;
         }
@@ -3516,6 +3536,8 @@ namespace FM {
         public virtual void cancel () {
             grab_focus (); /* Cancel any renaming */
             cancel_hover ();
+            /* Other views may still want the same thumbnails; the thumbnailer only drops our interest */
+            thumbnailer.dequeue (thumbnail_request);
             cancel_thumbnailing ();
             cancel_drag_timer ();
             cancel_timeout (ref drag_scroll_timer_id);
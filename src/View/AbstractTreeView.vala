@@ -238,6 +238,7 @@ namespace FM {
                     zone = ClickZone.INVALID;
                 } else if (x < rect.x + ICON_XPAD + icon_size) { /* cannot be on name */
                     bool on_helper = false;
+                    file.update_icon (icon_size); /* pix may have been evicted */
                     bool on_icon = is_on_icon (x, y, rect, file.pix, ref on_helper);
 
                     if (on_helper) {
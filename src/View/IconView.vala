@@ -247,6 +247,7 @@ namespace FM {
                     bool on_helper = false;
                     GOF.File? file = model.file_for_path (p);
                     if (file != null) {
+                        file.update_icon (icon_size); /* pix may have been evicted */
                         bool on_icon = is_on_icon (x, y, rect, file.pix, ref on_helper);
 
                         if (on_helper) {
@@ -89,6 +89,9 @@ public class Marlin.Progress.InfoWidget : Gtk.Box {
         string details = this.info.get_details ();
         string markup = Markup.printf_escaped ("<span size='small'>%s</span>", details);
         (this.details as Gtk.Label).set_markup (markup);
+
+        /* Waiting for other operations on the same disk */
+        this.progress_bar.sensitive = !this.info.get_is_queued ();
     }
 
     private void update_progress () {
@@ -0,0 +1,411 @@
+/*
+* Copyright (c) 2017 elementary LLC
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 3 of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+* Boston, MA 02111-1307, USA.
+*/
+
+/* Drives Marlin.Thumbnailer against a mock tumbler service running on a private session bus.
+ *
+ * The following environment variables tune the run:
+ *   MARLIN_BENCH_N_FILES           number of images in the synthetic folder (default 300)
+ *   MARLIN_BENCH_N_VIEWS           number of views showing the folder (default 2)
+ *   MOCK_TUMBLER_DELAY_MS          time the mock takes per thumbnail (default 2)
+ *   MOCK_TUMBLER_FAILURE_RATE      fraction of thumbnails reported as failed (default 0.0)
+ */
+
+const string TUMBLER_NAME = "org.freedesktop.thumbnails.Thumbnailer1";
+const string TUMBLER_PATH = "/org/freedesktop/thumbnails/Thumbnailer1";
+
+/* Number of files visible in a simulated view and the margin thumbnailed either side, as in AbstractDirectoryView */
+const int VISIBLE_FILES = 40;
+const int VISIBLE_MARGIN = 50;
+const uint SCROLL_INTERVAL_MSEC = 30;
+const uint N_CHANGED_FILES = 20;
+
+[DBus (name = "org.freedesktop.thumbnails.Thumbnailer1")]
+public class MockTumbler : GLib.Object {
+    public signal void started (uint handle);
+    public signal void finished (uint handle);
+    public signal void ready (uint handle, string[] uris);
+    public signal void error (uint handle, string[] failed_uris, int error_code, string message);
+
+    private class Job {
+        public uint handle;
+        public string[] uris;
+        public int next = 0;
+    }
+
+    private uint delay_ms;
+    private double failure_rate;
+    private uint last_handle = 0;
+    private Gee.LinkedList<Job> jobs = new Gee.LinkedList<Job> ();
+    private Gee.HashSet<string> in_flight = new Gee.HashSet<string> ();
+    private uint source_id = 0;
+
+    private Mutex stats_lock = Mutex ();
+    private uint n_requests = 0;
+    private uint n_uris = 0;
+    private uint n_duplicates = 0;
+
+    public MockTumbler (uint delay_ms, double failure_rate) {
+        this.delay_ms = delay_ms;
+        this.failure_rate = failure_rate;
+    }
+
+    public uint queue (string[] uris, string[] mime_types, string flavor,
+                       string scheduler, uint handle_to_unqueue) throws GLib.Error {
+        var job = new Job ();
+        job.handle = ++last_handle;
+        job.uris = uris;
+
+        stats_lock.@lock ();
+        n_requests++;
+        foreach (string uri in uris) {
+            n_uris++;
+            if (!in_flight.add (flavor + ":" + uri)) {
+                n_duplicates++;
+            }
+        }
+        stats_lock.unlock ();
+
+        jobs.offer_tail (job);
+        schedule_next ();
+        return job.handle;
+    }
+
+    public void dequeue (uint handle) throws GLib.Error {
+        foreach (var job in jobs) {
+            if (job.handle == handle) {
+                stats_lock.@lock ();
+                for (int i = job.next; i < job.uris.length; i++) {
+                    in_flight.remove ("normal:" + job.uris[i]);
+                    in_flight.remove ("large:" + job.uris[i]);
+                }
+                stats_lock.unlock ();
+
+                jobs.remove (job);
+                finished (handle);
+                break;
+            }
+        }
+    }
+
+    public void get_supported (out string[] uri_schemes, out string[] mime_types) throws GLib.Error {
+        uri_schemes = {"file"};
+        mime_types = {"image/png"};
+    }
+
+    [DBus (visible = false)]
+    public void get_stats (out uint requests, out uint uris, out uint duplicates) {
+        stats_lock.@lock ();
+        requests = n_requests;
+        uris = n_uris;
+        duplicates = n_duplicates;
+        stats_lock.unlock ();
+    }
+
+    private void schedule_next () {
+        if (source_id > 0 || jobs.is_empty) {
+            return;
+        }
+
+        /* Always called from the service thread, so attach to its context rather than the default one */
+        var source = new GLib.TimeoutSource (delay_ms);
+        source.set_callback (() => {
+            source_id = 0;
+            process_next ();
+            schedule_next ();
+            return false;
+        });
+        source_id = source.attach (GLib.MainContext.get_thread_default ());
+    }
+
+    private void process_next () {
+        var job = jobs.peek_head ();
+        if (job == null) {
+            return;
+        }
+
+        if (job.next == 0) {
+            started (job.handle);
+        }
+
+        /* The flavor is not needed to tell thumbnails apart in the statistics of a single run */
+        string uri = job.uris[job.next++];
+        stats_lock.@lock ();
+        in_flight.remove ("normal:" + uri);
+        in_flight.remove ("large:" + uri);
+        stats_lock.unlock ();
+
+        if (GLib.Random.next_double () < failure_rate) {
+            error (job.handle, {uri}, 1, "Mock failure");
+        } else {
+            ready (job.handle, {uri});
+        }
+
+        if (job.next >= job.uris.length) {
+            jobs.poll_head ();
+            finished (job.handle);
+        }
+    }
+}
+
+/* Runs the mock service in its own thread, with its own connection and main context, so that
+ * synchronous calls made by the thumbnailer from the main thread do not deadlock */
+class MockTumblerService {
+    public MockTumbler tumbler;
+    private string address;
+    private GLib.MainLoop? loop = null;
+    private GLib.Thread<void*>? thread = null;
+    private Mutex ready_lock = Mutex ();
+    private Cond ready_cond = Cond ();
+    private bool is_ready = false;
+
+    public MockTumblerService (string address, uint delay_ms, double failure_rate) {
+        this.address = address;
+        tumbler = new MockTumbler (delay_ms, failure_rate);
+    }
+
+    public void start () {
+        thread = new GLib.Thread<void*> ("mock-tumbler", run);
+        ready_lock.@lock ();
+        while (!is_ready) {
+            ready_cond.wait (ready_lock);
+        }
+        ready_lock.unlock ();
+    }
+
+    public void stop () {
+        loop.quit ();
+        thread.join ();
+    }
+
+    private void* run () {
+        var context = new GLib.MainContext ();
+        context.push_thread_default ();
+        loop = new GLib.MainLoop (context);
+
+        try {
+            var connection = new GLib.DBusConnection.for_address_sync (address,
+                                                                       GLib.DBusConnectionFlags.AUTHENTICATION_CLIENT |
+                                                                       GLib.DBusConnectionFlags.MESSAGE_BUS_CONNECTION);
+            connection.register_object (TUMBLER_PATH, tumbler);
+            connection.call_sync ("org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+                                  "RequestName", new GLib.Variant ("(su)", TUMBLER_NAME, 0x4),
+                                  null, GLib.DBusCallFlags.NONE, -1);
+        } catch (GLib.Error e) {
+            error ("Could not start mock thumbnailer - %s", e.message);
+        }
+
+        ready_lock.@lock ();
+        is_ready = true;
+        ready_cond.signal ();
+        ready_lock.unlock ();
+
+        loop.run ();
+        context.pop_thread_default ();
+        return null;
+    }
+}
+
+/* Mimics the thumbnail scheduling of AbstractDirectoryView: each view scrolls through the folder,
+ * requesting the visible files plus a margin, but only those whose thumb state is unknown */
+class SimulatedView {
+    public uint n_requests = 0;
+    private Marlin.Thumbnailer thumbnailer;
+    private GOF.File[] files;
+    private int first_visible = 0;
+    private int thumbnail_request = -1;
+
+    public SimulatedView (Marlin.Thumbnailer thumbnailer, GOF.File[] files) {
+        this.thumbnailer = thumbnailer;
+        this.files = files;
+    }
+
+    /* Returns false when the end of the folder has been reached */
+    public bool scroll () {
+        if (first_visible >= files.length) {
+            return false;
+        }
+
+        GLib.List<GOF.File> visible_files = null;
+        int start = int.max (0, first_visible - VISIBLE_MARGIN);
+        int end = int.min (files.length, first_visible + VISIBLE_FILES + VISIBLE_MARGIN);
+        for (int i = start; i < end; i++) {
+            if (files[i].flags == GOF.File.ThumbState.UNKNOWN) {
+                visible_files.prepend (files[i]);
+            }
+        }
+
+        visible_files.reverse ();
+        if (visible_files != null && thumbnailer.queue_files (visible_files, out thumbnail_request, false)) {
+            n_requests++;
+        }
+
+        first_visible += VISIBLE_FILES / 2;
+        return true;
+    }
+
+    public void file_changed (GOF.File file) {
+        if (thumbnailer.queue_file (file, null, false)) {
+            n_requests++;
+        }
+    }
+}
+
+uint get_env_uint (string name, uint default_value) {
+    var val = GLib.Environment.get_variable (name);
+    return val != null ? (uint)uint64.parse (val) : default_value;
+}
+
+double get_env_double (string name, double default_value) {
+    var val = GLib.Environment.get_variable (name);
+    return val != null ? double.parse (val) : default_value;
+}
+
+GOF.File[] setup_image_folder (string path, uint n_files) {
+    string template_path = Path.build_filename (Config.TESTDATA_DIR, "images", "testimage.png");
+    GOF.File[] files = {};
+
+    Posix.system ("mkdir -p " + path);
+    for (uint i = 0; i < n_files; i++) {
+        string pth = Path.build_filename (path, "image-%u.png".printf (i));
+        Posix.system ("cp --no-clobber " + template_path + " " + pth);
+        var file = GOF.File.get_by_uri (pth);
+        file.query_update ();
+        files += file;
+    }
+
+    return files;
+}
+
+bool all_done (GOF.File[] files) {
+    foreach (var file in files) {
+        if (file.flags == GOF.File.ThumbState.UNKNOWN || file.flags == GOF.File.ThumbState.LOADING) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void thumbnail_pipeline_benchmark () {
+    uint n_files = get_env_uint ("MARLIN_BENCH_N_FILES", 300);
+    uint n_views = get_env_uint ("MARLIN_BENCH_N_VIEWS", 2);
+    uint delay_ms = get_env_uint ("MOCK_TUMBLER_DELAY_MS", 2);
+    double failure_rate = get_env_double ("MOCK_TUMBLER_FAILURE_RATE", 0.0);
+
+    var test_bus = new GLib.TestDBus (GLib.TestDBusFlags.NONE);
+    test_bus.up ();
+
+    var service = new MockTumblerService (test_bus.get_bus_address (), delay_ms, failure_rate);
+    service.start ();
+
+    string test_dir_path = "/tmp/marlin-thumbnail-bench-" + get_real_time ().to_string ();
+    var files = setup_image_folder (test_dir_path, n_files);
+
+    var thumbnailer = Marlin.Thumbnailer.get ();
+    assert (thumbnailer != null);
+
+    SimulatedView[] views = {};
+    for (uint i = 0; i < n_views; i++) {
+        views += new SimulatedView (thumbnailer, files);
+    }
+
+    var loop = new GLib.MainLoop ();
+    int64 start_time = get_monotonic_time ();
+    int64 first_thumbnail_time = -1;
+    uint n_changed = 0;
+
+    /* All views scroll at the same pace then some files change, as seen by every view */
+    GLib.Timeout.add (SCROLL_INTERVAL_MSEC, () => {
+        bool scrolling = false;
+        foreach (var view in views) {
+            scrolling = view.scroll () || scrolling;
+        }
+
+        if (scrolling) {
+            return true;
+        }
+
+        if (n_changed < N_CHANGED_FILES && n_changed < n_files) {
+            var file = files[GLib.Random.int_range (0, (int32)n_files)];
+            file.flags = GOF.File.ThumbState.UNKNOWN;
+            foreach (var view in views) {
+                view.file_changed (file);
+            }
+
+            n_changed++;
+            return true;
+        }
+
+        return false;
+    });
+
+    GLib.Timeout.add (1, () => {
+        if (first_thumbnail_time < 0) {
+            foreach (var file in files) {
+                if (file.flags == GOF.File.ThumbState.READY || file.flags == GOF.File.ThumbState.NONE) {
+                    first_thumbnail_time = get_monotonic_time ();
+                    break;
+                }
+            }
+        }
+
+        if (n_changed >= uint.min (N_CHANGED_FILES, n_files) && all_done (files)) {
+            loop.quit ();
+            return false;
+        }
+
+        return true;
+    });
+
+    loop.run ();
+    int64 elapsed = get_monotonic_time () - start_time;
+
+    uint n_view_requests = 0;
+    foreach (var view in views) {
+        n_view_requests += view.n_requests;
+    }
+
+    uint n_daemon_requests, n_uris, n_duplicates;
+    service.tumbler.get_stats (out n_daemon_requests, out n_uris, out n_duplicates);
+
+    print ("\n");
+    print ("files: %u  views: %u  mock delay: %u ms  failure rate: %.2f\n", n_files, n_views, delay_ms, failure_rate);
+    print ("time to first thumbnail: %.1f ms\n", (first_thumbnail_time - start_time) / 1000.0);
+    print ("total time: %.1f ms  throughput: %.1f thumbnails/s\n",
+           elapsed / 1000.0, n_uris / (elapsed / 1000000.0));
+    print ("view requests: %u  daemon requests: %u  uris sent: %u  duplicated in flight: %u\n",
+           n_view_requests, n_daemon_requests, n_uris, n_duplicates);
+
+    /* The thumbnailer must not send a uri to the daemon while it is already in flight */
+    assert (n_duplicates == 0);
+    /* Single file change requests from all views must have been merged */
+    assert (n_daemon_requests < n_view_requests);
+
+    service.stop ();
+    test_bus.down ();
+    Posix.system ("rm -rf " + test_dir_path);
+}
+
+int main (string[] args) {
+    Test.init (ref args);
+
+    Test.add_func ("/Thumbnailer/pipeline_benchmark", thumbnail_pipeline_benchmark);
+
+    return Test.run ();
+}